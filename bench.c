@@ -0,0 +1,765 @@
+// Microbenchmarks for the core Pokedex data structures.
+//
+// Build (links everything in ex6.c except main):
+//   gcc -O2 -std=c99 -pthread -DEX6_NO_MAIN ex6.c bench.c -o bench
+// Run:
+//   ./bench                 default sizes 1000 and 8000
+//   ./bench 500 2000 16000  custom sizes
+//   ./bench --csv ...       machine-readable output
+//
+// Every operation is timed one call at a time with CLOCK_MONOTONIC, so the
+// percentiles include roughly 20-30ns of timer overhead per sample.
+#include "ex6.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+# define DEFAULT_SIZES 2
+# define MAX_SIZES 16
+# define TRAVERSAL_REPEATS 20
+# define OWNER_REPEATS 5
+# define MERGE_REPEATS 200
+# define NAME_LEN 12
+# define BATTLE_REPEATS 20
+# define CIRCULAR_LINES 1000000
+# define BATTLES_PER_CALL 200000
+
+typedef enum
+{
+    KEYS_SORTED,
+    KEYS_RANDOM,
+    KEYS_ADVERSARIAL
+} KeyOrder;
+
+static const char *orderNames[] = {"sorted", "random", "adversarial"};
+
+static int csvOutput = 0;
+static unsigned long long rngState = 0x9E3779B97F4A7C15ULL;
+static unsigned long long visitSink = 0;
+
+// --------------------------------------------------------------
+// Helpers
+// --------------------------------------------------------------
+
+static unsigned long long nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static unsigned int nextRand(void) {
+    // xorshift64*
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (unsigned int)((rngState * 2685821657736338717ULL) >> 32);
+}
+
+static void shuffle(int *values, int n) {
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)(nextRand() % (unsigned int)(i + 1));
+        int t = values[i];
+        values[i] = values[j];
+        values[j] = t;
+    }
+}
+
+// Keys 1..n in the requested insertion order. Adversarial is a zig-zag
+// (1, n, 2, n-1, ...) that degenerates the tree just like sorted input but
+// alternates the branch taken at every level.
+static int *makeKeys(int n, KeyOrder order) {
+    int *keys = (int *)malloc(sizeof(int) * n);
+    if (keys == NULL)
+        return NULL;
+    for (int i = 0; i < n; i++)
+        keys[i] = i + 1;
+    if (order == KEYS_RANDOM) {
+        shuffle(keys, n);
+    } else if (order == KEYS_ADVERSARIAL) {
+        int lo = 1, hi = n;
+        for (int i = 0; i < n; i++)
+            keys[i] = (i % 2 == 0) ? lo++ : hi--;
+    }
+    return keys;
+}
+
+// A node with a synthetic key; display fields borrow a real species
+static PokemonNode *benchNode(int id) {
+    const PokemonData *species = &pokedex[(id - 1) % 151];
+    PokemonNode *node = createPokemonNode(species->name);
+    if (node != NULL)
+        node->id = id;
+    return node;
+}
+
+static int compareU64(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *op, const char *order, int n, unsigned long long *samples, int count) {
+    if (count <= 0)
+        return;
+    unsigned long long total = 0;
+    for (int i = 0; i < count; i++)
+        total += samples[i];
+    qsort(samples, count, sizeof(unsigned long long), compareU64);
+    double opsPerSec = total ? (double)count * 1e9 / (double)total : 0.0;
+    unsigned long long p50 = samples[count / 2];
+    unsigned long long p90 = samples[(int)(count * 0.90)];
+    unsigned long long p99 = samples[(int)(count * 0.99)];
+    unsigned long long max = samples[count - 1];
+    if (csvOutput) {
+        printf("%s,%s,%d,%d,%.0f,%llu,%llu,%llu,%llu\n", op, order, n, count, opsPerSec, p50, p90, p99, max);
+    } else {
+        printf("%-20s %-12s %8d %8d %14.0f %10llu %10llu %10llu %12llu\n",
+               op, order, n, count, opsPerSec, p50, p90, p99, max);
+    }
+}
+
+static void countVisit(PokemonNode *node) {
+    visitSink += (unsigned long long)node->id;
+}
+
+static VisitResult countVisitWith(PokemonNode *node, void *context) {
+    *(unsigned long long *)context += (unsigned long long)node->id;
+    return VISIT_CONTINUE;
+}
+
+static VisitResult countVisitBatch(PokemonNode **nodes, int count, void *context) {
+    unsigned long long sum = 0;
+    for (int i = 0; i < count; i++)
+        sum += (unsigned long long)nodes[i]->id;
+    *(unsigned long long *)context += sum;
+    return VISIT_CONTINUE;
+}
+
+// displayAlphabetical prints; send stdout to /dev/null meanwhile
+static int silenceStdout(void) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    if (devNull >= 0) {
+        dup2(devNull, STDOUT_FILENO);
+        close(devNull);
+    }
+    return saved;
+}
+
+static void restoreStdout(int saved) {
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+}
+
+// --------------------------------------------------------------
+// BST benchmarks
+// --------------------------------------------------------------
+
+static void benchTree(int n, KeyOrder order) {
+    const char *orderName = orderNames[order];
+    int *keys = makeKeys(n, order);
+    int samplesCap = n > TRAVERSAL_REPEATS ? n : TRAVERSAL_REPEATS;
+    unsigned long long *samples = (unsigned long long *)malloc(sizeof(unsigned long long) * samplesCap);
+    if (keys == NULL || samples == NULL) {
+        free(keys);
+        free(samples);
+        printf("Memory allocation failed.\n");
+        return;
+    }
+
+    // insertPokemonNode: build the whole tree, one timed insert per key
+    PokemonNode *root = NULL;
+    for (int i = 0; i < n; i++) {
+        PokemonNode *node = benchNode(keys[i]);
+        unsigned long long t0 = nowNs();
+        root = insertPokemonNode(root, node);
+        samples[i] = nowNs() - t0;
+    }
+    report("insertPokemonNode", orderName, n, samples, n);
+
+    // searchPokemon: every key once, in random order
+    int *probe = makeKeys(n, KEYS_RANDOM);
+    if (probe != NULL) {
+        for (int i = 0; i < n; i++) {
+            unsigned long long t0 = nowNs();
+            PokemonNode *found = searchPokemon(root, probe[i]);
+            samples[i] = nowNs() - t0;
+            visitSink += found != NULL;
+        }
+        report("searchPokemon", orderName, n, samples, n);
+
+        // frozenSearch: the same probes against the Eytzinger copy
+        FrozenPokedex *frozen = freezeTree(root);
+        if (frozen != NULL) {
+            for (int i = 0; i < n; i++) {
+                unsigned long long t0 = nowNs();
+                const PokemonData *found = frozenSearch(frozen, probe[i]);
+                samples[i] = nowNs() - t0;
+                visitSink += found != NULL;
+            }
+            report("frozenSearch", orderName, n, samples, n);
+            freeFrozen(frozen);
+        }
+    }
+
+    // Traversals: whole-tree walks with a trivial visitor
+    struct
+    {
+        const char *name;
+        void (*walk)(PokemonNode *, VisitNodeFunc);
+    } walks[] = {
+        {"BFSGeneric", BFSGeneric},
+        {"preOrderGeneric", preOrderGeneric},
+        {"inOrderGeneric", inOrderGeneric},
+        {"postOrderGeneric", postOrderGeneric},
+    };
+    for (size_t w = 0; w < sizeof(walks) / sizeof(walks[0]); w++) {
+        for (int r = 0; r < TRAVERSAL_REPEATS; r++) {
+            unsigned long long t0 = nowNs();
+            walks[w].walk(root, countVisit);
+            samples[r] = nowNs() - t0;
+        }
+        report(walks[w].name, orderName, n, samples, TRAVERSAL_REPEATS);
+    }
+
+    // The same walks through the context visitors, one node and one batch per call
+    static const struct
+    {
+        const char *name;
+        TraversalOrder order;
+    } visitOrders[] = {
+        {"bfs", ORDER_BFS},
+        {"pre", ORDER_PRE},
+        {"in", ORDER_IN},
+        {"post", ORDER_POST},
+    };
+    for (size_t v = 0; v < sizeof(visitOrders) / sizeof(visitOrders[0]); v++) {
+        char name[32];
+        unsigned long long sum = 0;
+        for (int r = 0; r < TRAVERSAL_REPEATS; r++) {
+            unsigned long long t0 = nowNs();
+            traverseWith(root, visitOrders[v].order, countVisitWith, &sum);
+            samples[r] = nowNs() - t0;
+        }
+        snprintf(name, sizeof(name), "traverseWith/%s", visitOrders[v].name);
+        report(name, orderName, n, samples, TRAVERSAL_REPEATS);
+        for (int r = 0; r < TRAVERSAL_REPEATS; r++) {
+            unsigned long long t0 = nowNs();
+            traverseBatched(root, visitOrders[v].order, countVisitBatch, &sum);
+            samples[r] = nowNs() - t0;
+        }
+        snprintf(name, sizeof(name), "traverseBatched/%s", visitOrders[v].name);
+        report(name, orderName, n, samples, TRAVERSAL_REPEATS);
+        visitSink += sum;
+    }
+
+    int saved = silenceStdout();
+    for (int r = 0; r < TRAVERSAL_REPEATS; r++) {
+        unsigned long long t0 = nowNs();
+        displayAlphabetical(root);
+        samples[r] = nowNs() - t0;
+    }
+    restoreStdout(saved);
+    report("displayAlphabetical", orderName, n, samples, TRAVERSAL_REPEATS);
+
+    // removeNodeBST: tear the tree down in random order
+    if (probe != NULL) {
+        shuffle(probe, n);
+        for (int i = 0; i < n; i++) {
+            unsigned long long t0 = nowNs();
+            root = removeNodeBST(root, probe[i]);
+            samples[i] = nowNs() - t0;
+        }
+        report("removeNodeBST", orderName, n, samples, n);
+    }
+    freePokemonTree(root);
+    rcuSynchronize();
+
+    free(probe);
+    free(samples);
+    free(keys);
+}
+
+// --------------------------------------------------------------
+// Merge benchmark (mergePokeDex copies by species, so it is capped at 151)
+// --------------------------------------------------------------
+
+static void benchMerge(KeyOrder order) {
+    unsigned long long samples[MERGE_REPEATS];
+    int *keys = makeKeys(151, order);
+    if (keys == NULL)
+        return;
+    for (int r = 0; r < MERGE_REPEATS; r++) {
+        OwnerNode a, b;
+        memset(&a, 0, sizeof(a));
+        memset(&b, 0, sizeof(b));
+        // Overlapping halves: A gets keys[0..100), B gets keys[50..151)
+        for (int i = 0; i < 100; i++)
+            a.pokedexRoot = insertPokemonNode(a.pokedexRoot, createPokemonNode(pokedex[keys[i] - 1].name));
+        for (int i = 50; i < 151; i++)
+            b.pokedexRoot = insertPokemonNode(b.pokedexRoot, createPokemonNode(pokedex[keys[i] - 1].name));
+        unsigned long long t0 = nowNs();
+        mergePokeDex(&a, &b);
+        samples[r] = nowNs() - t0;
+        freePokemonTree(a.pokedexRoot);
+        freePokemonTree(b.pokedexRoot);
+    }
+    report("mergePokeDex", orderNames[order], 151, samples, MERGE_REPEATS);
+    free(keys);
+}
+
+// --------------------------------------------------------------
+// Node allocators: the same add/release churn on malloc and on a pool
+// --------------------------------------------------------------
+
+static void benchNodeAllocator(const char *label, Allocator *allocator) {
+    unsigned long long samples[MERGE_REPEATS];
+    int *keys = makeKeys(151, KEYS_RANDOM);
+    Registry *reg = registryCreate();
+    OwnerNode *owner = NULL;
+    allocatorSet(ALLOC_TAG_NODES, allocator);
+    if (keys != NULL && reg != NULL && registryAddOwner(reg, "Bench", 1, &owner) == POKE_OK) {
+        // Undo history makes every change copy a path of nodes
+        registrySetUndoDepth(reg, POKEDEX_UNDO_DEPTH);
+        for (int r = 0; r < MERGE_REPEATS; r++) {
+            unsigned long long t0 = nowNs();
+            for (int i = 0; i < 151; i++)
+                pokedexAddPokemon(reg, owner, keys[i], NULL);
+            for (int i = 0; i < 151; i++)
+                pokedexReleasePokemon(reg, owner, keys[i], NULL);
+            samples[r] = (nowNs() - t0) / 302;
+        }
+        report("addRelease/nodes", label, 151, samples, MERGE_REPEATS);
+    }
+    registryDestroy(reg);
+    allocatorSet(ALLOC_TAG_NODES, NULL);
+    free(keys);
+}
+
+// --------------------------------------------------------------
+// Library API round trip (add then release every species, as a service would)
+// --------------------------------------------------------------
+
+static void benchLibrary(KeyOrder order) {
+    unsigned long long samples[151 * MERGE_REPEATS];
+    int *keys = makeKeys(151, order);
+    Registry *reg = registryCreate();
+    OwnerNode *owner = NULL;
+    if (keys == NULL || reg == NULL || registryAddOwner(reg, "Bench", 1, &owner) != POKE_OK) {
+        free(keys);
+        registryDestroy(reg);
+        return;
+    }
+    pokedexReleasePokemon(reg, owner, 1, NULL);
+    int count = 0;
+    for (int r = 0; r < MERGE_REPEATS; r++) {
+        for (int i = 0; i < 151; i++) {
+            unsigned long long t0 = nowNs();
+            pokedexAddPokemon(reg, owner, keys[i], NULL);
+            samples[count++] = nowNs() - t0;
+        }
+        for (int i = 0; i < 151; i++)
+            pokedexReleasePokemon(reg, owner, keys[i], NULL);
+    }
+    report("pokedexAddPokemon", orderNames[order], 151, samples, count);
+    count = 0;
+    for (int r = 0; r < MERGE_REPEATS; r++) {
+        for (int i = 0; i < 151; i++)
+            pokedexAddPokemon(reg, owner, keys[i], NULL);
+        for (int i = 0; i < 151; i++) {
+            unsigned long long t0 = nowNs();
+            pokedexReleasePokemon(reg, owner, keys[i], NULL);
+            samples[count++] = nowNs() - t0;
+        }
+    }
+    report("pokedexRelease", orderNames[order], 151, samples, count);
+
+    // Same adds with undo history on: every add path-copies
+    registrySetUndoDepth(reg, POKEDEX_UNDO_DEPTH);
+    count = 0;
+    for (int r = 0; r < MERGE_REPEATS; r++) {
+        for (int i = 0; i < 151; i++) {
+            unsigned long long t0 = nowNs();
+            pokedexAddPokemon(reg, owner, keys[i], NULL);
+            samples[count++] = nowNs() - t0;
+        }
+        for (int i = 0; i < 151; i++)
+            pokedexReleasePokemon(reg, owner, keys[i], NULL);
+    }
+    report("pokedexAdd/undo", orderNames[order], 151, samples, count);
+
+    // pokedexAddMany: all 151 IDs in one call, released again in between
+    registrySetUndoDepth(reg, 0);
+    count = 0;
+    for (int r = 0; r < MERGE_REPEATS; r++) {
+        BulkResult added;
+        unsigned long long t0 = nowNs();
+        pokedexAddMany(reg, owner, keys, 151, &added);
+        samples[count++] = nowNs() - t0;
+        bulkResultFree(&added);
+        for (int i = 0; i < 151; i++)
+            pokedexReleasePokemon(reg, owner, keys[i], NULL);
+    }
+    report("pokedexAddMany", orderNames[order], 151, samples, count);
+
+    // pokedexReleaseMany: all 151 IDs (one range) in one call
+    count = 0;
+    for (int r = 0; r < MERGE_REPEATS; r++) {
+        BulkResult added, released;
+        pokedexAddMany(reg, owner, keys, 151, &added);
+        unsigned long long t0 = nowNs();
+        pokedexReleaseMany(reg, owner, keys, 151, &released);
+        samples[count++] = nowNs() - t0;
+        bulkResultFree(&added);
+        bulkResultFree(&released);
+    }
+    report("pokedexReleaseMany", orderNames[order], 151, samples, count);
+
+    // registryCloneOwner of a full Pokedex, then deleting the clone again
+    for (int i = 0; i < 151; i++)
+        pokedexAddPokemon(reg, owner, keys[i], NULL);
+    count = 0;
+    for (int r = 0; r < MERGE_REPEATS; r++) {
+        char name[NAME_LEN];
+        OwnerNode *clone = NULL;
+        snprintf(name, sizeof(name), "Clone%d", r);
+        unsigned long long t0 = nowNs();
+        PokeStatus status = registryCloneOwner(reg, owner, name, &clone);
+        samples[count++] = nowNs() - t0;
+        if (status == POKE_OK)
+            registryDeleteOwner(reg, clone);
+    }
+    report("registryCloneOwner", orderNames[order], 151, samples, count);
+
+    // pokedexSummary of a full Pokedex: read from the root, no walk
+    count = 0;
+    for (int r = 0; r < MERGE_REPEATS; r++) {
+        PokedexSummary summary;
+        unsigned long long t0 = nowNs();
+        pokedexSummary(reg, owner, &summary);
+        samples[count++] = nowNs() - t0;
+    }
+    report("pokedexSummary", orderNames[order], 151, samples, count);
+
+    // pokedexNextPage: the full Pokedex ten entries at a time, in every order
+    for (int traversal = ORDER_BFS; traversal <= ORDER_ALPHA; traversal++) {
+        static const char *pageOps[] = {"", "nextPage/bfs", "nextPage/pre", "nextPage/in",
+                                        "nextPage/post", "nextPage/alpha"};
+        const PokemonData *page[10];
+        count = 0;
+        for (int r = 0; r < MERGE_REPEATS; r++) {
+            PokedexCursor cursor;
+            pokedexCursorInit(&cursor, (TraversalOrder)traversal);
+            while (!cursor.done) {
+                int got = 0;
+                unsigned long long t0 = nowNs();
+                PokeStatus status = pokedexNextPage(reg, owner, &cursor, page, 10, &got);
+                samples[count++] = nowNs() - t0;
+                visitSink += (unsigned long long)got;
+                if (status != POKE_OK)
+                    break;
+            }
+        }
+        report(pageOps[traversal], orderNames[order], 151, samples, count);
+    }
+
+    // pokedexTeamMatchup: the full Pokedex against a clone, both solvers
+    OwnerNode *rival = NULL;
+    if (registryCloneOwner(reg, owner, "Rival", &rival) == POKE_OK) {
+        MatchupResult matchup;
+        for (int method = MATCHUP_GREEDY; method <= MATCHUP_EXACT; method++) {
+            count = 0;
+            for (int r = 0; r < MERGE_REPEATS; r++) {
+                unsigned long long t0 = nowNs();
+                pokedexTeamMatchup(reg, owner, rival, (MatchupMethod)method, &matchup);
+                samples[count++] = nowNs() - t0;
+                visitSink += (unsigned long long)matchup.wins;
+                matchupResultFree(&matchup);
+            }
+            report(method == MATCHUP_GREEDY ? "teamMatchup/greedy" : "teamMatchup/exact",
+                   orderNames[order], 151, samples, count);
+        }
+    }
+
+    // Species lookups by ID and by name: one sample per pass over all 151,
+    // in nanoseconds per lookup
+    for (int byName = 0; byName <= 1; byName++) {
+        for (int r = 0; r < MERGE_REPEATS; r++) {
+            unsigned long long t0 = nowNs();
+            for (int i = 0; i < 151; i++) {
+                const PokemonData *species = byName ? findSpeciesByName(pokedex[keys[i] - 1].name)
+                                                    : findSpecies(keys[i]);
+                visitSink += (unsigned long long)(species != NULL);
+            }
+            samples[r] = (nowNs() - t0) / 151;
+        }
+        report(byName ? "findSpeciesByName" : "findSpecies", orderNames[order], 151, samples, MERGE_REPEATS);
+    }
+    registryDestroy(reg);
+    free(keys);
+}
+
+// --------------------------------------------------------------
+// Battle simulator: samples are nanoseconds per battle, so ops/sec reads as
+// battles per second (all cores, then one)
+// --------------------------------------------------------------
+static void benchBattles(int threads, const char *label) {
+    unsigned long long samples[BATTLE_REPEATS];
+    for (int r = 0; r < BATTLE_REPEATS; r++) {
+        // A spread of matchups: one-sided, even, and long type-resisted ones
+        const PokemonData *first = findSpecies(1 + (r * 37) % 151);
+        const PokemonData *second = findSpecies(1 + (r * 61 + 11) % 151);
+        BattleStats stats;
+        unsigned long long t0 = nowNs();
+        simulateBattles(first, second, BATTLES_PER_CALL, (unsigned long long)r, threads, &stats);
+        samples[r] = (nowNs() - t0) / BATTLES_PER_CALL;
+        visitSink += (unsigned long long)stats.firstWins;
+    }
+    report("simulateBattles", label, BATTLES_PER_CALL, samples, BATTLE_REPEATS);
+}
+
+// --------------------------------------------------------------
+// Owner ring benchmarks
+// --------------------------------------------------------------
+
+static InternedName *ownerName(Registry *reg, int rank) {
+    char name[NAME_LEN];
+    snprintf(name, sizeof(name), "Owner%06d", rank);
+    return internName(&reg->names, name, strlen(name));
+}
+
+// Ring of n owners whose names sort in the given order (adversarial = reversed)
+static void buildRing(Registry *reg, int n, KeyOrder order) {
+    int *keys = makeKeys(n, order == KEYS_ADVERSARIAL ? KEYS_SORTED : order);
+    if (keys == NULL)
+        return;
+    for (int i = 0; i < n; i++) {
+        int rank = order == KEYS_ADVERSARIAL ? n + 1 - keys[i] : keys[i];
+        OwnerNode *owner = createOwner(ownerName(reg, rank), NULL);
+        if (owner != NULL)
+            linkOwnerInCircularList(reg, owner);
+    }
+    free(keys);
+}
+
+// Gives every owner in the ring a spread of eight species
+static void fillRing(Registry *reg) {
+    int ids[8];
+    for (int i = 1; i <= reg->count; i++) {
+        for (int k = 0; k < 8; k++)
+            ids[k] = 1 + (i * 7 + k * 19) % 151;
+        BulkResult result;
+        pokedexAddMany(reg, registryOwnerAt(reg, i), ids, 8, &result);
+        bulkResultFree(&result);
+    }
+}
+
+// Every other owner folded into the first: pairwise merges, then one N-way merge
+static void benchMergeMany(Registry *reg, int n, const char *orderName, KeyOrder order,
+                           unsigned long long *samples) {
+    OwnerNode **sources = (OwnerNode **)malloc(sizeof(OwnerNode *) * n);
+    if (sources == NULL)
+        return;
+    for (int r = 0; r < OWNER_REPEATS; r++) {
+        buildRing(reg, n, order);
+        fillRing(reg);
+        OwnerNode *into = reg->head;
+        unsigned long long t0 = nowNs();
+        while (reg->head->next != reg->head)
+            registryMergeOwners(reg, into, into->next);
+        samples[r] = nowNs() - t0;
+        freeAllOwners(reg);
+    }
+    report("mergeOwners/each", orderName, n, samples, OWNER_REPEATS);
+    for (int r = 0; r < OWNER_REPEATS; r++) {
+        buildRing(reg, n, order);
+        fillRing(reg);
+        OwnerNode *into = reg->head;
+        int count = 0;
+        for (OwnerNode *owner = into->next; owner != into; owner = owner->next)
+            sources[count++] = owner;
+        MergeManyResult result;
+        unsigned long long t0 = nowNs();
+        registryMergeMany(reg, into, sources, count, 0, &result);
+        samples[r] = nowNs() - t0;
+        freeAllOwners(reg);
+    }
+    report("registryMergeMany", orderName, n, samples, OWNER_REPEATS);
+    free(sources);
+}
+
+// Queries over n owners holding 40 random species each
+static void benchQuery(int n) {
+    static const char *queries[][2] = {
+        {"one-owner", "owner=Owner000001 type=FIRE sort=-attack limit=5"},
+        {"all/type", "type=DRAGON hp>60 limit=20"},
+        {"all/top-hp", "sort=-hp limit=10"},
+        {"all/scan", "id>=100 id<=110 attack>80"},
+    };
+    unsigned long long samples[OWNER_REPEATS * 4];
+    Registry *reg = registryCreate();
+    if (reg == NULL)
+        return;
+    buildRing(reg, n, KEYS_RANDOM);
+    int ids[40];
+    for (int i = 1; i <= reg->count; i++) {
+        for (int k = 0; k < 40; k++)
+            ids[k] = 1 + (int)(nextRand() % 151);
+        BulkResult result;
+        pokedexAddMany(reg, registryOwnerAt(reg, i), ids, 40, &result);
+        bulkResultFree(&result);
+    }
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        Query query;
+        if (queryCompile(queries[q][1], &query) != POKE_OK)
+            continue;
+        for (int r = 0; r < OWNER_REPEATS * 4; r++) {
+            QueryResult result;
+            unsigned long long t0 = nowNs();
+            queryRun(reg, &query, &result);
+            samples[r] = nowNs() - t0;
+            visitSink += (unsigned long long)result.count;
+            queryResultFree(&result);
+        }
+        char label[32];
+        snprintf(label, sizeof(label), "query/%s", queries[q][0]);
+        report(label, "random", n, samples, OWNER_REPEATS * 4);
+    }
+    registryDestroy(reg);
+}
+
+static void benchOwners(int n, KeyOrder order) {
+    const char *orderName = orderNames[order];
+    unsigned long long *samples = (unsigned long long *)malloc(sizeof(unsigned long long) * (n + OWNER_REPEATS));
+    Registry *reg = registryCreate();
+    if (samples == NULL || reg == NULL) {
+        free(samples);
+        registryDestroy(reg);
+        return;
+    }
+
+    // registrySortOwners: one timed sort per freshly built ring
+    for (int r = 0; r < OWNER_REPEATS; r++) {
+        buildRing(reg, n, order);
+        unsigned long long t0 = nowNs();
+        registrySortOwners(reg);
+        samples[r] = nowNs() - t0;
+        freeAllOwners(reg);
+    }
+    report("sortOwners", orderName, n, samples, OWNER_REPEATS);
+    benchMergeMany(reg, n, orderName, order, samples);
+
+    // findOwnerByName: every owner once (random order) plus as many misses
+    buildRing(reg, n, order);
+    int *probe = makeKeys(n, KEYS_RANDOM);
+    char name[NAME_LEN];
+    if (probe != NULL) {
+        for (int i = 0; i < n; i++) {
+            snprintf(name, sizeof(name), "Owner%06d", probe[i]);
+            unsigned long long t0 = nowNs();
+            OwnerNode *found = findOwnerByName(reg, name);
+            samples[i] = nowNs() - t0;
+            visitSink += found != NULL;
+        }
+        report("findOwnerByName/hit", orderName, n, samples, n);
+        int misses = n < 1000 ? n : 1000;
+        for (int i = 0; i < misses; i++) {
+            snprintf(name, sizeof(name), "Nobody%05d", i);
+            unsigned long long t0 = nowNs();
+            OwnerNode *found = findOwnerByName(reg, name);
+            samples[i] = nowNs() - t0;
+            visitSink += found != NULL;
+        }
+        report("findOwnerByName/miss", orderName, n, samples, misses);
+
+        // Leaderboard: every add moves its owner, then ranks and a top-10 page
+        for (int i = 0; i < n; i++) {
+            OwnerNode *owner = registryOwnerAt(reg, 1 + (probe[i] - 1) % n);
+            unsigned long long t0 = nowNs();
+            pokedexAddPokemon(reg, owner, 1 + probe[i] % 151, NULL);
+            samples[i] = nowNs() - t0;
+        }
+        report("addPokemon+rank", orderName, n, samples, n);
+        for (int i = 0; i < misses; i++) {
+            OwnerNode *owner = registryOwnerAt(reg, 1 + (probe[i] - 1) % n);
+            LeaderboardEntry entry;
+            unsigned long long t0 = nowNs();
+            registryOwnerRank(reg, owner, &entry);
+            samples[i] = nowNs() - t0;
+            visitSink += entry.rank;
+        }
+        report("registryOwnerRank", orderName, n, samples, misses);
+        for (int i = 0; i < misses; i++) {
+            LeaderboardEntry top[10];
+            int count;
+            unsigned long long t0 = nowNs();
+            registryLeaderboard(reg, 1, 10, top, &count);
+            samples[i] = nowNs() - t0;
+            visitSink += count;
+        }
+        report("registryLeaderboard", orderName, n, samples, misses);
+    }
+
+    // writeOwnersCircular: samples are nanoseconds per line written to /dev/null
+    FILE *devNull = fopen("/dev/null", "w");
+    if (devNull != NULL) {
+        for (int r = 0; r < OWNER_REPEATS; r++) {
+            unsigned long long t0 = nowNs();
+            writeOwnersCircular(reg, devNull, r & 1, CIRCULAR_LINES);
+            samples[r] = (nowNs() - t0) / CIRCULAR_LINES;
+        }
+        report("writeOwnersCircular", orderName, CIRCULAR_LINES, samples, OWNER_REPEATS);
+        fclose(devNull);
+    }
+    registryDestroy(reg);
+    free(probe);
+    free(samples);
+}
+
+int main(int argc, char **argv) {
+    int sizes[MAX_SIZES] = {1000, 8000};
+    int sizeCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csvOutput = 1;
+        } else if (sizeCount < MAX_SIZES && atoi(argv[i]) > 0) {
+            sizes[sizeCount++] = atoi(argv[i]);
+        }
+    }
+    if (sizeCount == 0)
+        sizeCount = DEFAULT_SIZES;
+
+    if (csvOutput)
+        printf("op,order,n,samples,ops_per_sec,p50_ns,p90_ns,p99_ns,max_ns\n");
+    else
+        printf("%-20s %-12s %8s %8s %14s %10s %10s %10s %12s\n",
+               "op", "order", "n", "samples", "ops/sec", "p50 ns", "p90 ns", "p99 ns", "max ns");
+
+    for (int s = 0; s < sizeCount; s++) {
+        for (int o = KEYS_SORTED; o <= KEYS_ADVERSARIAL; o++) {
+            benchTree(sizes[s], (KeyOrder)o);
+            benchOwners(sizes[s], (KeyOrder)o);
+        }
+        benchQuery(sizes[s]);
+    }
+    for (int o = KEYS_SORTED; o <= KEYS_ADVERSARIAL; o++) {
+        benchMerge((KeyOrder)o);
+        benchLibrary((KeyOrder)o);
+    }
+    benchNodeAllocator("malloc", NULL);
+    Allocator *pool = poolAllocatorCreate(sizeof(PokemonNode), 0);
+    if (pool != NULL) {
+        benchNodeAllocator("pool", pool);
+        allocatorDestroy(pool);
+    }
+    benchBattles(0, "threads=all");
+    benchBattles(1, "threads=1");
+
+    // Keeps the visitors from being optimized away
+    fprintf(stderr, "checksum %llu\n", visitSink);
+    return 0;
+}
@@ -0,0 +1,205 @@
+// Species catalog tool: builds the files speciesCatalogLoad maps (section 30).
+//
+// Build (links everything in ex6.c except main):
+//   gcc -O2 -std=c99 -pthread -DEX6_NO_MAIN ex6.c catalog.c -o catalog
+//
+// Print a catalog as CSV (the built-in 151 without a file, a good start):
+//   ./catalog dump [species.cat] > species.csv
+// Build a catalog file from CSV lines "id,name,type,hp,attack,evolvesTo":
+//   ./catalog build species.csv species.cat
+// Then run the game on it:
+//   EX6_CATALOG=species.cat ./ex6
+//
+// IDs must run 1..N without gaps (N <= SPECIES_MAX) and names must be unique.
+// type is a name as displayed (FIRE, WATER, ...), hp and attack are
+// 0..CATALOG_MAX_STAT and evolvesTo is the next stage's ID, 0 for none.
+// Blank lines and lines starting with # are skipped.
+#include "ex6.h"
+
+# define LINE_LEN 256
+
+typedef struct
+{
+    char *name;
+    int type;
+    int hp;
+    int attack;
+    int evolvesTo;
+} SpeciesRow;
+
+static SpeciesRow rows[SPECIES_MAX + 1]; // rows[id], filled from the CSV
+static int rowCount = 0;
+
+static int parseType(const char *text) {
+    for (int type = 0; type < POKEMON_TYPE_COUNT; type++) {
+        if (strcmp(text, getTypeName((PokemonType)type)) == 0)
+            return type;
+    }
+    return -1;
+}
+
+// Splits one CSV line into exactly six fields; returns 0 if it does not fit
+static int splitFields(char *line, char **fields) {
+    int count = 0;
+    char *start = line;
+    for (char *p = line;; p++) {
+        if (*p == ',' || *p == '\0') {
+            int last = *p == '\0';
+            if (count == 6)
+                return 0;
+            *p = '\0';
+            fields[count++] = start;
+            if (last)
+                break;
+            start = p + 1;
+        }
+    }
+    return count == 6;
+}
+
+static int parseNumber(const char *text, int low, int high, int *out) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || value < low || value > high)
+        return 0;
+    *out = (int)value;
+    return 1;
+}
+
+static int readCsv(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 0;
+    }
+    char line[LINE_LEN];
+    int lineNo = 0, ok = 1;
+    while (ok && fgets(line, sizeof(line), in) != NULL) {
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        char *fields[6];
+        int id, hp, attack, evolvesTo;
+        int type = -1;
+        if (!splitFields(line, fields) || !parseNumber(fields[0], 1, SPECIES_MAX, &id) || fields[1][0] == '\0'
+            || (type = parseType(fields[2])) < 0 || !parseNumber(fields[3], 0, CATALOG_MAX_STAT, &hp)
+            || !parseNumber(fields[4], 0, CATALOG_MAX_STAT, &attack)
+            || !parseNumber(fields[5], 0, SPECIES_MAX, &evolvesTo)) {
+            fprintf(stderr, "%s:%d: expected id,name,type,hp,attack,evolvesTo\n", path, lineNo);
+            ok = 0;
+        } else if (rows[id].name != NULL) {
+            fprintf(stderr, "%s:%d: ID %d listed twice\n", path, lineNo, id);
+            ok = 0;
+        } else if ((rows[id].name = strdup(fields[1])) == NULL) {
+            fprintf(stderr, "Memory allocation failed.\n");
+            ok = 0;
+        } else {
+            rows[id].type = type;
+            rows[id].hp = hp;
+            rows[id].attack = attack;
+            rows[id].evolvesTo = evolvesTo;
+            if (id > rowCount)
+                rowCount = id;
+        }
+    }
+    fclose(in);
+    for (int id = 1; ok && id <= rowCount; id++) {
+        if (rows[id].name == NULL) {
+            fprintf(stderr, "%s: ID %d is missing (IDs must run 1..%d)\n", path, id, rowCount);
+            ok = 0;
+        } else if (rows[id].evolvesTo > rowCount || rows[id].evolvesTo == id) {
+            fprintf(stderr, "%s: ID %d evolves into unknown ID %d\n", path, id, rows[id].evolvesTo);
+            ok = 0;
+        }
+    }
+    if (ok && rowCount == 0) {
+        fprintf(stderr, "%s: no species\n", path);
+        ok = 0;
+    }
+    return ok;
+}
+
+static int compareRowNames(const void *a, const void *b) {
+    return strcmp(rows[*(const uint32_t *)a].name, rows[*(const uint32_t *)b].name);
+}
+
+static int writeCatalog(const char *path) {
+    static uint32_t byName[SPECIES_MAX];
+    static CatalogFileRecord records[SPECIES_MAX];
+    CatalogFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CATALOG_MAGIC, sizeof(header.magic));
+    header.version = CATALOG_VERSION;
+    header.byteOrder = CATALOG_BYTE_ORDER;
+    header.count = (uint32_t)rowCount;
+    for (int id = 1; id <= rowCount; id++) {
+        records[id - 1].nameOffset = header.namesSize;
+        records[id - 1].type = (uint32_t)rows[id].type;
+        records[id - 1].hp = rows[id].hp;
+        records[id - 1].attack = rows[id].attack;
+        records[id - 1].evolvesTo = (uint32_t)rows[id].evolvesTo;
+        header.namesSize += (uint32_t)strlen(rows[id].name) + 1;
+        byName[id - 1] = (uint32_t)id;
+    }
+    qsort(byName, rowCount, sizeof(byName[0]), compareRowNames);
+    for (int i = 1; i < rowCount; i++) {
+        if (strcmp(rows[byName[i - 1]].name, rows[byName[i]].name) == 0) {
+            fprintf(stderr, "Name %s is used twice\n", rows[byName[i]].name);
+            return 0;
+        }
+    }
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot create %s\n", path);
+        return 0;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1
+             && fwrite(records, sizeof(records[0]), rowCount, out) == (size_t)rowCount
+             && fwrite(byName, sizeof(byName[0]), rowCount, out) == (size_t)rowCount;
+    for (int id = 1; ok && id <= rowCount; id++)
+        ok = fwrite(rows[id].name, strlen(rows[id].name) + 1, 1, out) == 1;
+    if (fclose(out) != 0 || !ok) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+static void dumpCatalog(void) {
+    printf("# id,name,type,hp,attack,evolvesTo\n");
+    for (int id = 1; id <= speciesCount(); id++) {
+        const PokemonData *species = findSpecies(id);
+        const PokemonData *next = speciesEvolution(species);
+        printf("%d,%s,%s,%d,%d,%d\n", id, species->name, getTypeName(species->TYPE), species->hp,
+               species->attack, next ? next->id : 0);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2 && argc <= 3 && strcmp(argv[1], "dump") == 0) {
+        if (argc == 3) {
+            PokeStatus status = speciesCatalogLoad(argv[2]);
+            if (status != POKE_OK) {
+                fprintf(stderr, "%s: %s\n", argv[2], getStatusMessage(status));
+                return 1;
+            }
+        }
+        dumpCatalog();
+        return 0;
+    }
+    if (argc == 4 && strcmp(argv[1], "build") == 0) {
+        if (!readCsv(argv[2]) || !writeCatalog(argv[3]))
+            return 1;
+        // Read it back exactly as the game will
+        PokeStatus status = speciesCatalogLoad(argv[3]);
+        if (status != POKE_OK) {
+            fprintf(stderr, "%s: %s\n", argv[3], getStatusMessage(status));
+            return 1;
+        }
+        fprintf(stderr, "Wrote %d species to %s\n", speciesCount(), argv[3]);
+        return 0;
+    }
+    fprintf(stderr, "Usage: catalog dump [file.cat] | catalog build species.csv file.cat\n");
+    return 1;
+}
@@ -1,23 +1,227 @@
     #include "ex6.h"
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 # define INT_BUFFER 128
+# define INPUT_BLOCK 65536
 # define ZERO 0
 # define ONE 1
 # define MAX_SIZE 20
+# define BULK_MAX_IDS (4 * SPECIES_MAX)
+# define POKEMON_LINE_FMT "ID: %d, Name: %s, Type: %s, HP: %d, Attack: %d, Can Evolve: %s\n"
 
 // ================================================
 // Basic struct definitions from ex6.h assumed:
 //   PokemonData { int id; char *name; PokemonType TYPE; int hp; int attack; EvolutionStatus CAN_EVOLVE; }
 //   PokemonNode { PokemonData* data; PokemonNode* left, *right; }
-//   OwnerNode   { char* ownerName; PokemonNode* pokedexRoot; OwnerNode *next, *prev; }
-//   OwnerNode* ownerHead;
+//   OwnerNode   { char* ownerName; InternedName *name; PokemonNode* pokedexRoot; OwnerNode *next, *prev; }
+//   Registry    { OwnerNode *head; int count; pthread_mutex_t writer; NameTable names; }
 //   const PokemonData pokedex[];
 // ================================================
 
+// Writers only scan the reader slots once this many objects wait in limbo
+# define RCU_RECLAIM_BATCH 64
+// Limbo entries kept aside for when malloc fails in rcuRetire
+# define RCU_RESERVE 64
+# define NAME_TABLE_BUCKETS 64
+
+// Helpers shared by the menus and the library, defined with their sections
+static InternedName *readInternedName(Registry *reg);
+static OwnerNode *findOwnerByInterned(Registry *reg, const InternedName *name);
+static void recordUndo(Registry *reg, OwnerNode *owner);
+
+#ifndef EX6_NO_STATS
+__thread PerfCounters threadCounters;
+#endif
+static PerfCounters globalCounters;
+// Every species lookup goes through here; speciesCatalogLoad may swap in a file
+static SpeciesCatalog catalog = {pokedex, POKEDEX_SIZE, NULL, NULL, NULL};
+// insertPokemonNode counts the levels it walks here so callers learn the depth
+static __thread int insertLevels = 0;
+
+// Subsystem each allocation site belongs to (section 32). The limbo holds
+// retired owners and summaries as well as nodes, and only until a grace
+// period ends, so it counts as scratch.
+static const AllocTag siteTags[] = {
+    [ALLOC_SITE_STRDUP] = ALLOC_TAG_NAMES,
+    [ALLOC_SITE_INPUT] = ALLOC_TAG_INPUT,
+    [ALLOC_SITE_POKEMON_NODE] = ALLOC_TAG_NODES,
+    [ALLOC_SITE_OWNER] = ALLOC_TAG_OWNERS,
+    [ALLOC_SITE_NODE_ARRAY] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_BFS_QUEUE] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_MERGE_QUEUE] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_SORT] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_RCU_LIMBO] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_REPORT] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_NAMES] = ALLOC_TAG_NAMES,
+    [ALLOC_SITE_FROZEN] = ALLOC_TAG_NODES,
+    [ALLOC_SITE_BATTLE] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_VISIT] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_CATALOG] = ALLOC_TAG_NAMES,
+    [ALLOC_SITE_CIRCULAR] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_QUERY] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_BULK] = ALLOC_TAG_SCRATCH,
+    [ALLOC_SITE_MATCHUP] = ALLOC_TAG_SCRATCH,
+};
+// Fails to compile when a site is added without a tag (C99 static assert)
+typedef char siteTagsComplete[sizeof(siteTags) / sizeof(siteTags[0]) == ALLOC_SITE_COUNT ? 1 : -1];
+
+// In front of every block; 16 bytes keep the payload as aligned as malloc's
+#define ALLOC_HEADER_SIZE 16
+typedef struct
+{
+    const Allocator *from;
+    uint32_t size;  // payload bytes
+    uint32_t site;
+} AllocHeader;
+typedef char allocHeaderFits[sizeof(AllocHeader) <= ALLOC_HEADER_SIZE ? 1 : -1];
+
+// The default allocator of each tag; state is its count of bytes held
+static size_t mallocHeld[ALLOC_TAG_COUNT];
+
+static void *mallocAlloc(void *state, size_t size) {
+    void *ptr = malloc(size);
+    if (ptr)
+        __atomic_fetch_add((size_t *)state, size, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+static void *mallocResize(void *state, void *ptr, size_t oldSize, size_t newSize) {
+    void *bigger = realloc(ptr, newSize);
+    if (bigger) {
+        __atomic_fetch_add((size_t *)state, newSize, __ATOMIC_RELAXED);
+        __atomic_fetch_sub((size_t *)state, oldSize, __ATOMIC_RELAXED);
+    }
+    return bigger;
+}
+
+static void mallocRelease(void *state, void *ptr, size_t size) {
+    __atomic_fetch_sub((size_t *)state, size, __ATOMIC_RELAXED);
+    free(ptr);
+}
+
+static size_t mallocReserved(void *state) {
+    return __atomic_load_n((size_t *)state, __ATOMIC_RELAXED);
+}
+
+#define MALLOC_ALLOCATOR(tag) {"malloc", &mallocHeld[tag], mallocAlloc, mallocResize, mallocRelease, mallocReserved}
+static const Allocator mallocAllocators[ALLOC_TAG_COUNT] = {
+    MALLOC_ALLOCATOR(0), MALLOC_ALLOCATOR(1), MALLOC_ALLOCATOR(2), MALLOC_ALLOCATOR(3), MALLOC_ALLOCATOR(4)};
+static const Allocator *tagAllocators[ALLOC_TAG_COUNT] = {
+    &mallocAllocators[0], &mallocAllocators[1], &mallocAllocators[2], &mallocAllocators[3], &mallocAllocators[4]};
+
+// Allocation through the tag's allocator, counted per call site and per tag
+static void *countedMalloc(AllocSite site, size_t size) {
+    AllocTag tag = siteTags[site];
+    if (size > UINT32_MAX - ALLOC_HEADER_SIZE)
+        return NULL;
+    const Allocator *from = __atomic_load_n(&tagAllocators[tag], __ATOMIC_ACQUIRE);
+    AllocHeader *header = (AllocHeader *)from->alloc(from->state, ALLOC_HEADER_SIZE + size);
+    if (header == NULL)
+        return NULL;
+    header->from = from;
+    header->size = (uint32_t)size;
+    header->site = (uint32_t)site;
+    STAT_ADD(allocs[site], 1);
+    STAT_ADD(tagAllocs[tag], 1);
+    STAT_ADD(tagBytes[tag], size);
+    return (char *)header + ALLOC_HEADER_SIZE;
+}
+
+// The block stays with the allocator that made it
+static void *countedRealloc(AllocSite site, void *old, size_t size) {
+    if (old == NULL)
+        return countedMalloc(site, size);
+    if (size > UINT32_MAX - ALLOC_HEADER_SIZE)
+        return NULL;
+    AllocHeader *header = (AllocHeader *)((char *)old - ALLOC_HEADER_SIZE);
+    const Allocator *from = header->from;
+    size_t oldSize = header->size;
+    AllocHeader *moved;
+    if (from->resize != NULL) {
+        moved = (AllocHeader *)from->resize(from->state, header, ALLOC_HEADER_SIZE + oldSize,
+                                            ALLOC_HEADER_SIZE + size);
+    } else {
+        moved = (AllocHeader *)from->alloc(from->state, ALLOC_HEADER_SIZE + size);
+        if (moved != NULL) {
+            memcpy(moved, header, ALLOC_HEADER_SIZE + (oldSize < size ? oldSize : size));
+            from->release(from->state, header, ALLOC_HEADER_SIZE + oldSize);
+        }
+    }
+    if (moved == NULL)
+        return NULL;
+    moved->size = (uint32_t)size;
+    STAT_ADD(tagBytes[siteTags[moved->site]], size);
+    STAT_ADD(tagFreedBytes[siteTags[moved->site]], oldSize);
+    return (char *)moved + ALLOC_HEADER_SIZE;
+}
+
+// The header knows the site, so site is only there to read well at call sites
+static void countedFree(AllocSite site, void *ptr) {
+    (void)site;
+    if (ptr == NULL)
+        return;
+    AllocHeader *header = (AllocHeader *)((char *)ptr - ALLOC_HEADER_SIZE);
+    STAT_ADD(frees[header->site], 1);
+    STAT_ADD(tagFrees[siteTags[header->site]], 1);
+    STAT_ADD(tagFreedBytes[siteTags[header->site]], header->size);
+    header->from->release(header->from->state, header, ALLOC_HEADER_SIZE + header->size);
+}
+
+static void reclaimPokemonNode(void *node) {
+    freePokemonNode((PokemonNode *)node);
+}
+
+// The last reference went a grace period ago; the children lose this one
+static void reclaimDroppedNode(void *node) {
+    PokemonNode *dropped = (PokemonNode *)node;
+    freePokemonTree(dropped->left);
+    freePokemonTree(dropped->right);
+    freePokemonNode(dropped);
+}
+
+static void reclaimSummary(void *summary) {
+    countedFree(ALLOC_SITE_OWNER, summary);
+}
+
+static void reclaimFrozen(void *frozen) {
+    freeFrozen((FrozenPokedex *)frozen);
+}
+
+static void reclaimOwnerNode(void *owner) {
+    freeOwnerNode((OwnerNode *)owner);
+}
+
+static CommandObserver commandObserver = NULL;
+
+static unsigned long long monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// Only pay for the clock when somebody is listening
+static unsigned long long commandStart(void) {
+    return commandObserver ? monotonicNs() : 0;
+}
+
+static void commandDone(CommandKind kind, unsigned long long started) {
+    if (commandObserver)
+        commandObserver(kind, monotonicNs() - started);
+}
+
 // --------------------------------------------------------------
 // 1) Safe integer reading
 // --------------------------------------------------------------
@@ -50,66 +254,229 @@ char *myStrdup(const char *src)
     if (!src)
         return NULL;
     size_t len = strlen(src);
-    char *dest = (char *)malloc(len + 1);
+    char *dest = (char *)countedMalloc(ALLOC_SITE_STRDUP, len + 1);
     if (!dest)
-    {
-        printf("Memory allocation failed in myStrdup.\n");
         return NULL;
-    }
     strcpy(dest, src);
     return dest;
 }
 
-int readIntSafe(const char *prompt)
+// stdin is consumed in INPUT_BLOCK reads; lines are handed out as views into
+// [pos, end) and the unread tail is moved to the front before the next read.
+typedef struct
 {
-    char buffer[INT_BUFFER];
-    int value;
-    int success = 0;
+    char *buf;
+    size_t cap;
+    size_t pos;  // first unread byte
+    size_t end;  // one past the last byte read
+    int eof;
+} InputReader;
 
-    while (!success)
-    {
-        printf("%s", prompt);
+static InputReader stdinReader = {NULL, 0, 0, 0, 0};
 
-        // If we fail to read, treat it as invalid
-        if (!fgets(buffer, sizeof(buffer), stdin))
+// Returns the number of bytes added, 0 at end of input or on error
+static size_t refillInput(InputReader *in) {
+    if (in->pos > 0) {
+        memmove(in->buf, in->buf + in->pos, in->end - in->pos);
+        in->end -= in->pos;
+        in->pos = 0;
+    }
+    if (in->cap - in->end < INPUT_BLOCK) {
+        // Grow only for lines longer than the free space
+        size_t newCap = in->cap ? in->cap * 2 : INPUT_BLOCK;
+        while (newCap - in->end < INPUT_BLOCK)
+            newCap *= 2;
+        char *bigger = (char *)countedRealloc(ALLOC_SITE_INPUT, in->buf, newCap);
+        if (!bigger)
         {
-            printf("Invalid input.\n");
-            clearerr(stdin);
-            continue;
+            printf("Memory reallocation failed.\n");
+            return 0;
+        }
+        in->buf = bigger;
+        in->cap = newCap;
+    }
+    // Prompts are printed without a newline; show them before we block
+    fflush(stdout);
+    ssize_t got;
+    do {
+        got = read(fileno(stdin), in->buf + in->end, in->cap - in->end);
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0)
+        return 0;
+    in->end += (size_t)got;
+    return (size_t)got;
+}
+
+int readLineView(StrView *line)
+{
+    InputReader *in = &stdinReader;
+    size_t scanned = in->pos;
+    for (;;) {
+        // memchr is vectorized in every libc we care about
+        char *newline = in->buf ? (char *)memchr(in->buf + scanned, '\n', in->end - scanned) : NULL;
+        if (newline) {
+            line->text = in->buf + in->pos;
+            line->len = (size_t)(newline - line->text);
+            in->pos = (size_t)(newline - in->buf) + 1;
+            break;
         }
+        if (in->eof) {
+            // Forget EOF once reported, so a terminal can keep typing after ^D
+            in->eof = 0;
+            if (in->pos == in->end)
+                return 0;
+            // Last line without a newline
+            line->text = in->buf + in->pos;
+            line->len = in->end - in->pos;
+            in->pos = in->end;
+            break;
+        }
+        scanned = in->end - in->pos;
+        if (refillInput(in) == 0)
+            in->eof = 1;
+    }
+    if (line->len > 0 && line->text[line->len - 1] == '\r')
+        line->len--;
+    return 1;
+}
 
-        // 1) Strip any trailing \r or \n
-        //    so "123\r\n" becomes "123"
-        size_t len = strlen(buffer);
-        if (len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == '\r'))
-            buffer[--len] = '\0';
-        if (len > 0 && (buffer[len - 1] == '\r' || buffer[len - 1] == '\n'))
-            buffer[--len] = '\0';
+StrView trimView(StrView view)
+{
+    while (view.len > 0 && (*view.text == ' ' || *view.text == '\t' || *view.text == '\r')) {
+        view.text++;
+        view.len--;
+    }
+    while (view.len > 0 && (view.text[view.len - 1] == ' ' || view.text[view.len - 1] == '\t'
+                            || view.text[view.len - 1] == '\r'))
+        view.len--;
+    return view;
+}
 
-        // 2) Check if empty after stripping
-        if (len == 0)
-        {
-            printf("Invalid input.\n");
+int parseIntView(StrView view, int *value)
+{
+    size_t i = 0;
+    // strtol skips leading whitespace, so we do too
+    while (i < view.len && isspace((unsigned char)view.text[i]))
+        i++;
+    int negative = 0;
+    if (i < view.len && (view.text[i] == '-' || view.text[i] == '+'))
+        negative = view.text[i++] == '-';
+    if (i == view.len)
+        return 0;
+    long long number = 0;
+    for (; i < view.len; i++) {
+        unsigned digit = (unsigned)(view.text[i] - '0');
+        if (digit > 9)
+            return 0;
+        number = number * 10 + digit;
+        if (number > (long long)INT_MAX + 1)
+            return 0;
+    }
+    if (negative)
+        number = -number;
+    if (number > INT_MAX)
+        return 0;
+    *value = (int)number;
+    return 1;
+}
+
+int viewEquals(StrView view, const char *text)
+{
+    return strncmp(view.text, text, view.len) == 0 && text[view.len] == '\0';
+}
+
+static int isIdSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == ',';
+}
+
+// Digits at *pos, saturating at one billion; fails unless a separator, '-'
+// or the end of the view follows
+static int scanIdNumber(StrView view, size_t *pos, long *value)
+{
+    size_t i = *pos;
+    long number = 0;
+    while (i < view.len && view.text[i] >= '0' && view.text[i] <= '9') {
+        if (number < 1000000000L)
+            number = number * 10 + (view.text[i] - '0');
+        i++;
+    }
+    if (i == *pos || (i < view.len && !isIdSeparator(view.text[i]) && view.text[i] != '-'))
+        return 0;
+    *pos = i;
+    *value = number;
+    return 1;
+}
+
+int parseIdList(StrView text, int *ids, int capacity, int *outOfRange)
+{
+    int stored = 0;
+    long rejected = 0;
+    size_t i = 0;
+    for (;;) {
+        while (i < text.len && isIdSeparator(text.text[i]))
+            i++;
+        if (i == text.len)
+            break;
+        long first, last;
+        if (!scanIdNumber(text, &i, &first))
+            return -1;
+        last = first;
+        size_t after = i;
+        while (after < text.len && (text.text[after] == ' ' || text.text[after] == '\t'))
+            after++;
+        if (after < text.len && text.text[after] == '-') {
+            i = after + 1;
+            while (i < text.len && (text.text[i] == ' ' || text.text[i] == '\t'))
+                i++;
+            if (!scanIdNumber(text, &i, &last))
+                return -1;
+            // "151-1" means the same IDs as "1-151"
+            if (last < first) {
+                long swap = first;
+                first = last;
+                last = swap;
+            }
+        }
+        // Only the part of the range inside the pokedex is stored
+        long low = first < 1 ? 1 : first;
+        long high = last > catalog.count ? catalog.count : last;
+        if (low > high) {
+            rejected += last - first + 1;
             continue;
         }
+        rejected += (low - first) + (last - high);
+        for (long id = low; id <= high; id++) {
+            if (stored == capacity)
+                return -1;
+            ids[stored++] = (int)id;
+        }
+    }
+    if (outOfRange)
+        *outOfRange = rejected > INT_MAX ? INT_MAX : (int)rejected;
+    return stored;
+}
+
+int readIntSafe(const char *prompt)
+{
+    StrView line;
+    int value;
 
-        // 3) Attempt to parse integer with strtol
-        char *endptr;
-        value = (int)strtol(buffer, &endptr, 10);
+    for (;;)
+    {
+        printf("%s", prompt);
 
-        // If endptr didn't point to the end => leftover chars => invalid
-        // or if buffer was something non-numeric
-        if (*endptr != '\0')
+        // If we fail to read, treat it as invalid; an empty line is invalid too
+        if (!readLineView(&line) || line.len == 0)
         {
             printf("Invalid input.\n");
+            continue;
         }
-        else
-        {
-            // We got a valid integer
-            success = 1;
-        }
+        // Anything but exactly one number (no trailing characters) is invalid
+        if (parseIntView(line, &value))
+            return value;
+        printf("Invalid input.\n");
     }
-    return value;
 }
 
 // --------------------------------------------------------------
@@ -154,52 +521,13 @@ const char *getTypeName(PokemonType type)
     }
 }
 
-// --------------------------------------------------------------
-// Utility: getDynamicInput (for reading a line into malloc'd memory)
-// --------------------------------------------------------------
-char *getDynamicInput()
-{
-    char *input = NULL;
-    size_t size = 0, capacity = 1;
-    input = (char *)malloc(capacity);
-    if (!input)
-    {
-        printf("Memory allocation failed.\n");
-        return NULL;
-    }
-
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF)
-    {
-        if (size + 1 >= capacity)
-        {
-            capacity *= 2;
-            char *temp = (char *)realloc(input, capacity);
-            if (!temp)
-            {
-                printf("Memory reallocation failed.\n");
-                free(input);
-                return NULL;
-            }
-            input = temp;
-        }
-        input[size++] = (char)c;
-    }
-    input[size] = '\0';
-
-    // Trim any leading/trailing whitespace or carriage returns
-    trimWhitespace(input);
-
-    return input;
-}
-
 // Function to print a single Pokemon node
 void printPokemonNode(PokemonNode *node)
 {
     if (!node)
         return;
-    printf("ID: %d, Name: %s, Type: %s, HP: %d, Attack: %d, Can Evolve: %s\n",
-           node->data->id,
+    printf(POKEMON_LINE_FMT,
+           node->id,
            node->data->name,
            getTypeName(node->data->TYPE),
            node->data->hp,
@@ -228,48 +556,76 @@ void displayMenu(OwnerNode *owner)
     int choice = readIntSafe("Your choice: ");
     VisitNodeFunc visit = printPokemonNode;
 
+    rcuReadLock();
+    PokemonNode *root = RCU_DEREF(owner->pokedexRoot);
     switch (choice)
     {
     case 1:
-        BFSGeneric(owner->pokedexRoot,visit);
+        BFSGeneric(root,visit);
         break;
     case 2:
-        preOrderGeneric(owner->pokedexRoot,visit);
+        preOrderGeneric(root,visit);
         break;
     case 3:
-        inOrderGeneric(owner->pokedexRoot,visit);
+        inOrderGeneric(root,visit);
         break;
     case 4:
-        postOrderGeneric(owner->pokedexRoot,visit);
+        postOrderGeneric(root,visit);
         break;
     case 5:
-        displayAlphabetical(owner->pokedexRoot);
+        displayAlphabetical(root);
         break;
     default:
         printf("Invalid choice.\n");
     }
+    rcuReadUnlock();
 }
 
 // --------------------------------------------------------------
 // Sub-menu for existing Pokedex
 // --------------------------------------------------------------
-void enterExistingPokedexMenu()
+static const CommandKind subCommands[] = {CMD_ADD_POKEMON, CMD_DISPLAY_POKEDEX, CMD_RELEASE_POKEMON,
+                                          CMD_FIGHT, CMD_EVOLVE, CMD_BACK_TO_MAIN, CMD_UNDO,
+                                          CMD_BULK_ADD, CMD_BULK_RELEASE, CMD_SIMULATE, CMD_PAGED_DISPLAY};
+static const CommandKind mainCommands[] = {CMD_NEW_POKEDEX, CMD_SELECT_POKEDEX, CMD_DELETE_POKEDEX,
+                                           CMD_MERGE_POKEDEXES, CMD_SORT_OWNERS, CMD_PRINT_CIRCULAR,
+                                           CMD_EXIT, CMD_REGISTRY_REPORT, CMD_STATS, CMD_CLONE_POKEDEX,
+                                           CMD_LEADERBOARD, CMD_MATCHUP, CMD_MERGE_MANY,
+                                           CMD_QUERY};
+
+void setCommandObserver(CommandObserver observer) {
+    commandObserver = observer;
+}
+
+const char *getCommandName(CommandKind kind) {
+    static const char *names[CMD_COUNT] = {"new", "select", "delete", "merge", "sort", "print", "exit",
+                                           "report", "stats", "add", "display", "release", "fight",
+                                           "evolve", "back", "clone", "undo", "bulkadd",
+                                           "bulkrelease", "leaderboard", "simulate", "matchup",
+                                           "pages", "mergemany", "query", "invalid"};
+    return (kind >= 0 && kind < CMD_COUNT) ? names[kind] : "unknown";
+}
+
+void enterExistingPokedexMenu(Registry *reg)
 {
-    if(!ownerHead) {
+    unsigned long long started = commandStart();
+    if(!reg->head) {
         printf("No existing Pokedexes.\n");
+        commandDone(CMD_SELECT_POKEDEX, started);
         return;
     }
     int pokeDex;
-    OwnerNode *cur = ownerHead;
-    OwnerNode *temp = ownerHead;
+    OwnerNode *cur = reg->head;
+    OwnerNode *temp = reg->head;
     // list owners
     printf("\nExisting Pokedexes:\n");
-    printOwners();
+    printOwners(reg);
     pokeDex = readIntSafe("Choose a Pokedex by number: ");
     for (int i = 1; i < pokeDex; i++)
         temp = temp->next;
     cur = temp;
     printf("\nEntering %s's Pokedex...\n", cur->ownerName);
+    commandDone(CMD_SELECT_POKEDEX, started);
 
     int subChoice;
     do
@@ -281,19 +637,25 @@ void enterExistingPokedexMenu()
         printf("4. Pokemon Fight!\n");
         printf("5. Evolve Pokemon\n");
         printf("6. Back to Main\n");
+        printf("7. Undo Last Change\n");
+        printf("8. Add Pokemon in Bulk\n");
+        printf("9. Release Pokemon in Bulk\n");
+        printf("10. Simulate Battles\n");
+        printf("11. Display Pokedex in Pages\n");
 
         subChoice = readIntSafe("Your choice: ");
+        started = commandStart();
 
         switch (subChoice)
         {
         case 1:
-            addPokemon(cur);
+            addPokemon(reg, cur);
             break;
         case 2:
             displayMenu(cur);
             break;
         case 3:
-            releasePokemon(cur);
+            releasePokemon(reg, cur);
             break;
         case 4:
             if(cur->pokedexRoot == NULL) {
@@ -307,21 +669,41 @@ void enterExistingPokedexMenu()
                 printf("Cannot evolve. Pokedex empty.\n");
                 break;
             }
-            evolvePokemon(cur);
+            evolvePokemon(reg, cur);
             break;
         case 6:
             printf("Back to Main Menu.\n");
             break;
+        case 7:
+            undoLastChange(reg, cur);
+            break;
+        case 8:
+            bulkAddPokemon(reg, cur);
+            break;
+        case 9:
+            bulkReleasePokemon(reg, cur);
+            break;
+        case 10:
+            if(cur->pokedexRoot == NULL) {
+                printf("Pokedex is empty.\n");
+                break;
+            }
+            simulateBattlesMenu(cur);
+            break;
+        case 11:
+            pagedDisplayMenu(reg, cur);
+            break;
         default:
             printf("Invalid choice.\n");
         }
+        commandDone(subChoice >= 1 && subChoice <= 11 ? subCommands[subChoice - 1] : CMD_INVALID, started);
     } while (subChoice != 6);
 }
 
 // --------------------------------------------------------------
 // Main Menu
 // --------------------------------------------------------------
-void mainMenu()
+void mainMenu(Registry *reg)
 {
     int choice;
     do
@@ -334,70 +716,153 @@ void mainMenu()
         printf("5. Sort Owners by Name\n");
         printf("6. Print Owners in a direction X times\n");
         printf("7. Exit\n");
+        printf("8. Full Registry Report\n");
+        printf("9. Statistics\n");
+        printf("10. Clone a Pokedex\n");
+        printf("11. Power Leaderboard\n");
+        printf("12. Team Matchup\n");
+        printf("13. Merge Many Owners\n");
+        printf("14. Query Pokedexes\n");
         choice = readIntSafe("Your choice: ");
+        unsigned long long started = commandStart();
+        // The Pokedex sub-menu reports its own commands
+        int nested = (choice == 2 && reg->head != NULL);
 
         switch (choice)
         {
         case 1:
-            openPokedexMenu();
+            openPokedexMenu(reg);
             break;
         case 2:
-            if(ownerHead == NULL) {
+            if(reg->head == NULL) {
                 printf("No existing Pokedexes.\n");
                 break;
             }
-            enterExistingPokedexMenu();
+            enterExistingPokedexMenu(reg);
             break;
         case 3:
-            if(ownerHead == NULL) {
+            if(reg->head == NULL) {
                 printf("No existing Pokedexes to delete.\n");
                 break;
             }
             printf("\n=== Delete a Pokedex ===\n");
-            deletePokedex();
+            deletePokedex(reg);
             break;
         case 4:
-            if(ownerHead == NULL) {
+            if(reg->head == NULL) {
                 printf("Not enough owners to merge.\n");
                 break;
             }
             printf("\n=== Merge Pokedexes ===\n");
-            mergePokedexMenu();
+            mergePokedexMenu(reg);
             break;
         case 5:
-            sortOwners();
+            sortOwners(reg);
             break;
         case 6:
-            if(ownerHead == NULL) {
+            if(reg->head == NULL) {
                 printf("No owners.\n");
                 break;
             }
-            printOwnersCircular();
+            printOwnersCircular(reg);
             break;
         case 7:
             printf("Goodbye!\n");
-            freeAllOwners();
+            freeAllOwners(reg);
+            break;
+        case 8:
+            registryReportMenu(reg);
+            break;
+        case 9:
+            statsMenu(reg);
+            break;
+        case 10:
+            if(reg->head == NULL) {
+                printf("No existing Pokedexes.\n");
+                break;
+            }
+            printf("\n=== Clone a Pokedex ===\n");
+            clonePokedexMenu(reg);
+            break;
+        case 11:
+            if(reg->head == NULL) {
+                printf("No owners.\n");
+                break;
+            }
+            printf("\n=== Power Leaderboard ===\n");
+            leaderboardMenu(reg);
+            break;
+        case 12:
+            if(reg->head == NULL) {
+                printf("Not enough owners for a matchup.\n");
+                break;
+            }
+            printf("\n=== Team Matchup ===\n");
+            teamMatchupMenu(reg);
+            break;
+        case 13:
+            if(reg->head == NULL || reg->head->next == reg->head) {
+                printf("Not enough owners to merge.\n");
+                break;
+            }
+            printf("\n=== Merge Many Owners ===\n");
+            mergeManyMenu(reg);
+            break;
+        case 14:
+            if(reg->head == NULL) {
+                printf("No existing Pokedexes.\n");
+                break;
+            }
+            printf("\n=== Query Pokedexes ===\n");
+            queryMenu(reg);
             break;
         default:
             printf("Invalid.\n");
         }
+        if (!nested)
+            commandDone(choice >= 1 && choice <= 14 ? mainCommands[choice - 1] : CMD_INVALID, started);
     } while (choice != 7);
 }
 
+#ifndef EX6_NO_MAIN
 int main()
 {
-    mainMenu();
-    freeAllOwners();
+    // Allocators per subsystem, e.g. EX6_ALLOCATORS=nodes=pool,scratch=bump
+    const char *allocators = getenv("EX6_ALLOCATORS");
+    if (allocators != NULL && allocatorConfigure(allocators) != POKE_OK)
+        printf("Invalid allocator setting %s.\n", allocators);
+    Registry *registry = registryCreate();
+    if (registry == NULL) {
+        printf("Memory allocation failed.\n");
+        return 1;
+    }
+    registrySetUndoDepth(registry, POKEDEX_UNDO_DEPTH);
+    // A species catalog file replaces the built-in 151 when one is named
+    const char *catalogPath = getenv("EX6_CATALOG");
+    if (catalogPath != NULL && *catalogPath != '\0') {
+        PokeStatus status = speciesCatalogLoad(catalogPath);
+        if (status != POKE_OK)
+            printf("Could not load species catalog %s: %s.\n", catalogPath, getStatusMessage(status));
+    }
+    mainMenu(registry);
+    registryDestroy(registry);
     return 0;
 }
-void openPokedexMenu() {
+#endif
+void openPokedexMenu(Registry *reg) {
+    // Starter choices 1-3 map to these species IDs
+    static const int starterIds[] = {1, 4, 7};
     int starterPokemine;
     printf("Your name:");
-    char *name = getDynamicInput();
-    if(findOwnerByName(name) != NULL) {
+    InternedName *name = readInternedName(reg);
+    if (name == NULL) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    if(findOwnerByInterned(reg, name) != NULL) {
         printf(" Owner '%s' already exists. "
-               "Not creating a new Pokedex.\n",name);
-        free(name);
+               "Not creating a new Pokedex.\n",name->text);
+        releaseName(name);
         return;
     }
     printf(" Choose Starter:\n"
@@ -405,152 +870,450 @@ void openPokedexMenu() {
         "2. Charmander\n"
         "3. Squirtle\n");
     starterPokemine = readIntSafe("Your choice: ");
-    PokemonNode *newPokemon;
-    // Use the enum values directly to select the correct Pokémon
-    switch (starterPokemine) {
-        case 1: {
-            newPokemon = createPokemonNode("Bulbasaur");
-            free(name);
-            break;
-        }
-        case 2: {
-            newPokemon = createPokemonNode("Charmander");
-            free(name);
-            break;
-        }
-        case 3: {
-            newPokemon = createPokemonNode("Squirtle");
-            free(name);
-            break;
-        }
-        default: {
-            printf("Invalid selection!\n");
-            free(name);
-            return;
-        }
+    if (starterPokemine < 1 || starterPokemine > 3) {
+        printf("Invalid selection!\n");
+        releaseName(name);
+        return;
     }
-    OwnerNode *newOwner = createOwner(name,newPokemon);
-    if(!newOwner) {
+    int starterId = starterIds[starterPokemine - 1];
+    switch (registryAddOwner(reg, name->text, starterId, NULL)) {
+    case POKE_OK:
+        printf("New Pokedex created for %s with starter %s.\n",name->text,findSpecies(starterId)->name);
+        break;
+    case POKE_ERR_OWNER_EXISTS:
+        printf(" Owner '%s' already exists. "
+               "Not creating a new Pokedex.\n",name->text);
+        break;
+    default:
         printf("Memory allocation failed.\n");
-        freeOwnerNode(newOwner);
-        return;
     }
-    linkOwnerInCircularList(newOwner);
-    printf("New Pokedex created for %s with starter %s.\n",name,newPokemon->data->name);
-    free(name);
+    releaseName(name);
 }
-PokemonNode *createPokemonNode(const char* name){
-    PokemonNode* new_node = (PokemonNode*)malloc(sizeof(PokemonNode));
-    if (!new_node) {
-        printf("Memory allocation failed.\n");;
+// Fight score times ten, kept in integers: 1.5 * attack + 1.2 * hp
+static int fightScore(const PokemonData *species) {
+    return 15 * species->attack + 12 * species->hp;
+}
+// One allocation per node: the species record is shared, never copied
+static PokemonNode *createSpeciesNode(const PokemonData *species) {
+    PokemonNode* new_node = (PokemonNode*)countedMalloc(ALLOC_SITE_POKEMON_NODE, sizeof(PokemonNode));
+    if (!new_node)
         return NULL;
+    new_node->id = species->id;
+    new_node->refs = 1;
+    new_node->data = species;
+    new_node->left = NULL;
+    new_node->right = NULL;
+    new_node->size = 1;
+    new_node->sumHp = species->hp;
+    new_node->sumAttack = species->attack;
+    new_node->bestScore = fightScore(species);
+    new_node->best = species;
+    return new_node;
+}
+// Whether species (with that score) beats the node's current best
+static int beatsBest(const PokemonNode *node, const PokemonData *species, int score) {
+    return score > node->bestScore || (score == node->bestScore && species->id < node->best->id);
+}
+// Recomputes the node's subtree aggregates from its species and its
+// children's, which must already be current. O(1).
+static void pullUp(PokemonNode *node) {
+    const PokemonData *self = node->data;
+    node->size = 1;
+    node->sumHp = self->hp;
+    node->sumAttack = self->attack;
+    node->bestScore = fightScore(self);
+    node->best = self;
+    for (int side = 0; side < 2; side++) {
+        const PokemonNode *child = side ? node->right : node->left;
+        if (child == NULL)
+            continue;
+        node->size += child->size;
+        node->sumHp += child->sumHp;
+        node->sumAttack += child->sumAttack;
+        if (beatsBest(node, child->best, child->bestScore)) {
+            node->bestScore = child->bestScore;
+            node->best = child->best;
+        }
     }
-    // Loop through the pokedex array to find the matching name
-    for (size_t i = 0; i < sizeof(pokedex) / sizeof(PokemonData); i++) {
-        if (strcmp(pokedex[i].name, name) == 0) {
-            new_node->data = (PokemonData*)malloc(sizeof(PokemonData));
-            if (!new_node->data) {
-                printf("Memory allocation failed.\n");
-                freePokemonNode(new_node);
-                return NULL;
-            }
-            // Need to duplicate the name string
-            new_node->data->name = myStrdup(pokedex[i].name);
-            new_node->data->id = pokedex[i].id;
-            new_node->data->TYPE = pokedex[i].TYPE;
-            new_node->data->hp = pokedex[i].hp;
-            new_node->data->attack = pokedex[i].attack;
-            new_node->data->CAN_EVOLVE = pokedex[i].CAN_EVOLVE;
-            new_node->left = NULL;
-            new_node->right = NULL;
-            return new_node;
-        }
-    }
-    freePokemonNode(new_node);
-    return NULL;
 }
-OwnerNode *createOwner(char *ownerName, PokemonNode *starter) {
-    OwnerNode *node = (OwnerNode *)malloc(sizeof(OwnerNode));
-    if(node == NULL) {
-        printf("Memory allocation failed.\n");
-        freeOwnerNode(node);
+// Pulls up an edit path from its deepest node back to the root
+static void pullUpPath(PokemonNode **path, int depth) {
+    while (depth-- > 0)
+        pullUp(path[depth]);
+}
+// Pulls up levels nodes down the search path for id, deepest first
+static void pullUpToward(PokemonNode *node, int id, int levels) {
+    if (levels <= 0)
+        return;
+    pullUpToward(id < node->id ? node->left : node->right, id, levels - 1);
+    pullUp(node);
+}
+// Pulls up the first levels nodes of the left spine starting at node,
+// deepest first
+static void pullUpLeftSpine(PokemonNode *node, int levels) {
+    if (levels <= 0)
+        return;
+    pullUpLeftSpine(node->left, levels - 1);
+    pullUp(node);
+}
+// Counts a species in or out of the size and totals of a node whose subtree
+// gains or loses it. Deltas touch only the node itself, no siblings.
+static void countAggregate(PokemonNode *node, const PokemonData *species, int sign) {
+    node->size += sign;
+    node->sumHp += sign * species->hp;
+    node->sumAttack += sign * species->attack;
+}
+// Takes a species out of the aggregates of a node whose subtree just lost it;
+// its children must be current. Only a node whose strongest it was needs a
+// full recompute.
+static void dropAggregate(PokemonNode *node, const PokemonData *species) {
+    if (node->best == species)
+        pullUp(node);
+    else
+        countAggregate(node, species, -1);
+}
+PokemonNode *createPokemonNode(const char* name){
+    const PokemonData *species = findSpeciesByName(name);
+    return species ? createSpeciesNode(species) : NULL;
+}
+//--------------- Power leaderboard ---------------
+// Power is the sum of fight scores (1.5 * attack + 1.2 * hp), times ten so it stays integral
+static long long ownerPower(const OwnerNode *owner) {
+    PokemonNode *root = owner->pokedexRoot;
+    return root ? 15LL * root->sumAttack + 12LL * root->sumHp : 0;
+}
+// Each level keeps about a quarter of the one below. The level comes from the
+// name's hash, so no random state is shared between writers.
+static int rankLevelFor(const InternedName *name) {
+    unsigned long long bits = name ? name->hash : 0;
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    int level = 1;
+    while (level < LEADERBOARD_MAX_LEVEL && (bits & 3) == 0) {
+        level++;
+        bits >>= 2;
+    }
+    return level;
+}
+static RankNode *createRankNode(OwnerNode *owner, int level) {
+    RankNode *node = (RankNode *)countedMalloc(ALLOC_SITE_OWNER, sizeof(RankNode) + level * sizeof(RankLink));
+    if (node == NULL)
         return NULL;
+    node->owner = owner;
+    node->power = 0;
+    node->count = 0;
+    node->ranked = 0;
+    node->level = level;
+    for (int i = 0; i < level; i++) {
+        node->links[i].next = NULL;
+        node->links[i].span = 0;
+    }
+    return node;
+}
+// Negative when (power, name) ranks ahead of the node, positive when behind
+static int compareRank(long long power, const InternedName *name, const RankNode *node) {
+    if (power != node->power)
+        return power > node->power ? -1 : 1;
+    return compareInternedNames(name, node->owner->name);
+}
+// Stops before (power, name) on every level: update[i] is the last node ahead
+// of it and passed[i] the rank of that node (0 for the head).
+static void rankingSeek(Leaderboard *board, long long power, const InternedName *name,
+                        RankNode **update, int *passed) {
+    RankNode *node = board->head;
+    int rank = 0;
+    for (int i = board->level - 1; i >= 0; i--) {
+        while (node->links[i].next != NULL && compareRank(power, name, node->links[i].next) > 0) {
+            rank += node->links[i].span;
+            node = node->links[i].next;
+        }
+        update[i] = node;
+        passed[i] = rank;
+    }
+}
+// Caller holds the writer lock and the board's lock for writing; the
+// entry's power is its key
+static void rankingLink(Leaderboard *board, RankNode *entry) {
+    RankNode *update[LEADERBOARD_MAX_LEVEL];
+    int passed[LEADERBOARD_MAX_LEVEL];
+    rankingSeek(board, entry->power, entry->owner->name, update, passed);
+    for (int i = board->level; i < entry->level; i++) {
+        update[i] = board->head;
+        passed[i] = 0;
+        board->head->links[i].span = board->length;
+    }
+    if (entry->level > board->level)
+        board->level = entry->level;
+    for (int i = 0; i < entry->level; i++) {
+        entry->links[i].next = update[i]->links[i].next;
+        update[i]->links[i].next = entry;
+        entry->links[i].span = update[i]->links[i].span - (passed[0] - passed[i]);
+        update[i]->links[i].span = passed[0] - passed[i] + 1;
+    }
+    for (int i = entry->level; i < board->level; i++)
+        update[i]->links[i].span++;
+    board->length++;
+    entry->ranked = 1;
+}
+// Caller holds the writer lock and the board's lock for writing; the entry
+// must still hold the power it was linked with
+static void rankingUnlink(Leaderboard *board, RankNode *entry) {
+    RankNode *update[LEADERBOARD_MAX_LEVEL];
+    int passed[LEADERBOARD_MAX_LEVEL];
+    rankingSeek(board, entry->power, entry->owner->name, update, passed);
+    for (int i = 0; i < board->level; i++) {
+        if (update[i]->links[i].next == entry) {
+            update[i]->links[i].span += entry->links[i].span - 1;
+            update[i]->links[i].next = entry->links[i].next;
+        } else {
+            update[i]->links[i].span--;
+        }
+    }
+    while (board->level > 1 && board->head->links[board->level - 1].next == NULL)
+        board->level--;
+    board->length--;
+    entry->ranked = 0;
+}
+// Caller holds the writer lock and has just changed the owner's Pokedex
+static void leaderboardUpdate(Registry *reg, OwnerNode *owner) {
+    RankNode *entry = owner->rank;
+    PokemonNode *root = owner->pokedexRoot;
+    int count = root ? root->size : 0;
+    if (entry == NULL || !entry->ranked || (entry->power == ownerPower(owner) && entry->count == count))
+        return;
+    // One move under the board's lock: readers never see the entry missing
+    pthread_rwlock_wrlock(&reg->ranking.lock);
+    entry->count = count;
+    if (entry->power != ownerPower(owner)) {
+        rankingUnlink(&reg->ranking, entry);
+        entry->power = ownerPower(owner);
+        rankingLink(&reg->ranking, entry);
     }
-    node->ownerName = ownerName;
+    pthread_rwlock_unlock(&reg->ranking.lock);
+}
+// Caller holds the writer lock (or owns the owner alone)
+static void summaryFill(const OwnerNode *owner, PokedexSummary *summary) {
+    const PokemonNode *root = owner->pokedexRoot;
+    summary->count = root ? root->size : 0;
+    summary->totalHp = root ? root->sumHp : 0;
+    summary->totalAttack = root ? root->sumAttack : 0;
+    summary->strongest = root ? root->best : NULL;
+    summary->maxDepth = owner->maxDepth;
+    memcpy(summary->typeCount, owner->typeCount, sizeof(summary->typeCount));
+}
+// Caller holds the writer lock (or owns the owner alone) and is done changing
+// the owner's Pokedex. The record is replaced, never edited, so readers take
+// it without the lock. If memory runs out it is left NULL and readers ask
+// under the lock instead.
+static void summaryPublish(OwnerNode *owner) {
+    PokedexSummary *fresh = (PokedexSummary *)countedMalloc(ALLOC_SITE_OWNER, sizeof(PokedexSummary));
+    if (fresh != NULL)
+        summaryFill(owner, fresh);
+    PokedexSummary *old = owner->summary;
+    RCU_ASSIGN(owner->summary, fresh);
+    rcuRetire(old, reclaimSummary);
+}
+// Caller holds the writer lock and is done changing the owner's Pokedex:
+// what readers see of its totals catches up
+static void treeSettled(Registry *reg, OwnerNode *owner) {
+    summaryPublish(owner);
+    leaderboardUpdate(reg, owner);
+}
+static unsigned long ownerSerials = 0;
+
+OwnerNode *createOwner(InternedName *name, PokemonNode *starter) {
+    OwnerNode *node = (OwnerNode *)countedMalloc(ALLOC_SITE_OWNER, sizeof(OwnerNode));
+    if(node == NULL)
+        return NULL;
+    node->name = name;
+    node->ownerName = name ? name->text : NULL;
     node->pokedexRoot = starter;
     node->next = NULL;
     node->prev = NULL;
+    node->maxDepth = starter ? treeHeight(starter) : 0;
+    node->frozen = NULL;
+    node->undoCount = 0;
+    node->version = 0;
+    node->serial = __atomic_add_fetch(&ownerSerials, 1, __ATOMIC_RELAXED);
+    memset(node->typeCount, 0, sizeof(node->typeCount));
+    if (starter)
+        node->typeCount[starter->data->TYPE]++;
+    node->rank = createRankNode(node, rankLevelFor(name));
+    if (node->rank == NULL) {
+        countedFree(ALLOC_SITE_OWNER, node);
+        return NULL;
+    }
+    node->summary = NULL;
+    summaryPublish(node);
     return node;
 }
-void linkOwnerInCircularList(OwnerNode *newOwner) {
+// Caller holds the writer lock. The new node is fully linked before it is
+// published, so a concurrent reader either sees it complete or not at all.
+void linkOwnerInCircularList(Registry *reg, OwnerNode *newOwner) {
     // Check if the linked list is empty-then the new owner is the head
-    if(!ownerHead) {
-        ownerHead = newOwner;
+    if(!reg->head) {
         //Circule linked list
         newOwner->next = newOwner;
         newOwner->prev = newOwner;
+        RCU_ASSIGN(reg->head, newOwner);
     }// Adding a new owner to the last in linked list
     else {
-        OwnerNode *temp = ownerHead->prev;
-        temp->next = newOwner;
+        OwnerNode *temp = reg->head->prev;
         newOwner->prev = temp;
-        newOwner->next = ownerHead;
-        ownerHead->prev = newOwner;
+        newOwner->next = reg->head;
+        RCU_ASSIGN(temp->next, newOwner);
+        RCU_ASSIGN(reg->head->prev, newOwner);
     }
+    RCU_ASSIGN(reg->count, reg->count + 1);
+    RCU_ASSIGN(newOwner->name->owner, newOwner);
+    pthread_rwlock_wrlock(&reg->ranking.lock);
+    newOwner->rank->power = ownerPower(newOwner);
+    newOwner->rank->count = newOwner->pokedexRoot ? newOwner->pokedexRoot->size : 0;
+    rankingLink(&reg->ranking, newOwner->rank);
+    pthread_rwlock_unlock(&reg->ranking.lock);
+}
+// Caller holds the writer lock and is about to change the owner's tree: the
+// frozen copy goes stale and handles taken so far stop being trusted.
+static void treeChanged(OwnerNode *owner) {
+    owner->version++;
+    FrozenPokedex *frozen = owner->frozen;
+    if (frozen == NULL)
+        return;
+    RCU_ASSIGN(owner->frozen, NULL);
+    rcuRetire(frozen, reclaimFrozen);
+}
+// Caller holds the writer lock. Takes a reference to the owner's tree for
+// another version (snapshot, clone, undo step). Nodes on the owner's path
+// may become shared through it, so handles taken so far stop being trusted.
+static PokemonNode *shareRoot(OwnerNode *owner) {
+    owner->version++;
+    return retainTree(owner->pokedexRoot);
 }
 //--------Adding Pokemon to the tree--------
-void addPokemon(OwnerNode *owner) {
+// Caller holds the writer lock. Inserts and keeps the owner's max depth current;
+// returns what insertAtLink does (-1 means the node was freed, out of memory).
+static int insertAtLink(PokemonNode **link, PokemonNode *newNode);
+static int ownerInsert(OwnerNode *owner, PokemonNode *newNode) {
+    insertLevels = 0;
+    treeChanged(owner);
+    PokemonType type = newNode->data->TYPE;
+    int inserted = insertAtLink(&owner->pokedexRoot, newNode);
+    if (inserted > 0)
+        owner->typeCount[type]++;
+    if (insertLevels + 1 > owner->maxDepth)
+        owner->maxDepth = insertLevels + 1;
+    return inserted;
+}
+void addPokemon(Registry *reg, OwnerNode *owner) {
     int pokemonId = readIntSafe("Enter ID to add: ");
-    if (pokemonId < 1 || pokemonId > 151) {
+    const PokemonData *added = NULL;
+    switch (pokedexAddPokemon(reg, owner, pokemonId, &added)) {
+    case POKE_OK:
+        printf("Pokemon %s (ID %d) added.\n", added->name, added->id);
+        break;
+    case POKE_ERR_INVALID_ID:
         printf("Invalid ID.\n");
-        return;
-    }// Checking if pokemon is already in pokedex
-    if (searchPokemon(owner->pokedexRoot, pokemonId)) {
+        break;
+    case POKE_ERR_DUPLICATE:
         printf("Pokemon with ID %d is already in the Pokedex. No changes made.\n", pokemonId);
-        return;
-    }//create new pokemon node in pokedex for new pokemon
-    PokemonNode *newPokemon = createPokemonNode(pokedex[pokemonId-1].name);
-    if(newPokemon == NULL) {
+        break;
+    default:
         printf("Memory allocation failed.\n");
-        return;
     }
-    // Insert new pokemon into pokedex root
-    owner->pokedexRoot = insertPokemonNode(owner->pokedexRoot, newPokemon);
-    printf("Pokemon %s (ID %d) added.\n", newPokemon->data->name, newPokemon->data->id);
 }
-PokemonNode *insertPokemonNode(PokemonNode *root, PokemonNode *newNode) {
-    if (!root) {
-        return newNode;
-    }
-    if(newNode->data->id < root->data->id) {
-        root->left = insertPokemonNode(root->left, newNode);
-    } else if(newNode->data->id > root->data->id) {
-        root->right = insertPokemonNode(root->right, newNode);
-    } else if(newNode->data->id == root->data->id) {
-        return root;  // Pokemon already exists
+// Caller holds the writer lock. Makes the node at *link private to this
+// version of the tree: if other versions reach it too, a copy sharing its
+// children takes its place. Returns the private node, NULL if out of memory.
+static PokemonNode *unshareAt(PokemonNode **link) {
+    PokemonNode *node = *link;
+    if (__atomic_load_n(&node->refs, __ATOMIC_ACQUIRE) == 1)
+        return node;
+    PokemonNode *copy = createSpeciesNode(node->data);
+    if (copy == NULL)
+        return NULL;
+    copy->id = node->id;
+    copy->left = retainTree(node->left);
+    copy->right = retainTree(node->right);
+    pullUp(copy);
+    RCU_ASSIGN(*link, copy);
+    freePokemonTree(node);
+    STAT_ADD(pathCopies, 1);
+    return copy;
+}
+
+// Caller holds the writer lock. Returns 1 if linked, 0 for a duplicate (freed
+// here, it was never published) and -1 if a path copy ran out of memory.
+static int insertAtLink(PokemonNode **link, PokemonNode *newNode) {
+    PokemonNode **top = link;
+    const PokemonData *species = newNode->data;
+    int id = newNode->id, score = newNode->bestScore, levels = 0;
+    // Walk down to the empty link the new node belongs in, counting it into
+    // every node passed on the way
+    while (*link) {
+        PokemonNode *node = unshareAt(link);
+        if (node == NULL) {
+            freePokemonNode(newNode);
+            pullUpToward(*top, id, levels);
+            return -1;
+        }
+        STAT_ADD(insertVisits, 1);
+        insertLevels++;
+        if (id == node->id) {
+            // Pokemon already exists. It is in every subtree passed, so their
+            // best never changed; only the counts come back out. (Trees built
+            // through the generic API may hold another species under the ID.)
+            freePokemonNode(newNode);
+            if (node->data != species) {
+                pullUpToward(*top, id, levels);
+                return 0;
+            }
+            for (link = top; levels-- > 0; link = id < (*link)->id ? &(*link)->left : &(*link)->right)
+                countAggregate(*link, species, -1);
+            return 0;
+        }
+        countAggregate(node, species, 1);
+        if (beatsBest(node, species, score)) {
+            node->bestScore = score;
+            node->best = species;
+        }
+        levels++;
+        link = id < node->id ? &node->left : &node->right;
     }
+    RCU_ASSIGN(*link, newNode);
+    return 1;
+}
+
+PokemonNode *insertPokemonNode(PokemonNode *root, PokemonNode *newNode) {
+    insertAtLink(&root, newNode);
     return root;
 }
-void printOwners() {
+void printOwners(Registry *reg) {
+        rcuReadLock();
         int counter = 1;
-        OwnerNode *temp = ownerHead;
-        do {
-         printf("%d. %s\n",counter,temp->ownerName);
-            temp = temp->next;
-            counter++;
-        }while (temp != ownerHead);
+        int limit = RCU_DEREF(reg->count);
+        OwnerNode *head = RCU_DEREF(reg->head);
+        OwnerNode *temp = head;
+        if (temp) {
+            do {
+             printf("%d. %s\n",counter,temp->ownerName);
+                temp = RCU_DEREF(temp->next);
+                counter++;
+            }while (temp != head && counter <= limit);
+        }
+        rcuReadUnlock();
 }
 int sizeOfBinTree(PokemonNode *root) {
     if (root == NULL)
         return 0;
-    return 1 + sizeOfBinTree(root->left) + sizeOfBinTree(root->right);
+    return 1 + sizeOfBinTree(RCU_DEREF(root->left)) + sizeOfBinTree(RCU_DEREF(root->right));
 }
 //--------------- All the display methods ---------------
 void BFSGeneric(PokemonNode *root, VisitNodeFunc visit) {
     if (root == NULL)
         return;
     int size = sizeOfBinTree(root);
-    PokemonNode **temp =(PokemonNode**)malloc(sizeof(PokemonNode*) * size);
+    PokemonNode **temp =(PokemonNode**)countedMalloc(ALLOC_SITE_BFS_QUEUE, sizeof(PokemonNode*) * size);
     if(temp == NULL) {
         printf("Memory allocation failed.\n");
         return;
@@ -561,63 +1324,75 @@ void BFSGeneric(PokemonNode *root, VisitNodeFunc visit) {
 
     while (front < rear) {
         PokemonNode *currentNode = temp[front++];
+        STAT_ADD(traversalVisits, 1);
         visit(currentNode);
-        if (currentNode->left != NULL )
-            temp[rear++] = currentNode->left;
+        // A concurrent writer may have grown the tree since we counted it
+        if (rear + 2 > size) {
+            PokemonNode **bigger = (PokemonNode**)countedRealloc(ALLOC_SITE_BFS_QUEUE, temp, sizeof(PokemonNode*) * (size * 2 + 2));
+            if (bigger == NULL) {
+                printf("Memory allocation failed.\n");
+                break;
+            }
+            temp = bigger;
+            size = size * 2 + 2;
+        }
+        PokemonNode *left = RCU_DEREF(currentNode->left);
+        PokemonNode *right = RCU_DEREF(currentNode->right);
+        if (left != NULL )
+            temp[rear++] = left;
 
-        if (currentNode->right != NULL )
-            temp[rear++] = currentNode->right;
+        if (right != NULL )
+            temp[rear++] = right;
     }
-    free(temp);
+    countedFree(ALLOC_SITE_BFS_QUEUE, temp);
 }
 void preOrderGeneric(PokemonNode *root, VisitNodeFunc visit) {
     if (root == NULL)
         return;
+    STAT_ADD(traversalVisits, 1);
     visit(root);
-    preOrderGeneric(root->left, visit);
-    preOrderGeneric(root->right, visit);
+    preOrderGeneric(RCU_DEREF(root->left), visit);
+    preOrderGeneric(RCU_DEREF(root->right), visit);
 }
 void inOrderGeneric(PokemonNode *root, VisitNodeFunc visit) {
     if (root == NULL)
         return;
-    inOrderGeneric(root->left, visit);
+    inOrderGeneric(RCU_DEREF(root->left), visit);
+    STAT_ADD(traversalVisits, 1);
     visit(root);
-    inOrderGeneric(root->right, visit);
+    inOrderGeneric(RCU_DEREF(root->right), visit);
 }
 void postOrderGeneric(PokemonNode *root, VisitNodeFunc visit) {
     if (root == NULL)
         return;
-    postOrderGeneric(root->left, visit);
-    postOrderGeneric(root->right, visit);
+    postOrderGeneric(RCU_DEREF(root->left), visit);
+    postOrderGeneric(RCU_DEREF(root->right), visit);
+    STAT_ADD(traversalVisits, 1);
     visit(root);
 }
 void initNodeArray(NodeArray *na, int cap) {
-    na->nodes=(PokemonNode**)malloc(cap*sizeof(PokemonNode*));
-    if(na->nodes==NULL) {
-        printf("Memory allocation failed.\n");
+    na->nodes=(PokemonNode**)countedMalloc(ALLOC_SITE_NODE_ARRAY, cap*sizeof(PokemonNode*));
+    if(na->nodes==NULL)
         return;
-    }
     na->size=0;
     na->capacity=cap;
 }
 void addNode(NodeArray *na, PokemonNode *node) {
-    if(!na || !node) {
-        printf("Null node provided.\n");
+    if(!na || !node)
         return;
-    }
     // If dynamic allocation trminate to limit, add more place
     if(na->size==na->capacity) {
         na->capacity*=2;
-        PokemonNode** temp=(PokemonNode**)malloc(na->capacity*sizeof(PokemonNode*));
+        PokemonNode** temp=(PokemonNode**)countedMalloc(ALLOC_SITE_NODE_ARRAY, na->capacity*sizeof(PokemonNode*));
         if(temp==NULL) {
-            printf("Memory allocation failed.\n");
+            na->capacity/=2;
             return;
         }
         // Copy existing nodes to new array
         for (int i = 0; i < na->size; i++) {
             temp[i] = na->nodes[i];
         }
-        free(na->nodes); // Free old memory
+        countedFree(ALLOC_SITE_NODE_ARRAY, na->nodes); // Free old memory
         na->nodes = temp; // initialize pointer to temp
     }
     // Add new node to place size+1 in array
@@ -626,84 +1401,324 @@ void addNode(NodeArray *na, PokemonNode *node) {
 void collectAll(PokemonNode *root, NodeArray *na) {
     if (root == NULL)
         return;
+    STAT_ADD(traversalVisits, 1);
     addNode(na,root);
-    collectAll(root->left,na);
-    collectAll(root->right,na);
+    collectAll(RCU_DEREF(root->left),na);
+    collectAll(RCU_DEREF(root->right),na);
 }
 int compareByNameNode(const void *a, const void *b) {
     PokemonNode *nodeA = *(PokemonNode **)a;
     PokemonNode *nodeB = *(PokemonNode **)b;
     return strcmp(nodeA->data->name, nodeB->data->name);
 }
-void displayAlphabetical(PokemonNode *root) {
+void alphabeticalGeneric(PokemonNode *root, VisitNodeFunc visit) {
     if(root==NULL) {
         return;
     }
     NodeArray na;
 
     initNodeArray(&na,sizeOfBinTree(root));
+    if(na.nodes==NULL) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
     collectAll(root,&na);
-    //A bubbleSort for Alphabetical
     // Sort by name
     qsort(na.nodes,na.size,sizeof(PokemonNode*),compareByNameNode);
-    // Display sorted nodes
+    // Visit sorted nodes
     for(int i=0;i<na.size;i++) {
-        printPokemonNode(na.nodes[i]);
+        visit(na.nodes[i]);
     }
-    free(na.nodes); // Free allocated memory
+    countedFree(ALLOC_SITE_NODE_ARRAY, na.nodes); // Free allocated memory
+}
+void displayAlphabetical(PokemonNode *root) {
+    alphabeticalGeneric(root, printPokemonNode);
 }
 // ------------ removing pokemon from the tree --------------
-PokemonNode *removeNodeBST(PokemonNode *root, int id) {
-    if(root==NULL) {
-        return NULL;
+// Caller holds the writer lock and knows the ID is in this owner's tree at
+// most HANDLE_PATH_MAX levels down. Copies every shared node on the way down
+// to it and returns the (now private) link that holds it, or NULL if memory
+// ran out. path receives the ancestors.
+static PokemonNode **unsharePath(PokemonNode **link, int id, PokemonNode **path, int *depth) {
+    *depth = 0;
+    for (;;) {
+        PokemonNode *node = unshareAt(link);
+        if (node == NULL)
+            return NULL;
+        if (node->id == id)
+            return link;
+        path[(*depth)++] = node;
+        link = id < node->id ? &node->left : &node->right;
     }
-    // Search for the node
-    if(id<root->data->id) {
-        root->left = removeNodeBST(root->left, id);
-        return root;
+}
+
+// Caller holds the writer lock; *link and everything above it are private.
+// Unlinks the node at *link; returns 1, or -1 if out of memory. Removed
+// memory is retired, never freed in place, so readers already walking the
+// tree keep seeing valid nodes. The caller pulls up the ancestors.
+static int unlinkAtLink(PokemonNode **link) {
+    PokemonNode *node = *link;
+    // No children or one child: the child takes its place
+    if (node->left == NULL || node->right == NULL) {
+        RCU_ASSIGN(*link, node->left ? node->left : node->right);
+        rcuRetire(node, reclaimPokemonNode);
+        return 1;
     }
-    else if(id>root->data->id) {
-        root->right = removeNodeBST(root->right, id);
-        return root;
+    // Two children: the successor itself moves into this node's place, so
+    // nothing is copied and pointers to it stay good. It has no left child,
+    // and no key lies between node and successor, so a reader standing on it
+    // never needs the left link it is about to get.
+    PokemonNode **successorLink = &node->right;
+    PokemonNode *successor;
+    int between = 0;
+    for (;;) {
+        if ((successor = unshareAt(successorLink)) == NULL)
+            return -1;
+        if (successor->left == NULL)
+            break;
+        between++;
+        successorLink = &successor->left;
     }
-    // Node found - handle deletion cases
-    // Case 1: no children
-    if(root->left==NULL && root->right==NULL) {
-        freePokemonNode(root);
-        return NULL;
+    RCU_ASSIGN(successor->left, node->left);
+    if (successorLink != &node->right) {
+        // Deeper down: it takes over node's right subtree before moving up,
+        // and its old spot gets its own right subtree last. In between, a
+        // reader below that spot can come round to it once more; every key
+        // stays reachable and searches end where they should.
+        PokemonNode *rest = successor->right;
+        RCU_ASSIGN(successor->right, node->right);
+        RCU_ASSIGN(*link, successor);
+        RCU_ASSIGN(*successorLink, rest);
+    } else {
+        RCU_ASSIGN(*link, successor);
+    }
+    rcuRetire(node, reclaimPokemonNode);
+    // The nodes it passed are the left spine of its new right subtree
+    pullUpLeftSpine(successor->right, between);
+    pullUp(successor);
+    return 1;
+}
+
+// Caller holds the writer lock. Unlinks the node with this ID from the tree
+// hanging off *link; returns 1 if removed, 0 if absent, -1 if out of memory.
+// Shared nodes on the path are copied first, so other versions of the tree
+// never change.
+static int removeAtLink(PokemonNode **link, int id) {
+    unsigned long long visits = 0;
+    PokemonNode *node = *link;
+    // Look before copying anything: a miss must leave shared nodes shared
+    while (node != NULL) {
+        visits++;
+        if (node->id == id)
+            break;
+        node = id < node->id ? node->left : node->right;
+    }
+    STAT_ADD(removeVisits, visits);
+    if (node == NULL)
+        return 0;
+    // Counted out top-down on the way; the nodes whose strongest it was form
+    // the bottom of the path and are recomputed once it is gone
+    const PokemonData *species = node->data;
+    PokemonNode **top = link, **stale = NULL;
+    int levels = 0, staleLevel = 0;
+    for (;;) {
+        if ((node = unshareAt(link)) == NULL) {
+            pullUpToward(*top, id, levels);
+            return -1;
+        }
+        if (node->id == id)
+            break;
+        countAggregate(node, species, -1);
+        if (stale == NULL && node->best == species) {
+            stale = link;
+            staleLevel = levels;
+        }
+        levels++;
+        link = id < node->id ? &node->left : &node->right;
+    }
+    if (unlinkAtLink(link) < 0) {
+        pullUpToward(*top, id, levels);
+        return -1;
+    }
+    if (stale != NULL)
+        pullUpToward(*stale, id, levels - staleLevel);
+    return 1;
+}
+
+// Caller holds the writer lock. One read-only descent fills in the handle for
+// this ID: where the node hangs, whether its path is shared, and its in-order
+// neighbours, each either the nearest ancestor turned away from or the
+// nearest node in the subtree on that side. Only the first HANDLE_PATH_MAX
+// ancestors are kept; depth still counts them all. Returns 0 if the ID is
+// absent.
+static int handleSeek(PokemonHandle *handle) {
+    unsigned long long visits = 0;
+    PokemonNode **link = &handle->owner->pokedexRoot;
+    handle->version = handle->owner->version;
+    handle->shared = 0;
+    handle->depth = 0;
+    handle->prevId = 0;
+    handle->nextId = 0;
+    while (*link != NULL) {
+        PokemonNode *node = *link;
+        visits++;
+        handle->shared |= __atomic_load_n(&node->refs, __ATOMIC_ACQUIRE) > 1;
+        if (node->id == handle->id)
+            break;
+        if (handle->depth < HANDLE_PATH_MAX)
+            handle->path[handle->depth] = node;
+        handle->depth++;
+        if (handle->id < node->id) {
+            handle->nextId = node->id;
+            link = &node->left;
+        } else {
+            handle->prevId = node->id;
+            link = &node->right;
+        }
+    }
+    STAT_ADD(searchVisits, visits);
+    handle->link = link;
+    if (*link == NULL)
+        return 0;
+    for (PokemonNode *next = (*link)->right; next != NULL; next = next->left)
+        handle->nextId = next->id;
+    for (PokemonNode *prev = (*link)->left; prev != NULL; prev = prev->right)
+        handle->prevId = prev->id;
+    handle->species = (*link)->data;
+    return 1;
+}
+
+// Caller holds the writer lock. Whether the handle's owner is still in the
+// ring. Nothing is dereferenced until that is known: once an owner has left,
+// its memory may be freed or even reused by a new owner at the same address.
+static int handleOwnerLive(Registry *reg, PokemonHandle *handle) {
+    if (handle->ownersRemoved == reg->ownersRemoved)
+        return 1;
+    OwnerNode *current = reg->head;
+    for (int i = 0; current != NULL && i < reg->count; i++, current = current->next) {
+        if (current == handle->owner) {
+            if (current->serial != handle->serial)
+                return 0;
+            handle->ownersRemoved = reg->ownersRemoved;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Caller holds the writer lock. Brings a handle up to date with the owner's
+// tree; returns 0 if its owner or its ID is no longer there.
+static int handleRefresh(Registry *reg, PokemonHandle *handle) {
+    if (!handleOwnerLive(reg, handle))
+        return 0;
+    if (handle->version == handle->owner->version)
+        return 1;
+    return handleSeek(handle);
+}
+
+// Caller holds the writer lock, has refreshed the handle and recorded the
+// undo step. Returns the link to edit, copying the path first if another
+// version of the tree shares it (handle->path then holds the copies); NULL
+// if memory ran out.
+static PokemonNode **handleEditLink(PokemonHandle *handle) {
+    OwnerNode *owner = handle->owner;
+    treeChanged(owner);
+    if (!handle->shared && __atomic_load_n(&owner->pokedexRoot->refs, __ATOMIC_ACQUIRE) == 1)
+        return handle->link;
+    return unsharePath(&owner->pokedexRoot, handle->id, handle->path, &handle->depth);
+}
+
+// Caller holds the writer lock, has refreshed the handle and recorded the
+// undo step. Takes the handle's Pokemon out of the tree.
+static PokeStatus handleUnlink(PokemonHandle *handle) {
+    if (handle->depth > HANDLE_PATH_MAX) {
+        // Too deep for the kept path: remove it by ID instead
+        treeChanged(handle->owner);
+        if (removeAtLink(&handle->owner->pokedexRoot, handle->id) < 0)
+            return POKE_ERR_NO_MEMORY;
+        handle->owner->typeCount[handle->species->TYPE]--;
+        return POKE_OK;
     }
+    PokemonNode **link = handleEditLink(handle);
+    if (link == NULL || unlinkAtLink(link) < 0)
+        return POKE_ERR_NO_MEMORY;
+    for (int i = handle->depth - 1; i >= 0; i--)
+        dropAggregate(handle->path[i], handle->species);
+    handle->owner->typeCount[handle->species->TYPE]--;
+    return POKE_OK;
+}
+
+// Caller holds the writer lock and has refreshed the handle.
+static PokeStatus handleRelease(Registry *reg, PokemonHandle *handle) {
+    recordUndo(reg, handle->owner);
+    return handleUnlink(handle);
+}
+
+// Caller holds the writer lock and has refreshed the handle; newId is a valid
+// species the owner does not have. Leaves the handle on newId. On failure the
+// tree still holds the original Pokemon and not the new one.
+static PokeStatus handleReplace(Registry *reg, PokemonHandle *handle, int newId) {
+    const PokemonData *species = findSpecies(newId);
+    // Always a fresh node, even when the old one is private to this version:
+    // lock-free readers walk the live tree, and a key that changed under
+    // them would send a search the wrong way
+    PokemonNode *newNode = createSpeciesNode(species);
+    if (newNode == NULL)
+        return POKE_ERR_NO_MEMORY;
+    recordUndo(reg, handle->owner);
+    if (handle->depth <= HANDLE_PATH_MAX && newId > handle->prevId
+        && (handle->nextId == 0 || newId < handle->nextId)) {
+        // No owned ID lies between the two, so the new node takes the old
+        // one's place and children. Readers see the old node or the new
+        // one, each whole.
+        PokemonNode **link = handleEditLink(handle);
+        if (link == NULL) {
+            freePokemonNode(newNode);
+            return POKE_ERR_NO_MEMORY;
+        }
+        PokemonNode *node = *link;
+        newNode->left = node->left;
+        newNode->right = node->right;
+        pullUp(newNode);
+        RCU_ASSIGN(*link, newNode);
+        rcuRetire(node, reclaimPokemonNode);
+        pullUpPath(handle->path, handle->depth);
+        handle->owner->typeCount[handle->species->TYPE]--;
+        handle->owner->typeCount[species->TYPE]++;
+        // Same place, same neighbours: the handle stays trusted
+        handle->id = newId;
+        handle->species = species;
+        handle->link = link;
+        handle->shared = 0;
+        handle->version = handle->owner->version;
+        return POKE_OK;
+    }
+    // Elsewhere in the tree: insert before unlinking, so running out of
+    // memory never leaves the owner with neither form
+    if (ownerInsert(handle->owner, newNode) < 0)
+        return POKE_ERR_NO_MEMORY;
+    handleSeek(handle);
+    if (handleUnlink(handle) != POKE_OK) {
+        // The insert copied every node down to the new leaf, so taking it
+        // out again needs no memory
+        removeAtLink(&handle->owner->pokedexRoot, newId);
+        handle->owner->typeCount[species->TYPE]--;
+        handleSeek(handle);
+        return POKE_ERR_NO_MEMORY;
+    }
+    handle->id = newId;
+    handleSeek(handle);
+    return POKE_OK;
+}
 
-    // Case 2: one child
-    if(root->left==NULL) {
-        PokemonNode *temp = root->right;
-        freePokemonNode(root);
-        return temp;
-    }
-    if(root->right==NULL) {
-        PokemonNode *temp = root->left;
-        freePokemonNode(root);
-        return temp;
-    }
-    // Case 3: Two children
-    PokemonNode *temp = root->right;
-    // Search minimum root in left to be the successor
-    while(temp->left != NULL) {
-        temp = temp->left;
-    }
-    // Copy successor data
-    root->data->id = temp->data->id;
-    // Free  old name before copying new name
-    free(root->data->name);
-    root->data->name = myStrdup(temp->data->name);
-    root->data->TYPE = temp->data->TYPE;
-    root->data->hp = temp->data->hp;
-    root->data->attack = temp->data->attack;
-    root->data->CAN_EVOLVE = temp->data->CAN_EVOLVE;
-    // Delete successor from his original location
-    root->right = removeNodeBST(root->right, temp->data->id);
+// Caller holds the writer lock.
+PokemonNode *removeNodeBST(PokemonNode *root, int id) {
+    if (removeAtLink(&root, id) < 0)
+        printf("Memory allocation failed.\n");
     return root;
 }
 
+
 // Search BFS and remove pokemon by ID in BST
 PokemonNode *removePokemonByID(PokemonNode *root, int id) {
     // Search for the node using BFS
@@ -721,7 +1736,7 @@ PokemonNode *removePokemonByID(PokemonNode *root, int id) {
 }
 
 
-void releasePokemon(OwnerNode *owner) {
+void releasePokemon(Registry *reg, OwnerNode *owner) {
     // if pokedex of onwer is empty - there is nothing to remove
     if (owner->pokedexRoot == NULL) {
         printf(" No Pokemon to release.\n");
@@ -729,203 +1744,225 @@ void releasePokemon(OwnerNode *owner) {
     }
     // ID to release
     int choice = readIntSafe(" Enter Pokemon ID to release:");
-
-    PokemonNode *found= searchPokemon(owner->pokedexRoot, choice);
-    if (found == NULL) {
+    const PokemonData *released = NULL;
+    switch (pokedexReleasePokemon(reg, owner, choice, &released)) {
+    case POKE_OK:
+        printf(" Removing Pokemon %s (ID %d).\n", released->name, choice);
+        break;
+    case POKE_ERR_EMPTY:
+        printf(" No Pokemon to release.\n");
+        break;
+    default:
         printf(" No Pokemon with ID %d found.\n", choice);
-        return;
     }
-    // Remove pokemon from pokedex by id
-    owner->pokedexRoot = removePokemonByID(owner->pokedexRoot, choice);
 }
 
 //----------- pokemon fight ------------
 void pokemonFight(OwnerNode *owner) {
     int firstId = readIntSafe("Enter ID of the first Pokemon: ");
-    PokemonNode *firstPokemon = searchPokemon(owner->pokedexRoot,firstId);
     int secondId = readIntSafe("Enter ID of the second Pokemon: ");
-    PokemonNode *secondPokemon = searchPokemon(owner->pokedexRoot,secondId);
-    if(firstPokemon == NULL || secondPokemon == NULL) {
+    FightResult fight;
+    if(pokedexFight(owner, firstId, secondId, &fight) != POKE_OK) {
         printf("One or both Pokemon IDs not found.\n");
         return;
     }
-    double a = (firstPokemon->data->attack*1.5)+(firstPokemon->data->hp*1.2);
-    double b = (secondPokemon->data->attack*1.5)+(secondPokemon->data->hp*1.2);
     printf("Pokemon 1: %s (Score = %.2f)\n"
-        "Pokemon 2: %s (Score = %.2f)\n",firstPokemon->data->name,a,secondPokemon->data->name,b);
-    if(a > b) {
-        printf("%s wins!\n",firstPokemon->data->name);
-    }else if(a < b) {
-        printf("%s wins!\n",secondPokemon->data->name);
+        "Pokemon 2: %s (Score = %.2f)\n",fight.first->name,fight.firstScore,
+        fight.second->name,fight.secondScore);
+    if(fight.winner == 1) {
+        printf("%s wins!\n",fight.first->name);
+    }else if(fight.winner == 2) {
+        printf("%s wins!\n",fight.second->name);
     }else
         printf("It's a tie!\n");
 }
 //--------- search for a pokemon the regular way-------------
 PokemonNode *searchPokemon(PokemonNode *root, int id) {
-    if (!root)
-        return NULL;
-    if (root->data->id > id) {
-        return searchPokemon(root->left,id);
-    }else if (root->data->id < id) {
-        return searchPokemon(root->right,id);
+    // Iterative so the visit count is added once per search, not per level
+    unsigned long long visits = 0;
+    while (root) {
+        visits++;
+        if (root->id > id) {
+            root = RCU_DEREF(root->left);
+        }else if (root->id < id) {
+            root = RCU_DEREF(root->right);
+        }else {
+            break;
+        }
     }
+    STAT_ADD(searchVisits, visits);
     return root;
 }
 //------------ evolve the pokemon-------------
-void evolvePokemon(OwnerNode *owner) {
+void evolvePokemon(Registry *reg, OwnerNode *owner) {
     if(owner->pokedexRoot==NULL) {
         printf(" Cannot evolve. Pokedex empty.\n");
         return;
     }
     int id = readIntSafe("Enter ID of Pokemon to evolve: ");
-    PokemonNode *pokemon = searchPokemon(owner->pokedexRoot, id);
-    if (pokemon == NULL) {
+    EvolveResult evolved;
+    switch (pokedexEvolvePokemon(reg, owner, id, &evolved)) {
+    case POKE_OK:
+        if (evolved.alreadyOwned) {
+            printf("Evolution ID %d (%s) already in the Pokedex. Releasing %s (ID %d).\n",
+                   evolved.to->id, evolved.to->name, evolved.from->name, id);
+        } else {
+            printf("Pokemon evolved from %s (ID %d) ", evolved.from->name, id);
+            printf("to %s (ID %d).\n", evolved.to->name, evolved.to->id);
+        }
+        printf(" Removing Pokemon %s (ID %d).\n", evolved.from->name, id);
+        break;
+    case POKE_ERR_EMPTY:
+        printf(" Cannot evolve. Pokedex empty.\n");
+        break;
+    case POKE_ERR_NOT_FOUND:
         printf("Pokemon with ID %d not found.\n", id);
-        return;
-    }
-    if (!pokemon->data->CAN_EVOLVE) {
-        printf("%s (ID %d) cannot evolve.\n", pokemon->data->name, id);
-        return;
-    }
-    PokemonNode *evolvedVersion = searchPokemon(owner->pokedexRoot, id + 1);
-    // If evolve version is already in pokedex
-    if (evolvedVersion != NULL) {
-        printf("Evolution ID %d (%s) already in the Pokedex. Releasing %s (ID %d).\n",
-               evolvedVersion->data->id, evolvedVersion->data->name,
-               pokemon->data->name, id);
-        owner->pokedexRoot= removePokemonByID(owner->pokedexRoot, id);
-        return;
-    }
-    // Evolve the Pokemon
-    printf("Pokemon evolved from %s (ID %d) ", pokemon->data->name, id);
-    PokemonNode *newPokemon = createPokemonNode(pokedex[id].name);
-    if(newPokemon==NULL) {
+        break;
+    case POKE_ERR_CANNOT_EVOLVE:
+        printf("%s (ID %d) cannot evolve.\n", evolved.from->name, id);
+        break;
+    default:
+        printf("Pokemon evolved from %s (ID %d) ", evolved.from->name, id);
         printf("Evolution ID falied - memory allocation error.\n");
-        return;
     }
-    printf("to %s (ID %d).\n", newPokemon->data->name, newPokemon->data->id);
-    // Remove the old Pokemon
-    owner->pokedexRoot= removePokemonByID(owner->pokedexRoot, id);
-    // Insert the evolved Pokemon into the BST
-    owner->pokedexRoot = insertPokemonNode(owner->pokedexRoot, newPokemon);
 }
-void deletePokedex() {
-    printOwners();
+void deletePokedex(Registry *reg) {
+    printOwners(reg);
     int ownerId = readIntSafe("Choose a Pokedex to delete by number: ");
-    if (!ownerHead) {
+    if (!reg->head) {
         printf("No existing Pokedexes to delete.\n");
         return;
     }
     // Ensure that the ownerId is valid
-    OwnerNode *current = ownerHead;
-    int count = 1; // to track the number of elements in the list
-    while (current->next != ownerHead) {
-        current = current->next;
-        count++;
-    }
-    // Check if the input ownerId is within bounds
-    if (ownerId < 1 || ownerId > count) {
+    OwnerNode *current = registryOwnerAt(reg, ownerId);
+    if (current == NULL) {
         printf("Invalid Pokedex number.\n");
         return;
     }
-    // Reset current to head again and traverse to the target ownerId
-    current = ownerHead;
-    for (int i = 1; i < ownerId; i++) {
-        current = current->next;
-    }
     printf("Deleting %s's entire Pokedex...\n",current->ownerName);
-    removeOwnerFromCircularList(current);
+    registryDeleteOwner(reg, current);
     printf("Pokedex deleted.\n");
 }
-void removeOwnerFromCircularList(OwnerNode *target) {
+// Caller holds the writer lock. The target keeps its own next/prev so a reader
+// standing on it can still step off; it is freed after the grace period.
+void removeOwnerFromCircularList(Registry *reg, OwnerNode *target) {
     if(target==NULL) {
         printf("Invalid target node.\n");
         return;
     }
+    RCU_ASSIGN(reg->count, reg->count - 1);
+    RCU_ASSIGN(target->name->owner, NULL);
+    reg->ownersRemoved++;
+    pthread_rwlock_wrlock(&reg->ranking.lock);
+    rankingUnlink(&reg->ranking, target->rank);
+    pthread_rwlock_unlock(&reg->ranking.lock);
     // If only one owner exists
     if (target->next == target) {
-        ownerHead = NULL;
-        freeOwnerNode(target);
+        RCU_ASSIGN(reg->head, NULL);
+        rcuRetire(target, reclaimOwnerNode);
         return;
     }
     // If deleting head of list with multiple owners
-    if (target == ownerHead) {
-        ownerHead = target->next;
+    if (target == reg->head) {
+        RCU_ASSIGN(reg->head, target->next);
         // Update links
-        target->prev->next = target->next;
-        target->next->prev = target->prev;
-        freeOwnerNode(target);
+        RCU_ASSIGN(target->prev->next, target->next);
+        RCU_ASSIGN(target->next->prev, target->prev);
+        rcuRetire(target, reclaimOwnerNode);
     }
     // Deleting any other node
     else {
         // Update links
-        target->prev->next = target->next;
-        target->next->prev = target->prev;
-        freeOwnerNode(target);
+        RCU_ASSIGN(target->prev->next, target->next);
+        RCU_ASSIGN(target->next->prev, target->prev);
+        rcuRetire(target, reclaimOwnerNode);
     }
 }
 //---------- all the free functions ---------------
 void freePokemonNode(PokemonNode *node) {
     if (node == NULL)
         return;
-    if(node->data) {
-        if(node->data->name)
-            free(node->data->name); // Release pokimon's name
-        free(node->data); // Release pokimon's data
-    }
-    free(node); // Release node himself
+    countedFree(ALLOC_SITE_POKEMON_NODE, node); // Release node himself
 }
 
+// Subtrees may be shared with other versions, so this only drops a reference.
+// A node nobody points at any more is retired, and its children lose their
+// reference once it is reclaimed (see reclaimDroppedNode).
 void freePokemonTree(PokemonNode *root) {
     if (root == NULL)
         return;
-    freePokemonTree(root->left);  // Release left tree
-    freePokemonTree(root->right); // Release right tree
-    freePokemonNode(root);        // Release root
+    if (__atomic_sub_fetch(&root->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        rcuRetire(root, reclaimDroppedNode);
 }
 
 void freeOwnerNode(OwnerNode *owner) {
     if (owner == NULL)
         return;
-    free(owner->ownerName);               // Release owner's name
+    releaseName(owner->name); // Release owner's name
+    freeFrozen(owner->frozen);
+    for (int i = 0; i < owner->undoCount; i++)
+        freePokemonTree(owner->undo[i]);  // release earlier versions
     freePokemonTree(owner->pokedexRoot);  // release pokedex root
-    free(owner);                          // Release onwer
+    countedFree(ALLOC_SITE_OWNER, owner->rank);
+    countedFree(ALLOC_SITE_OWNER, owner->summary);
+    countedFree(ALLOC_SITE_OWNER, owner); // Release onwer
+}
+
+static void rankingClear(Leaderboard *board) {
+    for (int i = 0; i < LEADERBOARD_MAX_LEVEL; i++) {
+        board->head->links[i].next = NULL;
+        board->head->links[i].span = 0;
+    }
+    board->level = 1;
+    board->length = 0;
 }
 
-void freeAllOwners() {
-    if(ownerHead==NULL)
+void freeAllOwners(Registry *reg) {
+    rcuWriteLock(reg);
+    OwnerNode *head = reg->head;
+    RCU_ASSIGN(reg->head, NULL);
+    RCU_ASSIGN(reg->count, 0);
+    reg->ownersRemoved++;
+    // Lookups by name stop finding them before they go
+    for (OwnerNode *owner = head; owner != NULL; owner = owner->next == head ? NULL : owner->next)
+        RCU_ASSIGN(owner->name->owner, NULL);
+    pthread_rwlock_wrlock(&reg->ranking.lock);
+    rankingClear(&reg->ranking);
+    pthread_rwlock_unlock(&reg->ranking.lock);
+    rcuWriteUnlock(reg);
+    // No reader can reach the old ring any more once the grace period is over
+    rcuSynchronize();
+    if(head==NULL)
         return;
-    OwnerNode *current = ownerHead; // Set current to head of link list
+    OwnerNode *current = head; // Set current to head of link list
     OwnerNode *next = NULL;
     do {
         next = current->next;  // Saving next node
         freeOwnerNode(current);          // Release current node
         current = next;                  // Cuntinue to next node
-    }while(current!=ownerHead && current!=NULL);
-    ownerHead=NULL;
+    }while(current!=head && current!=NULL);
+    // Their names were retired just now
+    rcuSynchronize();
 }
 //-------------- Function to perform BFS and merge pokedexes -----------
-void mergePokeDex(OwnerNode *ownerA, OwnerNode *ownerB) {
-    if (!ownerB->pokedexRoot) return;
+int mergePokeDex(OwnerNode *ownerA, OwnerNode *ownerB) {
+    if (!ownerB->pokedexRoot) return POKE_OK;
     // Create a queue for BFS
-    PokemonNode **queue = malloc(sizeOfBinTree(ownerB->pokedexRoot) * sizeof(PokemonNode*));
+    PokemonNode **queue = countedMalloc(ALLOC_SITE_MERGE_QUEUE, sizeOfBinTree(ownerB->pokedexRoot) * sizeof(PokemonNode*));
     if(queue == NULL) {
-        printf("Memory allocation error.\n");
-        free(queue);
-        return;
+        return POKE_ERR_NO_MEMORY;
     }
+    int status = POKE_OK;
     int front = 0, rear = 0;
     // Start BFS from root of ownerB's pokedex
     queue[rear++] = ownerB->pokedexRoot;
     while (front < rear) {
         PokemonNode *current = queue[front++];
         // Create a new pokemon node and insert it into ownerA's pokedex
-        PokemonNode *newPokemon = createPokemonNode(current->data->name);
-        if (newPokemon == NULL) {
-            printf("Memory allocation failed for new Pokemon.\n");
-            continue;
+        PokemonNode *newPokemon = createSpeciesNode(current->data);
+        if (newPokemon == NULL || ownerInsert(ownerA, newPokemon) < 0) {
+            status = POKE_ERR_NO_MEMORY;
         }
-        ownerA->pokedexRoot = insertPokemonNode(ownerA->pokedexRoot, newPokemon);
         // Add left and right children to queue if they exist
         if (current->left) {
             queue[rear++] = current->left;
@@ -934,117 +1971,4528 @@ void mergePokeDex(OwnerNode *ownerA, OwnerNode *ownerB) {
             queue[rear++] = current->right;
         }
     }
-    free(queue);
+    countedFree(ALLOC_SITE_MERGE_QUEUE, queue);
+    return status;
 }
-void mergePokedexMenu() {
-    if(ownerHead->next == ownerHead) {
+// Next input line, trimmed and interned in the registry's name table
+static InternedName *readInternedName(Registry *reg) {
+    StrView line = {"", 0};
+    if (readLineView(&line))
+        line = trimView(line);
+    return internName(&reg->names, line.text, line.len);
+}
+void mergePokedexMenu(Registry *reg) {
+    if(reg->head->next == reg->head) {
         printf("Not enough owners to merge.\n");
         return;
     }
     printf("Enter name of first owner: ");
-    char *firstOwner = getDynamicInput();
+    InternedName *firstOwner = readInternedName(reg);
     printf("Enter name of second owner: ");
-    char *secondOwner = getDynamicInput();
+    InternedName *secondOwner = readInternedName(reg);
+    if (firstOwner == NULL || secondOwner == NULL) {
+        printf("Memory allocation failed.\n");
+        releaseName(firstOwner);
+        releaseName(secondOwner);
+        return;
+    }
     // Validation check -cannot merge pokedex with itself
-    if(strcmp(firstOwner, secondOwner)==0) {
+    if(firstOwner == secondOwner) {
         printf("Cannot merge Pokedexs with the same name.\n");
-        free(firstOwner);
-        free(secondOwner);
+        releaseName(firstOwner);
+        releaseName(secondOwner);
         return;
     }// Finding two requested names in link list
-    OwnerNode *OwnerA = findOwnerByName(firstOwner);
-    OwnerNode *OwnerB = findOwnerByName(secondOwner);
+    OwnerNode *OwnerA = findOwnerByInterned(reg, firstOwner);
+    OwnerNode *OwnerB = findOwnerByInterned(reg, secondOwner);
     if (OwnerA == NULL || OwnerB == NULL) {
         printf("One or both owners not found.\n");
-        free(firstOwner);
-        free(secondOwner);
-        return;
-    }
-    printf("Merging %s and %s...\n",firstOwner,secondOwner);
-    mergePokeDex(OwnerA,OwnerB);
-    printf("Merge completed.\n");
-    removeOwnerFromCircularList(OwnerB);
-    printf("Owner '%s' has been removed after merging.\n",secondOwner);
-    free(firstOwner);
-    free(secondOwner);
-}
-OwnerNode *findOwnerByName(const char *name) {
-    if (!ownerHead) return NULL;  // Empty list
-    OwnerNode *current = ownerHead;
-    while (current->next != ownerHead) {
-        if(strcmp(current->ownerName, name) == 0)
-            return current;
-        current = current->next;
+        releaseName(firstOwner);
+        releaseName(secondOwner);
+        return;
     }
-    if(strcmp(current->ownerName,name) == 0)
-        return current;
-    else
+    printf("Merging %s and %s...\n",firstOwner->text,secondOwner->text);
+    if (registryMergeOwners(reg, OwnerA, OwnerB) == POKE_OK) {
+        printf("Merge completed.\n");
+        printf("Owner '%s' has been removed after merging.\n",secondOwner->text);
+    } else {
+        printf("Memory allocation failed.\n");
+    }
+    releaseName(firstOwner);
+    releaseName(secondOwner);
+}
+// Interned names are unique, and each one in the ring points at its owner:
+// no walk, so a sort relinking the ring meanwhile cannot hide anybody
+static OwnerNode *findOwnerByInterned(Registry *reg, const InternedName *name) {
+    if (name->table != &reg->names)
         return NULL;
+    STAT_ADD(findComparisons, 1);
+    return RCU_DEREF(name->owner);
+}
+OwnerNode *findOwnerByName(Registry *reg, const char *name) {
+    rcuReadLock();
+    // A name missing from the table belongs to nobody: no ring walk at all
+    const InternedName *key = lookupName(&reg->names, name, strlen(name));
+    OwnerNode *found = key ? findOwnerByInterned(reg, key) : NULL;
+    rcuReadUnlock();
+    return found;
 }
 //--------------- Sorting Owners --------------
-void sortOwners() {
-    if (ownerHead == NULL ||ownerHead->next == ownerHead ) {
+static int compareOwnersByName(const void *a, const void *b) {
+    const OwnerNode *ownerA = *(OwnerNode *const *)a;
+    const OwnerNode *ownerB = *(OwnerNode *const *)b;
+    STAT_ADD(sortComparisons, 1);
+    return compareInternedNames(ownerA->name, ownerB->name);
+}
+
+void sortOwners(Registry *reg) {
+    switch (registrySortOwners(reg)) {
+    case POKE_OK:
+        printf("Owners sorted by name.\n");
+        break;
+    case POKE_ERR_TOO_FEW_OWNERS:
         printf("0 or 1 owners only => no need to sort.\n");
-        return;
+        break;
+    default:
+        printf("Memory allocation failed.\n");
     }
-    int swapped = 0;
-    OwnerNode *current ;
-    OwnerNode *last = ownerHead->prev;
-    do {
-        swapped = 0;          // Reset swap flag for this pass
-        current = ownerHead;  // Start from the head
-        // Inner while: moves through adjacent pairs of nodes
-        while (current != last) {
-            // Compare current with next node
-            if (strcmp(current->ownerName, current->next->ownerName) > 0) {
-                // Swap their data
-                swapOwnerData(current, current->next);
-                swapped = 1;  // Mark that we did a swap
-            }
-            current = current->next;  // Move to next pair
-        }
-        last = current->prev;  // Shrink the unsorted portion
-    } while (swapped);  // Outer loop: continue if any swaps happened
-    printf("Owners sorted by name.\n");
-}
-void swapOwnerData(OwnerNode *a, OwnerNode *b) {
-    // Swap pointers of names
-    char *tempName= a->ownerName;
-    a->ownerName= b->ownerName;
-    b->ownerName= tempName;
-    // Swap pointers to pokedex root
-    PokemonNode *tempPokedexRoot= a->pokedexRoot;
-    a->pokedexRoot= b->pokedexRoot;
-    b->pokedexRoot= tempPokedexRoot;
 }
 //--------Printing Owners in a Circle---------
-void printOwnersCircular(void) {
-    if(ownerHead==NULL) {
+void printOwnersCircular(Registry *reg) {
+    if(reg->head==NULL) {
         printf(" No owners.\n");
         return;
     }
     printf(" Enter direction (F or B): ");
-    char *direction=getDynamicInput();
-    while(strcmp(direction,"F")!=0 && strcmp(direction,"B")!=0 && strcmp(direction,"f")!=0
-        && strcmp(direction,"b")!=0) {
+    // Only the direction letter is kept, so the line can stay in the input buffer
+    StrView direction = {"", 0};
+    if (readLineView(&direction))
+        direction = trimView(direction);
+    while(!viewEquals(direction,"F") && !viewEquals(direction,"B") && !viewEquals(direction,"f")
+        && !viewEquals(direction,"b")) {
         printf("Invalid direction, must by F or B.\n");
-        free(direction);
         printf(" Enter direction (F or B): ");
-        direction=getDynamicInput();
+        direction.len = 0;
+        if (readLineView(&direction))
+            direction = trimView(direction);
         }
+    int forward = (*direction.text == 'F' || *direction.text == 'f');
     int numberOfPrints=readIntSafe("How many prints? ");
-    OwnerNode *current=ownerHead;
-    if (strcmp(direction,"F")==0 || strcmp(direction,"f")==0) {
-        for(int i=1; i<=numberOfPrints; i++) {
-            printf("[%d] %s\n",i, current->ownerName);
-            current=current->next;
+    writeOwnersCircular(reg, stdout, forward, numberOfPrints);
+}
+
+// Copies the names of one trip around the ring (at most limit owners) as
+// "name\n" pieces; ends[j] is the offset just past owner j's line. Returns
+// the number of owners, 0 if there are none, -1 if memory ran out.
+static int snapshotCircle(Registry *reg, int forward, int limit, StrBuf *names, size_t **ends) {
+    int count = 0, cap = 0, ok = 1;
+    rcuReadLock();
+    OwnerNode *start = RCU_DEREF(reg->head);
+    // start is NULL if every owner was deleted while we waited for input
+    for (OwnerNode *current = start; current != NULL && count < limit && ok;) {
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            size_t *bigger = (size_t *)countedRealloc(ALLOC_SITE_CIRCULAR, *ends, sizeof(size_t) * cap);
+            if (bigger == NULL) {
+                ok = 0;
+                break;
+            }
+            *ends = bigger;
+        }
+        ok = sbAppendf(names, "%s\n", current->ownerName);
+        (*ends)[count++] = names->len;
+        current = forward ? RCU_DEREF(current->next) : RCU_DEREF(current->prev);
+        if (current == start)
+            break;
+    }
+    rcuReadUnlock();
+    return ok ? count : -1;
+}
+
+// Adds one to a decimal number of width digits, in place
+static void incrementDigits(char *digits, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        if (digits[i] != '9') {
+            digits[i]++;
+            return;
+        }
+        digits[i] = '0';
+    }
+}
+
+void writeOwnersCircular(Registry *reg, FILE *out, int forward, int count) {
+    if (reg == NULL || out == NULL || count <= 0)
+        return;
+    StrBuf names = {NULL, 0, 0};
+    size_t *ends = NULL;
+    int owners = snapshotCircle(reg, forward, count, &names, &ends);
+    char *chunk = NULL;
+    size_t *digitsAt = NULL;
+    size_t *lineEnd = NULL;
+    if (owners < 0)
+        printf("Memory allocation failed.\n");
+    long line = 1;
+    // Every run of line numbers with the same digit count gets its own
+    // chunk: whole cycles, starting at the owner the run starts on, so
+    // consecutive chunks line up and only the digits differ between them
+    for (int width = 1; owners > 0 && line <= count; width++) {
+        long long widest = 1;
+        for (int i = 0; i < width; i++)
+            widest *= 10;
+        long runEnd = widest - 1 < count ? (long)(widest - 1) : count;
+        if (line > runEnd)
+            continue;
+        size_t cycleBytes = names.len + (size_t)owners * (size_t)(width + 3); // "[" digits "] "
+        long cycles = cycleBytes >= CIRCULAR_CHUNK ? 1 : (long)(CIRCULAR_CHUNK / cycleBytes);
+        long runCycles = (runEnd - line + owners) / owners;
+        if (cycles > runCycles)
+            cycles = runCycles;
+        long lines = cycles * owners;
+        countedFree(ALLOC_SITE_CIRCULAR, chunk);
+        countedFree(ALLOC_SITE_CIRCULAR, digitsAt);
+        countedFree(ALLOC_SITE_CIRCULAR, lineEnd);
+        chunk = (char *)countedMalloc(ALLOC_SITE_CIRCULAR, cycleBytes * (size_t)cycles);
+        digitsAt = (size_t *)countedMalloc(ALLOC_SITE_CIRCULAR, sizeof(size_t) * (size_t)lines);
+        lineEnd = (size_t *)countedMalloc(ALLOC_SITE_CIRCULAR, sizeof(size_t) * (size_t)lines);
+        if (chunk == NULL || digitsAt == NULL || lineEnd == NULL) {
+            printf("Memory allocation failed.\n");
+            break;
+        }
+        size_t at = 0;
+        int owner = (int)((line - 1) % owners);
+        for (long j = 0; j < lines; j++) {
+            size_t from = owner > 0 ? ends[owner - 1] : 0;
+            chunk[at++] = '[';
+            digitsAt[j] = at;
+            at += (size_t)width;
+            chunk[at++] = ']';
+            chunk[at++] = ' ';
+            memcpy(chunk + at, names.text + from, ends[owner] - from);
+            at += ends[owner] - from;
+            lineEnd[j] = at;
+            if (++owner == owners)
+                owner = 0;
+        }
+        char digits[24];
+        snprintf(digits, sizeof(digits), "%ld", line);
+        while (line <= runEnd) {
+            long take = runEnd - line + 1 < lines ? runEnd - line + 1 : lines;
+            for (long j = 0; j < take; j++) {
+                char *slot = chunk + digitsAt[j];
+                for (int d = 0; d < width; d++)
+                    slot[d] = digits[d];
+                incrementDigits(digits, width);
+            }
+            fwrite(chunk, 1, lineEnd[take - 1], out);
+            line += take;
+        }
+    }
+    countedFree(ALLOC_SITE_CIRCULAR, chunk);
+    countedFree(ALLOC_SITE_CIRCULAR, digitsAt);
+    countedFree(ALLOC_SITE_CIRCULAR, lineEnd);
+    countedFree(ALLOC_SITE_CIRCULAR, ends);
+    sbFree(&names);
+}
+//--------------- RCU-style epoch reclamation ---------------
+// Every reader owns a slot holding the epoch it entered in (0 = idle). The
+// global epoch may only advance once every busy reader has caught up with it,
+// so anything retired in epoch E is unreachable for all readers by E + 2.
+typedef struct
+{
+    unsigned long epoch;
+    int claimed;
+    char pad[64 - sizeof(unsigned long) - sizeof(int)]; // one slot per cache line
+} RcuSlot;
+
+typedef struct RcuRetired
+{
+    void *ptr;
+    RcuReclaimFunc reclaim;
+    unsigned long epoch;
+    struct RcuRetired *next;
+} RcuRetired;
+
+static RcuSlot rcuSlots[RCU_MAX_READERS];
+static unsigned long rcuGlobalEpoch = 1;
+static pthread_mutex_t rcuLimboMutex = PTHREAD_MUTEX_INITIALIZER;
+static RcuRetired *rcuLimbo = NULL;
+static int rcuLimboSize = 0; // changed under rcuLimboMutex, read without it
+static RcuRetired rcuReserve[RCU_RESERVE];
+static unsigned char rcuReserveBusy[RCU_RESERVE]; // under rcuLimboMutex
+static __thread int rcuMySlot = -1;
+static __thread int rcuNesting = 0;
+static __thread unsigned long rcuRetiredHere = 0; // rcuRetire calls on this thread
+// Holds slot + 1 for each thread with a slot, so the slot is freed on exit
+static pthread_key_t rcuSlotKey;
+static pthread_once_t rcuSlotKeyOnce = PTHREAD_ONCE_INIT;
+
+static void rcuSlotRelease(void *slot) {
+    int i = (int)(intptr_t)slot - 1;
+    // A thread that exits inside a read section must not hold up every writer
+    __atomic_store_n(&rcuSlots[i].epoch, 0UL, __ATOMIC_RELEASE);
+    __atomic_store_n(&rcuSlots[i].claimed, 0, __ATOMIC_RELEASE);
+}
+
+static void rcuSlotKeyCreate(void) {
+    pthread_key_create(&rcuSlotKey, rcuSlotRelease);
+}
+
+static void rcuClaimSlot(void) {
+    pthread_once(&rcuSlotKeyOnce, rcuSlotKeyCreate);
+    // Spin until a slot frees up; more than RCU_MAX_READERS live readers is a bug
+    for (;;) {
+        for (int i = 0; i < RCU_MAX_READERS; i++) {
+            int expected = 0;
+            if (__atomic_compare_exchange_n(&rcuSlots[i].claimed, &expected, 1, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                rcuMySlot = i;
+                pthread_setspecific(rcuSlotKey, (void *)(intptr_t)(i + 1));
+                return;
+            }
+        }
+        sched_yield();
+    }
+}
+
+void rcuReadLock(void) {
+    if (rcuNesting++ > 0)
+        return;
+    if (rcuMySlot < 0)
+        rcuClaimSlot();
+    __atomic_store_n(&rcuSlots[rcuMySlot].epoch, __atomic_load_n(&rcuGlobalEpoch, __ATOMIC_ACQUIRE),
+                     __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void rcuReadUnlock(void) {
+    if (--rcuNesting > 0)
+        return;
+    __atomic_store_n(&rcuSlots[rcuMySlot].epoch, 0UL, __ATOMIC_RELEASE);
+}
+
+void rcuThreadOffline(void) {
+    if (rcuMySlot < 0 || rcuNesting > 0)
+        return;
+    pthread_setspecific(rcuSlotKey, NULL);
+    __atomic_store_n(&rcuSlots[rcuMySlot].claimed, 0, __ATOMIC_RELEASE);
+    rcuMySlot = -1;
+}
+
+void rcuWriteLock(Registry *reg) {
+    pthread_mutex_lock(&reg->writer);
+}
+
+void rcuWriteUnlock(Registry *reg) {
+    pthread_mutex_unlock(&reg->writer);
+    if (__atomic_load_n(&rcuLimboSize, __ATOMIC_RELAXED) >= RCU_RECLAIM_BATCH)
+        rcuReclaim();
+}
+
+// Advance the global epoch if every active reader has observed the current one
+static unsigned long rcuTryAdvance(void) {
+    unsigned long global = __atomic_load_n(&rcuGlobalEpoch, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (int i = 0; i < RCU_MAX_READERS; i++) {
+        unsigned long e = __atomic_load_n(&rcuSlots[i].epoch, __ATOMIC_SEQ_CST);
+        if (e != 0 && e != global)
+            return global;
+    }
+    __atomic_compare_exchange_n(&rcuGlobalEpoch, &global, global + 1, 0,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&rcuGlobalEpoch, __ATOMIC_SEQ_CST);
+}
+
+// Waits until every reader that might have seen something retired before the
+// call is gone: two epoch advances. Never call it inside a read section.
+static void rcuWaitGracePeriod(void) {
+    unsigned long target = __atomic_load_n(&rcuGlobalEpoch, __ATOMIC_SEQ_CST) + 2;
+    while (rcuTryAdvance() < target)
+        sched_yield();
+}
+
+void rcuRetire(void *ptr, RcuReclaimFunc reclaim) {
+    if (ptr == NULL)
+        return;
+    rcuRetiredHere++;
+    RcuRetired *item = (RcuRetired *)countedMalloc(ALLOC_SITE_RCU_LIMBO, sizeof(RcuRetired));
+    pthread_mutex_lock(&rcuLimboMutex);
+    for (int i = 0; item == NULL && i < RCU_RESERVE; i++) {
+        if (!rcuReserveBusy[i]) {
+            rcuReserveBusy[i] = 1;
+            item = &rcuReserve[i];
+        }
+    }
+    if (item == NULL) {
+        pthread_mutex_unlock(&rcuLimboMutex);
+        // Nowhere to park it. Outside a read section, wait out the readers and
+        // free it now; inside one our own slot would hold the wait up forever,
+        // so it is left unfreed (it is unreachable either way).
+        if (rcuNesting == 0) {
+            rcuWaitGracePeriod();
+            reclaim(ptr);
+        }
+        return;
+    }
+    item->ptr = ptr;
+    item->reclaim = reclaim;
+    item->epoch = __atomic_load_n(&rcuGlobalEpoch, __ATOMIC_SEQ_CST);
+    item->next = rcuLimbo;
+    rcuLimbo = item;
+    __atomic_add_fetch(&rcuLimboSize, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&rcuLimboMutex);
+}
+
+void rcuReclaim(void) {
+    unsigned long global = rcuTryAdvance();
+    pthread_mutex_lock(&rcuLimboMutex);
+    RcuRetired *ready = NULL;
+    RcuRetired **link = &rcuLimbo;
+    while (*link) {
+        RcuRetired *item = *link;
+        if (item->epoch + 2 <= global) {
+            *link = item->next;
+            item->next = ready;
+            ready = item;
+            __atomic_sub_fetch(&rcuLimboSize, 1, __ATOMIC_RELAXED);
+        } else {
+            link = &item->next;
+        }
+    }
+    pthread_mutex_unlock(&rcuLimboMutex);
+    // Run the reclaimers outside the lock, they may retire more objects
+    while (ready) {
+        RcuRetired *next = ready->next;
+        ready->reclaim(ready->ptr);
+        if (ready >= rcuReserve && ready < rcuReserve + RCU_RESERVE) {
+            pthread_mutex_lock(&rcuLimboMutex);
+            rcuReserveBusy[ready - rcuReserve] = 0;
+            pthread_mutex_unlock(&rcuLimboMutex);
+        } else {
+            countedFree(ALLOC_SITE_RCU_LIMBO, ready);
         }
+        ready = next;
     }
-    else if(strcmp(direction,"B")==0 || strcmp(direction,"b")==0) {
-        for(int i=1; i<=numberOfPrints; i++) {
-            printf("[%d] %s\n",i, current->ownerName);
-            current=current->prev;
+}
+
+void rcuSynchronize(void) {
+    // Freeing may retire more (a dropped node's children, an owner's names);
+    // those are waited out too, but not what other threads retire meanwhile
+    unsigned long retired;
+    do {
+        retired = rcuRetiredHere;
+        rcuWaitGracePeriod();
+        rcuReclaim();
+    } while (rcuRetiredHere != retired);
+}
+
+//--------------- Whole-registry report ---------------
+int sbAppendf(StrBuf *sb, const char *fmt, ...) {
+    for (;;) {
+        size_t room = sb->cap - sb->len;
+        va_list args;
+        va_start(args, fmt);
+        int needed = vsnprintf(sb->text ? sb->text + sb->len : NULL, room, fmt, args);
+        va_end(args);
+        if (needed < 0)
+            return 0;
+        if ((size_t)needed < room) {
+            sb->len += (size_t)needed;
+            return 1;
         }
+        // Not enough room: grow geometrically and format again
+        size_t newCap = sb->cap ? sb->cap * 2 : 4096;
+        while (newCap - sb->len <= (size_t)needed)
+            newCap *= 2;
+        char *bigger = (char *)countedRealloc(ALLOC_SITE_REPORT, sb->text, newCap);
+        if (bigger == NULL)
+            return 0;
+        sb->text = bigger;
+        sb->cap = newCap;
+    }
+}
+
+void sbFree(StrBuf *sb) {
+    countedFree(ALLOC_SITE_REPORT, sb->text);
+    sb->text = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+}
+
+int workerThreadCount(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+// One owner as of the moment the report started: its name and a snapshot
+typedef struct
+{
+    InternedName *name;
+    PokemonNode *root;
+} ReportEntry;
+
+typedef struct
+{
+    ReportEntry *owners;
+    int count;
+    StrBuf *chunks; // one private buffer per REPORT_CHUNK_OWNERS owners
+    int chunkCount;
+    int nextChunk;  // claimed with an atomic add, so fast workers take more
+    TraversalOrder order;
+} ReportJob;
+
+// The worker's buffer rides along as the context, a batch of lines per call
+static VisitResult appendPokemonNodes(PokemonNode **nodes, int count, void *context) {
+    StrBuf *sb = (StrBuf *)context;
+    for (int i = 0; i < count; i++) {
+        const PokemonData *data = nodes[i]->data;
+        sbAppendf(sb, POKEMON_LINE_FMT,
+                  nodes[i]->id,
+                  data->name,
+                  getTypeName(data->TYPE),
+                  data->hp,
+                  data->attack,
+                  (data->CAN_EVOLVE == CAN_EVOLVE) ? "Yes" : "No");
+    }
+    return VISIT_CONTINUE;
+}
+
+static void formatOwnerReport(StrBuf *sb, const ReportEntry *owner, TraversalOrder order) {
+    PokemonNode *root = owner->root;
+    sbAppendf(sb, "\n--- %s's Pokedex ---\n", owner->name->text);
+    if (root == NULL) {
+        sbAppendf(sb, "Pokedex is empty.\n");
+        return;
+    }
+    traverseBatched(root, order, appendPokemonNodes, sb);
+}
+
+// Snapshots never change and hold their own references, so the workers need
+// no read section and reclamation carries on while they format
+static void *reportWorker(void *arg) {
+    ReportJob *job = (ReportJob *)arg;
+    for (;;) {
+        int chunk = __atomic_fetch_add(&job->nextChunk, 1, __ATOMIC_RELAXED);
+        if (chunk >= job->chunkCount)
+            break;
+        int first = chunk * REPORT_CHUNK_OWNERS;
+        int last = first + REPORT_CHUNK_OWNERS;
+        if (last > job->count)
+            last = job->count;
+        for (int i = first; i < last; i++)
+            formatOwnerReport(&job->chunks[chunk], &job->owners[i], job->order);
+    }
+    perfFlushThread();
+    rcuThreadOffline();
+    return NULL;
+}
+
+static void releaseReportEntries(ReportJob *job) {
+    for (int i = 0; i < job->count; i++) {
+        pokedexSnapshotRelease(job->owners[i].root);
+        releaseName(job->owners[i].name);
+    }
+    countedFree(ALLOC_SITE_REPORT, job->owners);
+}
+
+void generateRegistryReport(Registry *reg, FILE *out, TraversalOrder order, int threads) {
+    // Snapshot every owner under the writer lock: O(1) each, and the report
+    // shows the whole registry as of one moment however long formatting takes
+    rcuWriteLock(reg);
+    OwnerNode *head = reg->head;
+    int limit = reg->count;
+    if (head == NULL || limit <= 0) {
+        rcuWriteUnlock(reg);
+        fprintf(out, "No existing Pokedexes.\n");
+        return;
+    }
+    ReportJob job;
+    job.owners = (ReportEntry *)countedMalloc(ALLOC_SITE_REPORT, sizeof(ReportEntry) * limit);
+    if (job.owners == NULL) {
+        rcuWriteUnlock(reg);
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    job.count = 0;
+    OwnerNode *current = head;
+    do {
+        job.owners[job.count].name = retainName(current->name);
+        job.owners[job.count].root = shareRoot(current);
+        job.count++;
+        current = current->next;
+    } while (current != head && job.count < limit);
+    rcuWriteUnlock(reg);
+
+    job.chunkCount = (job.count + REPORT_CHUNK_OWNERS - 1) / REPORT_CHUNK_OWNERS;
+    job.chunks = (StrBuf *)countedMalloc(ALLOC_SITE_REPORT, sizeof(StrBuf) * job.chunkCount);
+    if (job.chunks == NULL) {
+        releaseReportEntries(&job);
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    memset(job.chunks, 0, sizeof(StrBuf) * job.chunkCount);
+    job.nextChunk = 0;
+    job.order = order;
+
+    if (threads <= 0)
+        threads = workerThreadCount();
+    if (threads > job.chunkCount)
+        threads = job.chunkCount;
+    pthread_t *workers = (pthread_t *)countedMalloc(ALLOC_SITE_REPORT, sizeof(pthread_t) * threads);
+    int started = 0;
+    // The calling thread is worker number 0
+    for (int i = 1; workers != NULL && i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, reportWorker, &job) != 0)
+            break;
+        started++;
+    }
+    reportWorker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+    countedFree(ALLOC_SITE_REPORT, workers);
+
+    // Stitch the private buffers back together in ring order
+    for (int i = 0; i < job.chunkCount; i++) {
+        if (job.chunks[i].len > 0)
+            fwrite(job.chunks[i].text, 1, job.chunks[i].len, out);
+        sbFree(&job.chunks[i]);
+    }
+    countedFree(ALLOC_SITE_REPORT, job.chunks);
+    releaseReportEntries(&job);
+}
+
+void registryReportMenu(Registry *reg) {
+    if (reg->head == NULL) {
+        printf("No existing Pokedexes.\n");
+        return;
+    }
+    printf("Report order:\n");
+    printf("1. BFS (Level-Order)\n");
+    printf("2. Pre-Order\n");
+    printf("3. In-Order\n");
+    printf("4. Post-Order\n");
+    printf("5. Alphabetical (by name)\n");
+    int choice = readIntSafe("Your choice: ");
+    if (choice < ORDER_BFS || choice > ORDER_ALPHA) {
+        printf("Invalid choice.\n");
+        return;
+    }
+    generateRegistryReport(reg, stdout, (TraversalOrder)choice, 0);
+    fflush(stdout);
+}
+
+//--------------- Hot-path counters & statistics ---------------
+static void addCounters(PerfCounters *into, const PerfCounters *from) {
+    // PerfCounters is nothing but unsigned long long fields
+    unsigned long long *dst = (unsigned long long *)into;
+    const unsigned long long *src = (const unsigned long long *)from;
+    for (size_t i = 0; i < sizeof(PerfCounters) / sizeof(unsigned long long); i++)
+        __atomic_fetch_add(&dst[i], src[i], __ATOMIC_RELAXED);
+}
+
+void perfFlushThread(void) {
+#ifndef EX6_NO_STATS
+    addCounters(&globalCounters, &threadCounters);
+    memset(&threadCounters, 0, sizeof(threadCounters));
+#endif
+}
+
+void perfSnapshot(PerfCounters *out) {
+    memset(out, 0, sizeof(*out));
+    addCounters(out, &globalCounters);
+#ifndef EX6_NO_STATS
+    addCounters(out, &threadCounters);
+#endif
+}
+
+const char *getAllocSiteName(AllocSite site) {
+    static const char *names[] = {
+        [ALLOC_SITE_STRDUP] = "strdup",
+        [ALLOC_SITE_INPUT] = "input",
+        [ALLOC_SITE_POKEMON_NODE] = "pokemon_node",
+        [ALLOC_SITE_OWNER] = "owner",
+        [ALLOC_SITE_NODE_ARRAY] = "node_array",
+        [ALLOC_SITE_BFS_QUEUE] = "bfs_queue",
+        [ALLOC_SITE_MERGE_QUEUE] = "merge_queue",
+        [ALLOC_SITE_SORT] = "sort",
+        [ALLOC_SITE_RCU_LIMBO] = "rcu_limbo",
+        [ALLOC_SITE_REPORT] = "report",
+        [ALLOC_SITE_NAMES] = "names",
+        [ALLOC_SITE_FROZEN] = "frozen",
+        [ALLOC_SITE_BATTLE] = "battle",
+        [ALLOC_SITE_VISIT] = "visit",
+        [ALLOC_SITE_CATALOG] = "catalog",
+        [ALLOC_SITE_CIRCULAR] = "circular",
+        [ALLOC_SITE_QUERY] = "query",
+        [ALLOC_SITE_BULK] = "bulk",
+        [ALLOC_SITE_MATCHUP] = "matchup",
+    };
+    typedef char namesComplete[sizeof(names) / sizeof(names[0]) == ALLOC_SITE_COUNT ? 1 : -1];
+    (void)sizeof(namesComplete);
+    return (site >= 0 && site < ALLOC_SITE_COUNT) ? names[site] : "unknown";
+}
+
+int treeHeight(PokemonNode *root) {
+    if (root == NULL)
+        return 0;
+    int left = treeHeight(RCU_DEREF(root->left));
+    int right = treeHeight(RCU_DEREF(root->right));
+    return 1 + (left > right ? left : right);
+}
+
+// Smallest possible height of a BST with n nodes: ceil(log2(n + 1))
+static int optimalHeight(int n) {
+    int height = 0;
+    while (n > 0) {
+        height++;
+        n /= 2;
     }
-    free(direction);
+    return height;
+}
+
+static void printJsonString(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(out, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(out, "\\u%04x", *c);
+        else
+            fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+void dumpStatsJSON(Registry *reg, FILE *out) {
+    PerfCounters totals;
+    perfSnapshot(&totals);
+    fprintf(out, "{\"visits\":{\"search\":%llu,\"insert\":%llu,\"remove\":%llu,\"traversal\":%llu},",
+            totals.searchVisits, totals.insertVisits, totals.removeVisits, totals.traversalVisits);
+    fprintf(out, "\"comparisons\":{\"sortOwners\":%llu,\"findOwnerByName\":%llu},",
+            totals.sortComparisons, totals.findComparisons);
+    fprintf(out, "\"pathCopies\":%llu,", totals.pathCopies);
+    fprintf(out, "\"allocations\":{");
+    for (int i = 0; i < ALLOC_SITE_COUNT; i++) {
+        fprintf(out, "%s\"%s\":{\"allocs\":%llu,\"frees\":%llu,\"live\":%lld}", i ? "," : "",
+                getAllocSiteName((AllocSite)i), totals.allocs[i], totals.frees[i],
+                (long long)(totals.allocs[i] - totals.frees[i]));
+    }
+    fprintf(out, "},\"subsystems\":{");
+    for (int i = 0; i < ALLOC_TAG_COUNT; i++) {
+        const Allocator *allocator = allocatorGet((AllocTag)i);
+        fprintf(out, "%s\"%s\":{\"allocator\":", i ? "," : "", getAllocTagName((AllocTag)i));
+        printJsonString(out, allocator->name);
+        fprintf(out, ",\"allocs\":%llu,\"frees\":%llu,\"live\":%lld,\"liveBytes\":%lld,\"reserved\":",
+                totals.tagAllocs[i], totals.tagFrees[i], (long long)(totals.tagAllocs[i] - totals.tagFrees[i]),
+                (long long)(totals.tagBytes[i] - totals.tagFreedBytes[i]));
+        if (allocator->reserved != NULL)
+            fprintf(out, "%zu}", allocator->reserved(allocator->state));
+        else
+            fprintf(out, "null}");
+    }
+    fprintf(out, "},\"owners\":[");
+    rcuReadLock();
+    OwnerNode *head = RCU_DEREF(reg->head);
+    int limit = RCU_DEREF(reg->count);
+    OwnerNode *current = head;
+    for (int i = 0; current != NULL && i < limit; i++) {
+        PokemonNode *root = RCU_DEREF(current->pokedexRoot);
+        // Totals from the published summary: writers edit the live tree's in
+        // place. Missing only if memory ran out at the last change.
+        PokedexSummary totals = {0};
+        const PokedexSummary *published = RCU_DEREF(current->summary);
+        if (published != NULL)
+            totals = *published;
+        fprintf(out, "%s{\"name\":", i ? "," : "");
+        printJsonString(out, current->ownerName);
+        fprintf(out, ",\"size\":%d,\"depth\":%d,\"maxDepth\":%d,\"optimalDepth\":%d,"
+                "\"totalHp\":%d,\"totalAttack\":%d}",
+                totals.count, treeHeight(root), totals.maxDepth, optimalHeight(totals.count),
+                totals.totalHp, totals.totalAttack);
+        current = RCU_DEREF(current->next);
+        if (current == head)
+            break;
+    }
+    rcuReadUnlock();
+    fprintf(out, "]}\n");
+}
+
+static void printStatsTable(Registry *reg) {
+    PerfCounters totals;
+    perfSnapshot(&totals);
+    printf("Node visits: search %llu, insert %llu, remove %llu, traversal %llu\n",
+           totals.searchVisits, totals.insertVisits, totals.removeVisits, totals.traversalVisits);
+    printf("Comparisons: sortOwners %llu, findOwnerByName %llu\n",
+           totals.sortComparisons, totals.findComparisons);
+    printf("Path copies: %llu\n", totals.pathCopies);
+    printf("%-14s %12s %12s %12s\n", "Alloc site", "Allocs", "Frees", "Live");
+    for (int i = 0; i < ALLOC_SITE_COUNT; i++) {
+        printf("%-14s %12llu %12llu %12lld\n", getAllocSiteName((AllocSite)i),
+               totals.allocs[i], totals.frees[i], (long long)(totals.allocs[i] - totals.frees[i]));
+    }
+    printf("%-10s %-8s %12s %12s %14s %14s\n", "Subsystem", "Via", "Live", "Allocs", "Live bytes", "Reserved");
+    for (int i = 0; i < ALLOC_TAG_COUNT; i++) {
+        const Allocator *allocator = allocatorGet((AllocTag)i);
+        printf("%-10s %-8s %12lld %12llu %14lld", getAllocTagName((AllocTag)i), allocator->name,
+               (long long)(totals.tagAllocs[i] - totals.tagFrees[i]), totals.tagAllocs[i],
+               (long long)(totals.tagBytes[i] - totals.tagFreedBytes[i]));
+        if (allocator->reserved != NULL)
+            printf(" %14zu\n", allocator->reserved(allocator->state));
+        else
+            printf(" %14s\n", "-");
+    }
+    printf("%-20s %8s %8s %8s %8s\n", "Owner", "Size", "Depth", "MaxDepth", "Optimal");
+    rcuReadLock();
+    OwnerNode *head = RCU_DEREF(reg->head);
+    int limit = RCU_DEREF(reg->count);
+    OwnerNode *current = head;
+    for (int i = 0; current != NULL && i < limit; i++) {
+        PokemonNode *root = RCU_DEREF(current->pokedexRoot);
+        PokedexSummary totals = {0};
+        const PokedexSummary *published = RCU_DEREF(current->summary);
+        if (published != NULL)
+            totals = *published;
+        int depth = treeHeight(root);
+        int optimal = optimalHeight(totals.count);
+        // Twice the optimal height is where lookups start to feel like a list
+        printf("%-20s %8d %8d %8d %8d%s\n", current->ownerName, totals.count, depth, totals.maxDepth,
+               optimal, depth > 2 * optimal ? "  (degenerate)" : "");
+        current = RCU_DEREF(current->next);
+        if (current == head)
+            break;
+    }
+    rcuReadUnlock();
+}
+
+void statsMenu(Registry *reg) {
+    printf("Statistics:\n");
+    printf("1. Table\n");
+    printf("2. JSON\n");
+    int choice = readIntSafe("Your choice: ");
+    if (choice == 1) {
+        printStatsTable(reg);
+    } else if (choice == 2) {
+        dumpStatsJSON(reg, stdout);
+    } else {
+        printf("Invalid choice.\n");
+    }
+}
+
+//--------------- Library API ---------------
+Registry *registryCreate(void) {
+    Registry *reg = (Registry *)countedMalloc(ALLOC_SITE_OWNER, sizeof(Registry));
+    if (reg == NULL)
+        return NULL;
+    reg->head = NULL;
+    reg->count = 0;
+    reg->undoDepth = 0;
+    reg->ownersRemoved = 0;
+    reg->ranking.head = createRankNode(NULL, LEADERBOARD_MAX_LEVEL);
+    if (reg->ranking.head == NULL || !nameTableInit(&reg->names)) {
+        countedFree(ALLOC_SITE_OWNER, reg->ranking.head);
+        countedFree(ALLOC_SITE_OWNER, reg);
+        return NULL;
+    }
+    reg->ranking.level = 1;
+    reg->ranking.length = 0;
+    pthread_rwlock_init(&reg->ranking.lock, NULL);
+    pthread_mutex_init(&reg->writer, NULL);
+    return reg;
+}
+
+void registryDestroy(Registry *reg) {
+    if (reg == NULL)
+        return;
+    freeAllOwners(reg);
+    nameTableFree(&reg->names);
+    countedFree(ALLOC_SITE_OWNER, reg->ranking.head);
+    pthread_rwlock_destroy(&reg->ranking.lock);
+    pthread_mutex_destroy(&reg->writer);
+    countedFree(ALLOC_SITE_OWNER, reg);
+}
+
+const char *getStatusMessage(PokeStatus status) {
+    static const char *messages[POKE_STATUS_COUNT] = {
+        "ok", "invalid argument", "invalid Pokemon ID", "memory allocation failed",
+        "Pokedex is empty", "Pokemon not found", "Pokemon already in the Pokedex",
+        "Pokemon cannot evolve", "owner already exists", "same owner given twice",
+        "not enough owners", "nothing to undo", "species catalog missing or malformed",
+        "species catalog already loaded", "allocator still in use"};
+    return (status >= 0 && status < POKE_STATUS_COUNT) ? messages[status] : "unknown status";
+}
+
+const PokemonData *findSpecies(int id) {
+    if (id < 1 || id > catalog.count)
+        return NULL;
+    return &catalog.species[id - 1];
+}
+
+PokeStatus registryAddOwner(Registry *reg, const char *name, int starterId, OwnerNode **created) {
+    if (reg == NULL || name == NULL)
+        return POKE_ERR_INVALID_ARG;
+    const PokemonData *species = findSpecies(starterId);
+    if (species == NULL)
+        return POKE_ERR_INVALID_ID;
+    // Build everything before taking the lock; only the check and the link are serialized
+    InternedName *ownName = internName(&reg->names, name, strlen(name));
+    PokemonNode *starter = createSpeciesNode(species);
+    OwnerNode *owner = (ownName && starter) ? createOwner(ownName, starter) : NULL;
+    if (owner == NULL) {
+        releaseName(ownName);
+        freePokemonTree(starter);
+        return POKE_ERR_NO_MEMORY;
+    }
+    rcuWriteLock(reg);
+    if (findOwnerByInterned(reg, ownName) != NULL) {
+        rcuWriteUnlock(reg);
+        freeOwnerNode(owner);
+        return POKE_ERR_OWNER_EXISTS;
+    }
+    linkOwnerInCircularList(reg, owner);
+    rcuWriteUnlock(reg);
+    if (created)
+        *created = owner;
+    return POKE_OK;
+}
+
+OwnerNode *registryOwnerAt(Registry *reg, int position) {
+    if (reg == NULL)
+        return NULL;
+    rcuReadLock();
+    OwnerNode *current = RCU_DEREF(reg->head);
+    if (position < 1 || position > RCU_DEREF(reg->count))
+        current = NULL;
+    for (int i = 1; current != NULL && i < position; i++)
+        current = RCU_DEREF(current->next);
+    rcuReadUnlock();
+    return current;
+}
+
+PokeStatus registryDeleteOwner(Registry *reg, OwnerNode *owner) {
+    if (reg == NULL || owner == NULL)
+        return POKE_ERR_INVALID_ARG;
+    rcuWriteLock(reg);
+    removeOwnerFromCircularList(reg, owner);
+    rcuWriteUnlock(reg);
+    return POKE_OK;
+}
+
+PokeStatus registryMergeOwners(Registry *reg, OwnerNode *into, OwnerNode *from) {
+    if (reg == NULL || into == NULL || from == NULL)
+        return POKE_ERR_INVALID_ARG;
+    if (into == from)
+        return POKE_ERR_SAME_OWNER;
+    rcuWriteLock(reg);
+    recordUndo(reg, into);
+    PokeStatus status = (PokeStatus)mergePokeDex(into, from);
+    // A partial copy keeps the source, so nothing is lost
+    if (status == POKE_OK)
+        removeOwnerFromCircularList(reg, from);
+    treeSettled(reg, into);
+    rcuWriteUnlock(reg);
+    return status;
+}
+
+// Owners are relinked, never copied: handles and OwnerNode pointers held by
+// callers must survive a sort. Readers bound their walks by the count.
+PokeStatus registrySortOwners(Registry *reg) {
+    if (reg == NULL)
+        return POKE_ERR_INVALID_ARG;
+    rcuWriteLock(reg);
+    if (reg->head == NULL || reg->head->next == reg->head) {
+        rcuWriteUnlock(reg);
+        return POKE_ERR_TOO_FEW_OWNERS;
+    }
+    OwnerNode **sorted = (OwnerNode **)countedMalloc(ALLOC_SITE_SORT, sizeof(OwnerNode *) * reg->count);
+    if (sorted == NULL) {
+        rcuWriteUnlock(reg);
+        return POKE_ERR_NO_MEMORY;
+    }
+    int count = 0;
+    OwnerNode *current = reg->head;
+    do {
+        sorted[count++] = current;
+        current = current->next;
+    } while (current != reg->head);
+    qsort(sorted, count, sizeof(OwnerNode *), compareOwnersByName);
+    // Relink the same owners, so pointers callers hold stay valid
+    for (int i = 0; i < count; i++) {
+        RCU_ASSIGN(sorted[i]->next, sorted[(i + 1) % count]);
+        RCU_ASSIGN(sorted[i]->prev, sorted[(i + count - 1) % count]);
+    }
+    RCU_ASSIGN(reg->head, sorted[0]);
+    countedFree(ALLOC_SITE_SORT, sorted);
+    rcuWriteUnlock(reg);
+    return POKE_OK;
+}
+
+PokeStatus pokedexAddPokemon(Registry *reg, OwnerNode *owner, int id, const PokemonData **added) {
+    if (reg == NULL || owner == NULL)
+        return POKE_ERR_INVALID_ARG;
+    const PokemonData *species = findSpecies(id);
+    if (species == NULL)
+        return POKE_ERR_INVALID_ID;
+    rcuWriteLock(reg);
+    if (searchPokemon(owner->pokedexRoot, id)) {
+        rcuWriteUnlock(reg);
+        return POKE_ERR_DUPLICATE;
+    }
+    PokemonNode *newPokemon = createSpeciesNode(species);
+    if (newPokemon == NULL) {
+        rcuWriteUnlock(reg);
+        return POKE_ERR_NO_MEMORY;
+    }
+    recordUndo(reg, owner);
+    int inserted = ownerInsert(owner, newPokemon);
+    treeSettled(reg, owner);
+    rcuWriteUnlock(reg);
+    if (inserted < 0)
+        return POKE_ERR_NO_MEMORY;
+    if (added)
+        *added = species;
+    return POKE_OK;
+}
+
+PokeStatus pokedexReleasePokemon(Registry *reg, OwnerNode *owner, int id, const PokemonData **released) {
+    if (reg == NULL || owner == NULL)
+        return POKE_ERR_INVALID_ARG;
+    PokemonHandle handle;
+    handle.owner = owner;
+    handle.id = id;
+    rcuWriteLock(reg);
+    PokeStatus status = POKE_OK;
+    if (owner->pokedexRoot == NULL)
+        status = POKE_ERR_EMPTY;
+    else if (!handleSeek(&handle))
+        status = POKE_ERR_NOT_FOUND;
+    else
+        status = handleRelease(reg, &handle);
+    treeSettled(reg, owner);
+    rcuWriteUnlock(reg);
+    if (status == POKE_OK && released)
+        *released = handle.species;
+    return status;
+}
+
+PokeStatus pokedexEvolvePokemon(Registry *reg, OwnerNode *owner, int id, EvolveResult *result) {
+    if (reg == NULL || owner == NULL || result == NULL)
+        return POKE_ERR_INVALID_ARG;
+    result->from = findSpecies(id);
+    result->to = NULL;
+    result->alreadyOwned = 0;
+    PokemonHandle handle;
+    handle.owner = owner;
+    handle.id = id;
+    rcuWriteLock(reg);
+    PokeStatus status = POKE_OK;
+    if (owner->pokedexRoot == NULL) {
+        status = POKE_ERR_EMPTY;
+    } else if (!handleSeek(&handle)) {
+        status = POKE_ERR_NOT_FOUND;
+    } else if ((result->to = speciesEvolution(result->from)) == NULL) {
+        status = POKE_ERR_CANNOT_EVOLVE;
+    } else {
+        int next = result->to->id;
+        // The one search already knows the in-order neighbours; only a next
+        // stage outside the gap around id (never id + 1) needs a second one
+        int inGap = next > handle.prevId && (handle.nextId == 0 || next < handle.nextId);
+        result->alreadyOwned = !inGap && (next == handle.prevId || next == handle.nextId
+                                          || searchPokemon(owner->pokedexRoot, next) != NULL);
+        // Already owned: the old form simply goes away. Otherwise it becomes
+        // the next stage, in the same spot when that falls in the gap.
+        status = result->alreadyOwned ? handleRelease(reg, &handle)
+                                       : handleReplace(reg, &handle, next);
+    }
+    treeSettled(reg, owner);
+    rcuWriteUnlock(reg);
+    return status;
+}
+
+PokeStatus pokedexFight(OwnerNode *owner, int firstId, int secondId, FightResult *result) {
+    if (owner == NULL || result == NULL)
+        return POKE_ERR_INVALID_ARG;
+    if (pokedexFindPokemon(owner, firstId, &result->first) != POKE_OK
+        || pokedexFindPokemon(owner, secondId, &result->second) != POKE_OK)
+        return POKE_ERR_NOT_FOUND;
+    result->firstScore = (result->first->attack*1.5)+(result->first->hp*1.2);
+    result->secondScore = (result->second->attack*1.5)+(result->second->hp*1.2);
+    result->winner = result->firstScore > result->secondScore ? 1
+                   : result->firstScore < result->secondScore ? 2 : 0;
+    return POKE_OK;
+}
+
+//--------------- Interned owner names ---------------
+static unsigned long long hashName(const char *text, size_t len) {
+    // FNV-1a
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Comparing these as integers orders names exactly like strcmp on 8 bytes
+static unsigned long long namePrefix(const char *text, size_t len) {
+    unsigned long long prefix = 0;
+    for (size_t i = 0; i < 8; i++)
+        prefix = (prefix << 8) | (i < len ? (unsigned char)text[i] : 0);
+    return prefix;
+}
+
+int nameTableInit(NameTable *table) {
+    table->buckets = (InternedName **)countedMalloc(ALLOC_SITE_NAMES, sizeof(InternedName *) * NAME_TABLE_BUCKETS);
+    if (table->buckets == NULL)
+        return 0;
+    memset(table->buckets, 0, sizeof(InternedName *) * NAME_TABLE_BUCKETS);
+    table->bucketCount = NAME_TABLE_BUCKETS;
+    table->size = 0;
+    pthread_mutex_init(&table->lock, NULL);
+    return 1;
+}
+
+void nameTableFree(NameTable *table) {
+    countedFree(ALLOC_SITE_NAMES, table->buckets);
+    table->buckets = NULL;
+    table->bucketCount = 0;
+    pthread_mutex_destroy(&table->lock);
+}
+
+// Caller holds table->lock
+static InternedName *findName(NameTable *table, const char *text, size_t len, unsigned long long hash) {
+    InternedName *entry = table->buckets[hash & (table->bucketCount - 1)];
+    while (entry && !(entry->hash == hash && entry->len == len && memcmp(entry->text, text, len) == 0))
+        entry = entry->next;
+    return entry;
+}
+
+// Caller holds table->lock. On allocation failure the chains just get longer.
+static void growNameTable(NameTable *table) {
+    size_t newCount = table->bucketCount * 2;
+    InternedName **bigger = (InternedName **)countedMalloc(ALLOC_SITE_NAMES, sizeof(InternedName *) * newCount);
+    if (bigger == NULL)
+        return;
+    memset(bigger, 0, sizeof(InternedName *) * newCount);
+    for (size_t i = 0; i < table->bucketCount; i++) {
+        InternedName *entry = table->buckets[i];
+        while (entry) {
+            InternedName *next = entry->next;
+            size_t slot = entry->hash & (newCount - 1);
+            entry->next = bigger[slot];
+            bigger[slot] = entry;
+            entry = next;
+        }
+    }
+    countedFree(ALLOC_SITE_NAMES, table->buckets);
+    table->buckets = bigger;
+    table->bucketCount = newCount;
+}
+
+InternedName *internName(NameTable *table, const char *text, size_t len) {
+    unsigned long long hash = hashName(text, len);
+    pthread_mutex_lock(&table->lock);
+    InternedName *entry = findName(table, text, len, hash);
+    if (entry) {
+        entry->refs++;
+        pthread_mutex_unlock(&table->lock);
+        return entry;
+    }
+    entry = (InternedName *)countedMalloc(ALLOC_SITE_NAMES, sizeof(InternedName) + len + 1);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&table->lock);
+        return NULL;
+    }
+    memcpy(entry->text, text, len);
+    entry->text[len] = '\0';
+    entry->table = table;
+    entry->hash = hash;
+    entry->prefix = namePrefix(text, len);
+    entry->len = len;
+    entry->refs = 1;
+    entry->owner = NULL;
+    if (table->size >= table->bucketCount)
+        growNameTable(table);
+    size_t slot = hash & (table->bucketCount - 1);
+    entry->next = table->buckets[slot];
+    table->buckets[slot] = entry;
+    table->size++;
+    pthread_mutex_unlock(&table->lock);
+    return entry;
+}
+
+const InternedName *lookupName(NameTable *table, const char *text, size_t len) {
+    unsigned long long hash = hashName(text, len);
+    pthread_mutex_lock(&table->lock);
+    InternedName *entry = findName(table, text, len, hash);
+    pthread_mutex_unlock(&table->lock);
+    return entry;
+}
+
+InternedName *retainName(InternedName *name) {
+    pthread_mutex_lock(&name->table->lock);
+    name->refs++;
+    pthread_mutex_unlock(&name->table->lock);
+    return name;
+}
+
+static void reclaimName(void *name) {
+    countedFree(ALLOC_SITE_NAMES, name);
+}
+
+void releaseName(InternedName *name) {
+    if (name == NULL)
+        return;
+    NameTable *table = name->table;
+    pthread_mutex_lock(&table->lock);
+    if (--name->refs > 0) {
+        pthread_mutex_unlock(&table->lock);
+        return;
+    }
+    InternedName **link = &table->buckets[name->hash & (table->bucketCount - 1)];
+    while (*link != name)
+        link = &(*link)->next;
+    *link = name->next;
+    table->size--;
+    pthread_mutex_unlock(&table->lock);
+    // A reader may have looked it up just before it left the table
+    rcuRetire(name, reclaimName);
+}
+
+int compareInternedNames(const InternedName *a, const InternedName *b) {
+    if (a == b)
+        return 0;
+    if (a->prefix != b->prefix)
+        return a->prefix < b->prefix ? -1 : 1;
+    // Equal prefixes: a name shorter than 8 bytes is then equal to the other
+    if (a->len < 8)
+        return 0;
+    return strcmp(a->text + 8, b->text + 8);
+}
+
+//--------------- Frozen Pokedex ---------------
+// Lay the sorted nodes out in Eytzinger order; returns the next sorted index
+static int fillFrozen(FrozenPokedex *frozen, PokemonNode **sorted, int next, int slot) {
+    if (slot > frozen->count)
+        return next;
+    next = fillFrozen(frozen, sorted, next, 2 * slot);
+    frozen->keys[slot] = sorted[next]->id;
+    frozen->species[slot] = sorted[next]->data;
+    next++;
+    return fillFrozen(frozen, sorted, next, 2 * slot + 1);
+}
+
+static void collectInOrder(PokemonNode *root, NodeArray *na) {
+    if (root == NULL)
+        return;
+    collectInOrder(RCU_DEREF(root->left), na);
+    addNode(na, root);
+    collectInOrder(RCU_DEREF(root->right), na);
+}
+
+FrozenPokedex *freezeTree(PokemonNode *root) {
+    int count = sizeOfBinTree(root);
+    if (count == 0)
+        return NULL;
+    NodeArray na;
+    initNodeArray(&na, count);
+    if (na.nodes == NULL)
+        return NULL;
+    collectInOrder(root, &na);
+    // One block: header, species pointers, then the keys the search walks
+    size_t bytes = sizeof(FrozenPokedex) + (size_t)(na.size + 1) * (sizeof(const PokemonData *) + sizeof(int));
+    FrozenPokedex *frozen = (FrozenPokedex *)countedMalloc(ALLOC_SITE_FROZEN, bytes);
+    if (frozen != NULL) {
+        frozen->count = na.size;
+        frozen->species = (const PokemonData **)(frozen + 1);
+        frozen->keys = (int *)(frozen->species + na.size + 1);
+        frozen->keys[0] = 0;
+        frozen->species[0] = NULL;
+        fillFrozen(frozen, na.nodes, 0, 1);
+    }
+    countedFree(ALLOC_SITE_NODE_ARRAY, na.nodes);
+    return frozen;
+}
+
+void freeFrozen(FrozenPokedex *frozen) {
+    countedFree(ALLOC_SITE_FROZEN, frozen);
+}
+
+const PokemonData *frozenSearch(const FrozenPokedex *frozen, int id) {
+    // Go right while the key is smaller; no data-dependent branch in the loop
+    unsigned long long slot = 1;
+    unsigned long long count = (unsigned long long)frozen->count;
+    while (slot <= count)
+        slot = 2 * slot + (unsigned long long)(frozen->keys[slot] < id);
+    // Undo the trailing right turns and the last left turn: that node is the
+    // smallest key >= id (slot 0 means every key is smaller)
+    slot >>= __builtin_ffsll((long long)~slot);
+    return (slot != 0 && frozen->keys[slot] == id) ? frozen->species[slot] : NULL;
+}
+
+PokeStatus pokedexFreeze(Registry *reg, OwnerNode *owner) {
+    if (reg == NULL || owner == NULL)
+        return POKE_ERR_INVALID_ARG;
+    rcuWriteLock(reg);
+    PokeStatus status = POKE_OK;
+    if (owner->pokedexRoot == NULL) {
+        status = POKE_ERR_EMPTY;
+    } else if (owner->frozen == NULL) {
+        FrozenPokedex *frozen = freezeTree(owner->pokedexRoot);
+        if (frozen == NULL)
+            status = POKE_ERR_NO_MEMORY;
+        else
+            RCU_ASSIGN(owner->frozen, frozen);
+    }
+    rcuWriteUnlock(reg);
+    return status;
+}
+
+PokeStatus pokedexFindPokemon(OwnerNode *owner, int id, const PokemonData **found) {
+    if (owner == NULL)
+        return POKE_ERR_INVALID_ARG;
+    rcuReadLock();
+    const FrozenPokedex *frozen = RCU_DEREF(owner->frozen);
+    const PokemonData *species = NULL;
+    if (frozen != NULL) {
+        species = frozenSearch(frozen, id);
+    } else {
+        PokemonNode *node = searchPokemon(RCU_DEREF(owner->pokedexRoot), id);
+        species = node ? node->data : NULL;
+    }
+    rcuReadUnlock();
+    if (species == NULL)
+        return POKE_ERR_NOT_FOUND;
+    if (found)
+        *found = species;
+    return POKE_OK;
+}
+
+//--------------- Persistent Pokedexes ---------------
+PokemonNode *retainTree(PokemonNode *root) {
+    if (root != NULL)
+        __atomic_add_fetch(&root->refs, 1, __ATOMIC_RELAXED);
+    return root;
+}
+
+// Taken under the writer lock: a writer that just saw a count of 1 is editing
+// that node in place, and the snapshot must not start sharing it halfway
+PokemonNode *pokedexSnapshot(Registry *reg, OwnerNode *owner) {
+    if (reg == NULL || owner == NULL)
+        return NULL;
+    rcuWriteLock(reg);
+    PokemonNode *root = shareRoot(owner);
+    rcuWriteUnlock(reg);
+    return root;
+}
+
+void pokedexSnapshotRelease(PokemonNode *root) {
+    freePokemonTree(root);
+}
+
+PokeStatus registryCloneOwner(Registry *reg, OwnerNode *source, const char *name, OwnerNode **created) {
+    if (reg == NULL || source == NULL || name == NULL)
+        return POKE_ERR_INVALID_ARG;
+    InternedName *ownName = internName(&reg->names, name, strlen(name));
+    OwnerNode *owner = ownName ? createOwner(ownName, NULL) : NULL;
+    if (owner == NULL) {
+        releaseName(ownName);
+        return POKE_ERR_NO_MEMORY;
+    }
+    rcuWriteLock(reg);
+    if (findOwnerByInterned(reg, ownName) != NULL) {
+        rcuWriteUnlock(reg);
+        freeOwnerNode(owner);
+        return POKE_ERR_OWNER_EXISTS;
+    }
+    // The whole tree is shared; either side copies what it changes later
+    owner->pokedexRoot = shareRoot(source);
+    owner->maxDepth = source->maxDepth;
+    memcpy(owner->typeCount, source->typeCount, sizeof(owner->typeCount));
+    summaryPublish(owner);
+    linkOwnerInCircularList(reg, owner);
+    rcuWriteUnlock(reg);
+    if (created)
+        *created = owner;
+    return POKE_OK;
+}
+
+// Caller holds the writer lock. Drops the oldest versions until keep are left.
+static void trimUndo(OwnerNode *owner, int keep) {
+    int excess = owner->undoCount - (keep > 0 ? keep : 0);
+    if (excess <= 0)
+        return;
+    for (int i = 0; i < excess; i++)
+        freePokemonTree(owner->undo[i]);
+    memmove(owner->undo, owner->undo + excess, sizeof(PokemonNode *) * (owner->undoCount - excess));
+    owner->undoCount -= excess;
+}
+
+// Caller holds the writer lock and is about to change the owner's Pokedex
+static void recordUndo(Registry *reg, OwnerNode *owner) {
+    trimUndo(owner, reg->undoDepth - 1);
+    if (reg->undoDepth > 0)
+        owner->undo[owner->undoCount++] = shareRoot(owner);
+}
+
+static void countTypes(const PokemonNode *root, int *typeCount) {
+    for (; root != NULL; root = root->right) {
+        typeCount[root->data->TYPE]++;
+        countTypes(root->left, typeCount);
+    }
+}
+PokeStatus pokedexUndo(Registry *reg, OwnerNode *owner) {
+    if (reg == NULL || owner == NULL)
+        return POKE_ERR_INVALID_ARG;
+    rcuWriteLock(reg);
+    if (owner->undoCount == 0) {
+        rcuWriteUnlock(reg);
+        return POKE_ERR_NOTHING_TO_UNDO;
+    }
+    PokemonNode *current = owner->pokedexRoot;
+    treeChanged(owner);
+    // The history's reference becomes the owner's
+    RCU_ASSIGN(owner->pokedexRoot, owner->undo[--owner->undoCount]);
+    freePokemonTree(current);
+    // The restored tree brings its own aggregates; only the histogram is
+    // rebuilt, O(n) on a command that is rare
+    memset(owner->typeCount, 0, sizeof(owner->typeCount));
+    countTypes(owner->pokedexRoot, owner->typeCount);
+    treeSettled(reg, owner);
+    rcuWriteUnlock(reg);
+    return POKE_OK;
+}
+
+void registrySetUndoDepth(Registry *reg, int depth) {
+    if (reg == NULL)
+        return;
+    if (depth < 0)
+        depth = 0;
+    if (depth > POKEDEX_UNDO_DEPTH)
+        depth = POKEDEX_UNDO_DEPTH;
+    rcuWriteLock(reg);
+    reg->undoDepth = depth;
+    OwnerNode *current = reg->head;
+    for (int i = 0; current != NULL && i < reg->count; i++) {
+        trimUndo(current, depth);
+        current = current->next;
+    }
+    rcuWriteUnlock(reg);
+}
+
+void clonePokedexMenu(Registry *reg) {
+    printOwners(reg);
+    int ownerId = readIntSafe("Choose a Pokedex to clone by number: ");
+    OwnerNode *source = registryOwnerAt(reg, ownerId);
+    if (source == NULL) {
+        printf("Invalid Pokedex number.\n");
+        return;
+    }
+    printf("Name of the new owner: ");
+    InternedName *name = readInternedName(reg);
+    if (name == NULL) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    switch (registryCloneOwner(reg, source, name->text, NULL)) {
+    case POKE_OK:
+        printf("Pokedex of %s cloned for %s.\n", source->ownerName, name->text);
+        break;
+    case POKE_ERR_OWNER_EXISTS:
+        printf(" Owner '%s' already exists. "
+               "Not creating a new Pokedex.\n",name->text);
+        break;
+    default:
+        printf("Memory allocation failed.\n");
+    }
+    releaseName(name);
+}
+
+void undoLastChange(Registry *reg, OwnerNode *owner) {
+    if (pokedexUndo(reg, owner) == POKE_OK)
+        printf("Last change undone.\n");
+    else
+        printf("Nothing to undo.\n");
+}
+
+//--------------- Bulk add & release ---------------
+// Sets owned[id] for every node; IDs outside the catalog are ignored
+static void markOwned(PokemonNode *root, unsigned char *owned) {
+    while (root != NULL) {
+        STAT_ADD(traversalVisits, 1);
+        if (root->id >= 1 && root->id <= catalog.count)
+            owned[root->id] = 1;
+        markOwned(RCU_DEREF(root->left), owned);
+        root = RCU_DEREF(root->right);
+    }
+}
+
+// Marks the wanted IDs; returns how many were not in the species catalog
+static int markWanted(const int *ids, int count, unsigned char *wanted) {
+    int invalid = 0;
+    for (int i = 0; i < count; i++) {
+        if (findSpecies(ids[i]) != NULL)
+            wanted[ids[i]] = 1;
+        else
+            invalid++;
+    }
+    return invalid;
+}
+
+// Room for up to room IDs in each list, in one block that done starts;
+// 0 (and empty lists) if memory ran out
+static int bulkResultInit(BulkResult *result, int room) {
+    result->doneCount = 0;
+    result->skippedCount = 0;
+    result->invalidCount = 0;
+    result->done = (int *)countedMalloc(ALLOC_SITE_BULK, sizeof(int) * 2 * (room > 0 ? room : 1));
+    result->skipped = result->done ? result->done + room : NULL;
+    return result->done != NULL;
+}
+
+void bulkResultFree(BulkResult *result) {
+    if (result == NULL)
+        return;
+    countedFree(ALLOC_SITE_BULK, result->done);
+    result->done = NULL;
+    result->skipped = NULL;
+    result->doneCount = 0;
+    result->skippedCount = 0;
+}
+
+// A balanced tree over sorted[0..count); on failure *ok is cleared and the
+// caller frees whatever was built
+static PokemonNode *buildBalanced(const PokemonData **sorted, int count, int *ok) {
+    if (count <= 0 || !*ok)
+        return NULL;
+    int mid = count / 2;
+    PokemonNode *node = createSpeciesNode(sorted[mid]);
+    if (node == NULL) {
+        *ok = 0;
+        return NULL;
+    }
+    node->left = buildBalanced(sorted, mid, ok);
+    node->right = buildBalanced(sorted + mid + 1, count - mid - 1, ok);
+    pullUp(node);
+    return node;
+}
+
+PokeStatus pokedexAddMany(Registry *reg, OwnerNode *owner, const int *ids, int count, BulkResult *result) {
+    if (result == NULL)
+        return POKE_ERR_INVALID_ARG;
+    result->done = result->skipped = NULL;
+    if (reg == NULL || owner == NULL || count < 0 || (ids == NULL && count > 0))
+        return POKE_ERR_INVALID_ARG;
+    int species = catalog.count;
+    // Wanted and owned flags by ID, then the merged ID order
+    unsigned char *wanted = (unsigned char *)countedMalloc(ALLOC_SITE_BULK, 2 * (size_t)(species + 1));
+    const PokemonData **sorted = (const PokemonData **)countedMalloc(ALLOC_SITE_BULK,
+                                                                     sizeof(PokemonData *) * species);
+    if (!bulkResultInit(result, count < species ? count : species) || wanted == NULL || sorted == NULL) {
+        bulkResultFree(result);
+        countedFree(ALLOC_SITE_BULK, wanted);
+        countedFree(ALLOC_SITE_BULK, sorted);
+        return POKE_ERR_NO_MEMORY;
+    }
+    unsigned char *owned = wanted + species + 1;
+    memset(wanted, 0, 2 * (size_t)(species + 1));
+    result->invalidCount = markWanted(ids, count, wanted);
+
+    rcuWriteLock(reg);
+    markOwned(owner->pokedexRoot, owned);
+    // The species table is in ID order, so one pass merges old and new
+    int total = 0;
+    for (int id = 1; id <= species; id++) {
+        if (wanted[id] && owned[id])
+            result->skipped[result->skippedCount++] = id;
+        else if (wanted[id])
+            result->done[result->doneCount++] = id;
+        if (wanted[id] || owned[id])
+            sorted[total++] = &catalog.species[id - 1];
+    }
+    PokeStatus status = POKE_OK;
+    int ok = 1;
+    PokemonNode *root = result->doneCount > 0 ? buildBalanced(sorted, total, &ok) : NULL;
+    if (!ok) {
+        freePokemonTree(root);
+        bulkResultFree(result);
+        status = POKE_ERR_NO_MEMORY;
+    } else if (result->doneCount > 0) {
+        recordUndo(reg, owner);
+        treeChanged(owner);
+        PokemonNode *old = owner->pokedexRoot;
+        RCU_ASSIGN(owner->pokedexRoot, root);
+        freePokemonTree(old);
+        for (int i = 0; i < result->doneCount; i++)
+            owner->typeCount[catalog.species[result->done[i] - 1].TYPE]++;
+        int height = treeHeight(root);
+        if (height > owner->maxDepth)
+            owner->maxDepth = height;
+        treeSettled(reg, owner);
+    }
+    rcuWriteUnlock(reg);
+    countedFree(ALLOC_SITE_BULK, wanted);
+    countedFree(ALLOC_SITE_BULK, sorted);
+    return status;
+}
+
+// "Label (n): 1-10, 25" with consecutive IDs folded into ranges
+static void printIdRanges(const char *label, const int *ids, int count) {
+    if (count == 0)
+        return;
+    printf("%s (%d): ", label, count);
+    for (int i = 0; i < count; i++) {
+        int first = ids[i];
+        while (i + 1 < count && ids[i + 1] == ids[i] + 1)
+            i++;
+        printf(first == ids[i] ? "%s%d" : "%s%d-%d", first > ids[0] ? ", " : "", first, ids[i]);
+    }
+    printf("\n");
+}
+
+// Prompts for one line and parses it; -1 if it is not a valid list
+static int readIdList(const char *prompt, int *ids, int *outOfRange) {
+    printf("%s", prompt);
+    StrView line = {"", 0};
+    readLineView(&line);
+    return parseIdList(line, ids, BULK_MAX_IDS, outOfRange);
+}
+
+void bulkAddPokemon(Registry *reg, OwnerNode *owner) {
+    int *ids = (int *)countedMalloc(ALLOC_SITE_BULK, sizeof(int) * BULK_MAX_IDS);
+    if (ids == NULL) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    int outOfRange = 0;
+    int count = readIdList("Enter IDs to add (e.g. 1-10, 25): ", ids, &outOfRange);
+    if (count < 0) {
+        countedFree(ALLOC_SITE_BULK, ids);
+        printf("Invalid ID list.\n");
+        return;
+    }
+    BulkResult result;
+    PokeStatus status = pokedexAddMany(reg, owner, ids, count, &result);
+    countedFree(ALLOC_SITE_BULK, ids);
+    if (status != POKE_OK) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    printIdRanges("Added", result.done, result.doneCount);
+    printIdRanges("Already in the Pokedex", result.skipped, result.skippedCount);
+    if (result.invalidCount + outOfRange > 0)
+        printf("Ignored %d invalid IDs.\n", result.invalidCount + outOfRange);
+    if (result.doneCount + result.skippedCount == 0)
+        printf("No Pokemon added.\n");
+    bulkResultFree(&result);
+}
+
+// Takes over the caller's reference to node and returns a node with the same
+// contents that only the caller holds: node itself, or a copy if it is
+// shared. NULL if memory ran out (the reference is dropped then).
+static PokemonNode *ownNode(PokemonNode *node) {
+    if (__atomic_load_n(&node->refs, __ATOMIC_ACQUIRE) == 1)
+        return node;
+    PokemonNode *copy = createSpeciesNode(node->data);
+    if (copy != NULL) {
+        copy->id = node->id;
+        copy->left = retainTree(node->left);
+        copy->right = retainTree(node->right);
+        pullUp(copy);
+        STAT_ADD(pathCopies, 1);
+    }
+    freePokemonTree(node);
+    return copy;
+}
+
+// Consumes the reference to root. *less receives the IDs below key and *rest
+// the others; only nodes on the split path are copied or relinked. Returns 0
+// with both halves NULL if memory ran out.
+static int splitTree(PokemonNode *root, int key, PokemonNode **less, PokemonNode **rest) {
+    *less = NULL;
+    *rest = NULL;
+    if (root == NULL)
+        return 1;
+    PokemonNode *node = ownNode(root);
+    if (node == NULL)
+        return 0;
+    STAT_ADD(removeVisits, 1);
+    PokemonNode *low, *high;
+    if (node->id < key) {
+        int ok = splitTree(node->right, key, &low, &high);
+        node->right = low;
+        if (!ok) {
+            freePokemonTree(node);
+            return 0;
+        }
+        pullUp(node);
+        *less = node;
+        *rest = high;
+    } else {
+        int ok = splitTree(node->left, key, &low, &high);
+        node->left = high;
+        if (!ok) {
+            freePokemonTree(node);
+            return 0;
+        }
+        pullUp(node);
+        *less = low;
+        *rest = node;
+    }
+    return 1;
+}
+
+// Consumes both trees; every ID in less is below every ID in rest. The
+// smallest node of rest becomes the root. NULL with *ok cleared if memory
+// ran out.
+static PokemonNode *joinTrees(PokemonNode *less, PokemonNode *rest, int *ok) {
+    if (less == NULL)
+        return rest;
+    if (rest == NULL)
+        return less;
+    PokemonNode **link = &rest;
+    PokemonNode *node;
+    int depth = 0;
+    for (;;) {
+        node = ownNode(*link);
+        *link = node;
+        if (node == NULL) {
+            freePokemonTree(rest);
+            freePokemonTree(less);
+            *ok = 0;
+            return NULL;
+        }
+        if (node->left == NULL)
+            break;
+        depth++;
+        link = &node->left;
+    }
+    *link = node->right;
+    pullUpLeftSpine(rest, depth);
+    node->left = less;
+    node->right = rest;
+    pullUp(node);
+    return node;
+}
+
+PokeStatus pokedexReleaseMany(Registry *reg, OwnerNode *owner, const int *ids, int count, BulkResult *result) {
+    if (result == NULL)
+        return POKE_ERR_INVALID_ARG;
+    result->done = result->skipped = NULL;
+    if (reg == NULL || owner == NULL || count < 0 || (ids == NULL && count > 0))
+        return POKE_ERR_INVALID_ARG;
+    int species = catalog.count;
+    // Wanted and removed flags by ID
+    unsigned char *wanted = (unsigned char *)countedMalloc(ALLOC_SITE_BULK, 2 * (size_t)(species + 1));
+    if (!bulkResultInit(result, count < species ? count : species) || wanted == NULL) {
+        bulkResultFree(result);
+        countedFree(ALLOC_SITE_BULK, wanted);
+        return POKE_ERR_NO_MEMORY;
+    }
+    unsigned char *removed = wanted + species + 1;
+    memset(wanted, 0, 2 * (size_t)(species + 1));
+    result->invalidCount = markWanted(ids, count, wanted);
+
+    rcuWriteLock(reg);
+    // The new version is built beside the published one, which stays intact
+    PokemonNode *work = retainTree(owner->pokedexRoot);
+    int ok = 1;
+    for (int id = 1; id <= species && ok; id++) {
+        if (!wanted[id])
+            continue;
+        int last = id;
+        while (last < species && wanted[last + 1])
+            last++;
+        // Cut [id, last] out: work = less | middle | rest
+        PokemonNode *less, *middle, *rest;
+        if (!splitTree(work, id, &less, &rest)) {
+            ok = 0;
+        } else if (!splitTree(rest, last + 1, &middle, &rest)) {
+            freePokemonTree(less);
+            ok = 0;
+        } else {
+            markOwned(middle, removed);
+            freePokemonTree(middle);
+            work = joinTrees(less, rest, &ok);
+        }
+        id = last;
+    }
+    if (!ok) {
+        rcuWriteUnlock(reg);
+        bulkResultFree(result);
+        countedFree(ALLOC_SITE_BULK, wanted);
+        return POKE_ERR_NO_MEMORY;
+    }
+    for (int id = 1; id <= species; id++) {
+        if (wanted[id] && removed[id])
+            result->done[result->doneCount++] = id;
+        else if (wanted[id])
+            result->skipped[result->skippedCount++] = id;
+    }
+    countedFree(ALLOC_SITE_BULK, wanted);
+    if (result->doneCount == 0) {
+        // Nothing matched: keep the published tree and its sharing as they are
+        rcuWriteUnlock(reg);
+        freePokemonTree(work);
+        return POKE_OK;
+    }
+    recordUndo(reg, owner);
+    treeChanged(owner);
+    PokemonNode *old = owner->pokedexRoot;
+    RCU_ASSIGN(owner->pokedexRoot, work);
+    freePokemonTree(old);
+    for (int i = 0; i < result->doneCount; i++)
+        owner->typeCount[catalog.species[result->done[i] - 1].TYPE]--;
+    treeSettled(reg, owner);
+    rcuWriteUnlock(reg);
+    return POKE_OK;
+}
+
+void bulkReleasePokemon(Registry *reg, OwnerNode *owner) {
+    if (owner->pokedexRoot == NULL) {
+        printf(" No Pokemon to release.\n");
+        return;
+    }
+    int *ids = (int *)countedMalloc(ALLOC_SITE_BULK, sizeof(int) * BULK_MAX_IDS);
+    if (ids == NULL) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    int outOfRange = 0;
+    int count = readIdList("Enter IDs to release (e.g. 1-10, 25): ", ids, &outOfRange);
+    if (count < 0) {
+        countedFree(ALLOC_SITE_BULK, ids);
+        printf("Invalid ID list.\n");
+        return;
+    }
+    BulkResult result;
+    PokeStatus status = pokedexReleaseMany(reg, owner, ids, count, &result);
+    countedFree(ALLOC_SITE_BULK, ids);
+    if (status != POKE_OK) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    printIdRanges("Released", result.done, result.doneCount);
+    printIdRanges("Not found", result.skipped, result.skippedCount);
+    if (result.invalidCount + outOfRange > 0)
+        printf("Ignored %d invalid IDs.\n", result.invalidCount + outOfRange);
+    if (result.doneCount + result.skippedCount == 0)
+        printf("No Pokemon released.\n");
+    bulkResultFree(&result);
+}
+
+//--------------- Pokemon handles ---------------
+PokeStatus pokedexFindHandle(Registry *reg, OwnerNode *owner, int id, PokemonHandle *handle) {
+    if (reg == NULL || owner == NULL || handle == NULL)
+        return POKE_ERR_INVALID_ARG;
+    handle->owner = owner;
+    handle->id = id;
+    handle->species = NULL;
+    rcuWriteLock(reg);
+    handle->serial = owner->serial;
+    handle->ownersRemoved = reg->ownersRemoved;
+    PokeStatus status = POKE_OK;
+    if (owner->pokedexRoot == NULL)
+        status = POKE_ERR_EMPTY;
+    else if (!handleSeek(handle))
+        status = POKE_ERR_NOT_FOUND;
+    rcuWriteUnlock(reg);
+    return status;
+}
+
+PokeStatus pokedexReleaseHandle(Registry *reg, PokemonHandle *handle, const PokemonData **released) {
+    if (reg == NULL || handle == NULL || handle->owner == NULL)
+        return POKE_ERR_INVALID_ARG;
+    rcuWriteLock(reg);
+    PokeStatus status = POKE_ERR_NOT_FOUND;
+    if (handleRefresh(reg, handle)) {
+        status = handleRelease(reg, handle);
+        treeSettled(reg, handle->owner);
+    }
+    rcuWriteUnlock(reg);
+    if (status == POKE_OK && released)
+        *released = handle->species;
+    return status;
+}
+
+PokeStatus pokedexReplaceHandle(Registry *reg, PokemonHandle *handle, int newId) {
+    if (reg == NULL || handle == NULL || handle->owner == NULL)
+        return POKE_ERR_INVALID_ARG;
+    if (findSpecies(newId) == NULL)
+        return POKE_ERR_INVALID_ID;
+    rcuWriteLock(reg);
+    PokeStatus status = POKE_OK;
+    if (!handleRefresh(reg, handle)) {
+        rcuWriteUnlock(reg);
+        return POKE_ERR_NOT_FOUND;
+    }
+    if (newId == handle->id)
+        status = POKE_OK;
+    else if (newId == handle->prevId || newId == handle->nextId
+             || searchPokemon(handle->owner->pokedexRoot, newId) != NULL)
+        status = POKE_ERR_DUPLICATE;
+    else
+        status = handleReplace(reg, handle, newId);
+    treeSettled(reg, handle->owner);
+    rcuWriteUnlock(reg);
+    return status;
+}
+
+//--------------- Pokedex aggregates ---------------
+PokeStatus pokedexSummary(Registry *reg, OwnerNode *owner, PokedexSummary *summary) {
+    if (reg == NULL || owner == NULL || summary == NULL)
+        return POKE_ERR_INVALID_ARG;
+    rcuReadLock();
+    const PokedexSummary *published = RCU_DEREF(owner->summary);
+    if (published != NULL)
+        *summary = *published;
+    rcuReadUnlock();
+    if (published != NULL)
+        return POKE_OK;
+    // Memory ran out at the last change; the writer lock keeps the totals and
+    // the histogram matching each other
+    rcuWriteLock(reg);
+    summaryFill(owner, summary);
+    rcuWriteUnlock(reg);
+    return POKE_OK;
+}
+
+//--------------- Power leaderboard queries ---------------
+static void fillRankEntry(LeaderboardEntry *entry, const RankNode *node, int rank) {
+    entry->owner = node->owner;
+    entry->rank = rank;
+    entry->power = node->power;
+    entry->count = node->count;
+}
+PokeStatus registryLeaderboard(Registry *reg, int first, int max, LeaderboardEntry *entries, int *count) {
+    if (reg == NULL || first < 1 || max < 0 || (entries == NULL && max > 0) || count == NULL)
+        return POKE_ERR_INVALID_ARG;
+    *count = 0;
+    // Owners leave the board before they are retired, so the read section
+    // keeps every entry's owner alive while the lock keeps the links still
+    Leaderboard *board = &reg->ranking;
+    rcuReadLock();
+    pthread_rwlock_rdlock(&board->lock);
+    // Descend to rank first - 1 using the spans, then walk the bottom level
+    RankNode *node = board->head;
+    int rank = 0;
+    for (int i = board->level - 1; i >= 0; i--) {
+        while (node->links[i].next != NULL && rank + node->links[i].span < first) {
+            rank += node->links[i].span;
+            node = node->links[i].next;
+        }
+    }
+    for (node = node->links[0].next; node != NULL && *count < max; node = node->links[0].next)
+        fillRankEntry(&entries[(*count)++], node, ++rank);
+    pthread_rwlock_unlock(&board->lock);
+    rcuReadUnlock();
+    return POKE_OK;
+}
+PokeStatus registryOwnerRank(Registry *reg, OwnerNode *owner, LeaderboardEntry *entry) {
+    if (reg == NULL || owner == NULL || entry == NULL)
+        return POKE_ERR_INVALID_ARG;
+    rcuReadLock();
+    pthread_rwlock_rdlock(&reg->ranking.lock);
+    RankNode *node = owner->rank;
+    PokeStatus status = POKE_ERR_INVALID_ARG;
+    if (node != NULL && node->ranked) {
+        RankNode *update[LEADERBOARD_MAX_LEVEL];
+        int passed[LEADERBOARD_MAX_LEVEL];
+        rankingSeek(&reg->ranking, node->power, owner->name, update, passed);
+        fillRankEntry(entry, node, passed[0] + 1);
+        status = POKE_OK;
+    }
+    pthread_rwlock_unlock(&reg->ranking.lock);
+    rcuReadUnlock();
+    return status;
+}
+void leaderboardMenu(Registry *reg) {
+    LeaderboardEntry top[10];
+    int count = 0;
+    if (registryLeaderboard(reg, 1, 10, top, &count) != POKE_OK)
+        return;
+    for (int i = 0; i < count; i++)
+        printf("%d. %s - power %lld.%lld (%d Pokemon)\n", top[i].rank, top[i].owner->ownerName,
+               top[i].power / 10, top[i].power % 10, top[i].count);
+}
+
+//--------------- Battle simulator ---------------
+// Multiplier times two (0 immune, 1 not very effective, 2 neutral, 4 super
+// effective). Rows attack, columns defend, both in PokemonType order.
+static const unsigned char typeChart[POKEMON_TYPE_COUNT][POKEMON_TYPE_COUNT] = {
+    //            GRA FIR WAT BUG NOR POI ELE GRO FAI FIG PSY ROC GHO DRA ICE
+    /* GRASS    */ {1, 1, 4, 1, 2, 1, 2, 4, 2, 2, 2, 4, 2, 1, 2},
+    /* FIRE     */ {4, 1, 1, 4, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 4},
+    /* WATER    */ {1, 4, 1, 2, 2, 2, 2, 4, 2, 2, 2, 4, 2, 1, 2},
+    /* BUG      */ {4, 1, 2, 2, 2, 1, 2, 2, 1, 1, 4, 2, 1, 2, 2},
+    /* NORMAL   */ {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 0, 2, 2},
+    /* POISON   */ {4, 2, 2, 2, 2, 1, 2, 1, 4, 2, 2, 1, 1, 2, 2},
+    /* ELECTRIC */ {1, 2, 4, 2, 2, 2, 1, 0, 2, 2, 2, 2, 2, 1, 2},
+    /* GROUND   */ {1, 4, 2, 1, 2, 4, 4, 2, 2, 2, 2, 4, 2, 2, 2},
+    /* FAIRY    */ {2, 1, 2, 2, 2, 1, 2, 2, 2, 4, 2, 2, 2, 4, 2},
+    /* FIGHTING */ {2, 2, 2, 1, 4, 1, 2, 2, 1, 2, 1, 4, 0, 2, 4},
+    /* PSYCHIC  */ {2, 2, 2, 2, 2, 4, 2, 2, 2, 4, 1, 2, 2, 2, 2},
+    /* ROCK     */ {2, 4, 2, 4, 2, 2, 2, 1, 2, 1, 2, 2, 2, 2, 4},
+    /* GHOST    */ {2, 2, 2, 2, 0, 2, 2, 2, 2, 2, 4, 2, 4, 2, 2},
+    /* DRAGON   */ {2, 2, 2, 2, 2, 2, 2, 2, 0, 2, 2, 2, 2, 4, 2},
+    /* ICE      */ {4, 1, 1, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 4, 1}};
+
+double typeEffectiveness(PokemonType attacker, PokemonType defender) {
+    if (attacker < 0 || attacker >= POKEMON_TYPE_COUNT || defender < 0 || defender >= POKEMON_TYPE_COUNT)
+        return 1.0;
+    return typeChart[attacker][defender] / 2.0;
+}
+
+typedef struct
+{
+    int firstHp;
+    int secondHp;
+    int firstPower;             // attack times the doubled multiplier
+    int secondPower;
+    long long battles;
+    unsigned long long seed;
+    int chunkCount;
+    int nextChunk;              // claimed with an atomic add, so fast workers take more
+    long long firstWins;        // totals, added once per worker
+    long long secondWins;
+    long long rounds;
+} BattleJob;
+
+static unsigned long long mixSeed(unsigned long long x) {
+    // splitmix64 finalizer
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Damage of one hit from a 32-bit draw: bits 0..7 pick the roll, 8..11 a
+// critical. At least 1 unless immune. Flags are multiplied in, not branched on.
+static inline int hitDamage(int power, unsigned int draw) {
+    int roll = 217 + (int)(((draw & 255) * 39) >> 8);
+    int crit = (draw & 0xf00) == 0;
+    int damage = (power * roll * (1 + crit)) >> 11;
+    return damage | ((damage == 0) & (power != 0));
+}
+
+// Fights `count` battles BATTLE_LANES at a time. Every loop over the lanes is
+// free of branches so it vectorizes; finished lanes just stop changing.
+static void fightChunk(const BattleJob *job, unsigned long long seed, int count,
+                       long long *firstWins, long long *secondWins, long long *rounds) {
+    unsigned int state[BATTLE_LANES];
+    for (int done = 0; done < count; done += BATTLE_LANES) {
+        int hp1[BATTLE_LANES], hp2[BATTLE_LANES], fought[BATTLE_LANES];
+        for (int l = 0; l < BATTLE_LANES; l++) {
+            // xorshift32 needs a nonzero state
+            state[l] = (unsigned int)mixSeed(seed + (unsigned long long)(done + l)) | 1u;
+            int used = done + l < count;
+            hp1[l] = used ? job->firstHp : 0;
+            hp2[l] = used ? job->secondHp : 0;
+            fought[l] = 0;
+        }
+        for (int round = 0; round < BATTLE_MAX_ROUNDS; round++) {
+            int anyLive = 0;
+            for (int l = 0; l < BATTLE_LANES; l++) {
+                unsigned int x = state[l];
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                state[l] = x;
+                int live = (hp1[l] > 0) & (hp2[l] > 0);
+                int firstStrikes = (int)(x >> 31);
+                int d1 = hitDamage(job->firstPower, x) * live;
+                int d2 = hitDamage(job->secondPower, x >> 12) * live;
+                // The side that strikes second only answers if it still stands
+                int h2 = hp2[l] - d1 * firstStrikes;
+                int h1 = hp1[l] - d2 * ((1 - firstStrikes) | (h2 > 0));
+                h2 -= d1 * ((1 - firstStrikes) & (h1 > 0));
+                hp1[l] = h1;
+                hp2[l] = h2;
+                fought[l] += live;
+                anyLive |= (h1 > 0) & (h2 > 0);
+            }
+            if (!anyLive)
+                break;
+        }
+        for (int l = 0; l < BATTLE_LANES && done + l < count; l++) {
+            *firstWins += hp2[l] <= 0;
+            *secondWins += hp1[l] <= 0;
+            *rounds += fought[l];
+        }
+    }
+}
+
+static void *battleWorker(void *arg) {
+    BattleJob *job = (BattleJob *)arg;
+    long long firstWins = 0, secondWins = 0, rounds = 0;
+    for (;;) {
+        int chunk = __atomic_fetch_add(&job->nextChunk, 1, __ATOMIC_RELAXED);
+        if (chunk >= job->chunkCount)
+            break;
+        long long first = (long long)chunk * BATTLE_CHUNK;
+        long long left = job->battles - first;
+        int count = left < BATTLE_CHUNK ? (int)left : BATTLE_CHUNK;
+        // Seeded by chunk, not by worker, so the thread count never shows
+        fightChunk(job, mixSeed(job->seed ^ mixSeed((unsigned long long)chunk)), count,
+                   &firstWins, &secondWins, &rounds);
+    }
+    __atomic_fetch_add(&job->firstWins, firstWins, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&job->secondWins, secondWins, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&job->rounds, rounds, __ATOMIC_RELAXED);
+    perfFlushThread();
+    rcuThreadOffline();
+    return NULL;
+}
+
+PokeStatus simulateBattles(const PokemonData *first, const PokemonData *second, long long battles,
+                           unsigned long long seed, int threads, BattleStats *stats) {
+    if (first == NULL || second == NULL || stats == NULL || battles <= 0
+        || battles > (long long)INT_MAX * BATTLE_CHUNK)
+        return POKE_ERR_INVALID_ARG;
+    BattleJob job;
+    job.firstHp = first->hp;
+    job.secondHp = second->hp;
+    job.firstPower = first->attack * typeChart[first->TYPE][second->TYPE];
+    job.secondPower = second->attack * typeChart[second->TYPE][first->TYPE];
+    job.battles = battles;
+    job.seed = seed;
+    job.chunkCount = (int)((battles + BATTLE_CHUNK - 1) / BATTLE_CHUNK);
+    job.nextChunk = 0;
+    job.firstWins = 0;
+    job.secondWins = 0;
+    job.rounds = 0;
+
+    if (threads <= 0)
+        threads = workerThreadCount();
+    if (threads > job.chunkCount)
+        threads = job.chunkCount;
+    pthread_t *workers = (pthread_t *)countedMalloc(ALLOC_SITE_BATTLE, sizeof(pthread_t) * threads);
+    if (workers == NULL)
+        return POKE_ERR_NO_MEMORY;
+    int started = 0;
+    // The calling thread is worker number 0
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, battleWorker, &job) != 0)
+            break;
+        started++;
+    }
+    battleWorker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+    countedFree(ALLOC_SITE_BATTLE, workers);
+
+    stats->first = first;
+    stats->second = second;
+    stats->battles = battles;
+    stats->firstWins = job.firstWins;
+    stats->secondWins = job.secondWins;
+    stats->draws = battles - job.firstWins - job.secondWins;
+    stats->firstWinRate = (double)job.firstWins / (double)battles;
+    stats->secondWinRate = (double)job.secondWins / (double)battles;
+    stats->averageRounds = (double)job.rounds / (double)battles;
+    return POKE_OK;
+}
+
+PokeStatus pokedexSimulateBattles(OwnerNode *owner, int firstId, int secondId, long long battles,
+                                  unsigned long long seed, int threads, BattleStats *stats) {
+    if (owner == NULL || stats == NULL)
+        return POKE_ERR_INVALID_ARG;
+    const PokemonData *first, *second;
+    if (pokedexFindPokemon(owner, firstId, &first) != POKE_OK
+        || pokedexFindPokemon(owner, secondId, &second) != POKE_OK)
+        return POKE_ERR_NOT_FOUND;
+    // Species records are static, so the battles need no read section
+    return simulateBattles(first, second, battles, seed, threads, stats);
+}
+
+void simulateBattlesMenu(OwnerNode *owner) {
+    int firstId = readIntSafe("Enter ID of the first Pokemon: ");
+    int secondId = readIntSafe("Enter ID of the second Pokemon: ");
+    int battles = readIntSafe("Number of battles: ");
+    BattleStats stats;
+    // A fixed seed: the same question always gets the same answer
+    switch (pokedexSimulateBattles(owner, firstId, secondId, battles, 1, 0, &stats)) {
+    case POKE_OK:
+        printf("%s vs %s over %lld battles:\n", stats.first->name, stats.second->name, stats.battles);
+        printf("%s wins %.2f%%, %s wins %.2f%%, draws %.2f%% (%.1f rounds on average)\n",
+               stats.first->name, 100.0 * stats.firstWinRate, stats.second->name,
+               100.0 * stats.secondWinRate, 100.0 * stats.draws / stats.battles, stats.averageRounds);
+        break;
+    case POKE_ERR_NOT_FOUND:
+        printf("One or both Pokemon IDs not found.\n");
+        break;
+    case POKE_ERR_INVALID_ARG:
+        printf("Invalid number of battles.\n");
+        break;
+    default:
+        printf("Memory allocation failed.\n");
+    }
+}
+
+//--------------- Team matchup ---------------
+static int nodeSize(const PokemonNode *node) {
+    return node ? node->size : 0;
+}
+
+typedef struct
+{
+    int score;                  // Fight score times ten
+    const PokemonData *species;
+} TeamMember;
+
+// In-order, so members come out in ID order; at most room of them. Returns
+// the new count.
+static int fillTeam(const PokemonNode *node, TeamMember *team, int count, int room) {
+    while (node != NULL && count < room) {
+        count = fillTeam(node->left, team, count, room);
+        if (count < room) {
+            team[count].score = fightScore(node->data);
+            team[count].species = node->data;
+            count++;
+        }
+        node = node->right;
+    }
+    return count;
+}
+
+static int compareMembersByScore(const void *a, const void *b) {
+    const TeamMember *x = (const TeamMember *)a;
+    const TeamMember *y = (const TeamMember *)b;
+    if (x->score != y->score)
+        return x->score < y->score ? -1 : 1;
+    return x->species->id - y->species->id;
+}
+
+static int compareBoutsById(const void *a, const void *b) {
+    return ((const MatchupBout *)a)->mine->id - ((const MatchupBout *)b)->mine->id;
+}
+
+static void addBout(MatchupResult *result, const TeamMember *mine, const TeamMember *theirs) {
+    MatchupBout *bout = &result->bouts[result->boutCount++];
+    bout->mine = mine->species;
+    bout->theirs = theirs->species;
+    bout->outcome = (mine->score > theirs->score) - (mine->score < theirs->score);
+}
+
+// Both teams sorted by score. Only the first side's strongest k and the second
+// side's weakest k can matter, so the lineup is played between those.
+static void matchupGreedy(const TeamMember *mine, int mineCount, const TeamMember *theirs, int theirCount,
+                          MatchupResult *result) {
+    int k = mineCount < theirCount ? mineCount : theirCount;
+    int lo = mineCount - k, hi = mineCount - 1;
+    int theirLo = 0, theirHi = k - 1;
+    while (lo <= hi) {
+        if (mine[hi].score > theirs[theirHi].score) {
+            // Our best beats their best
+            addBout(result, &mine[hi--], &theirs[theirHi--]);
+        } else if (mine[hi].score < theirs[theirHi].score) {
+            // Nothing of ours beats their best: spend our weakest on it
+            addBout(result, &mine[lo++], &theirs[theirHi--]);
+        } else if (mine[lo].score > theirs[theirLo].score) {
+            // Best against best would tie; take the sure win at the bottom
+            addBout(result, &mine[lo++], &theirs[theirLo++]);
+        } else {
+            addBout(result, &mine[lo++], &theirs[theirHi--]);
+        }
+    }
+}
+
+// Hungarian algorithm (potentials form) on rows x cols with rows <= cols; the
+// cost of a cell is 2 - points of the row against the column, computed from
+// the score arrays on the fly. Leaves in match[j] the row given column j
+// (0 for none), rows and columns counted from 1. Returns 0 if memory ran out.
+static int hungarian(const int *rowScore, int rows, const int *colScore, int cols, int *match) {
+    // u by row, then v, way and minv by column, in one block
+    int *u = (int *)countedMalloc(ALLOC_SITE_MATCHUP, sizeof(int) * ((rows + 1) + 3 * (size_t)(cols + 1)));
+    unsigned char *used = (unsigned char *)countedMalloc(ALLOC_SITE_MATCHUP, cols + 1);
+    if (u == NULL || used == NULL) {
+        countedFree(ALLOC_SITE_MATCHUP, u);
+        countedFree(ALLOC_SITE_MATCHUP, used);
+        return 0;
+    }
+    int *v = u + rows + 1, *way = v + cols + 1, *minv = way + cols + 1;
+    memset(u, 0, sizeof(int) * (rows + 1));
+    memset(v, 0, sizeof(int) * (cols + 1));
+    for (int j = 0; j <= cols; j++)
+        match[j] = 0;
+    for (int i = 1; i <= rows; i++) {
+        match[0] = i;
+        int j0 = 0;
+        for (int j = 0; j <= cols; j++) {
+            minv[j] = INT_MAX;
+            used[j] = 0;
+        }
+        do {
+            used[j0] = 1;
+            int i0 = match[j0], delta = INT_MAX, j1 = 0;
+            int score = rowScore[i0 - 1], base = u[i0];
+            for (int j = 1; j <= cols; j++) {
+                if (used[j])
+                    continue;
+                int cost = 1 - (score > colScore[j - 1]) + (score < colScore[j - 1]);
+                int reduced = cost - base - v[j];
+                if (reduced < minv[j]) {
+                    minv[j] = reduced;
+                    way[j] = j0;
+                }
+                if (minv[j] < delta) {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+            for (int j = 0; j <= cols; j++) {
+                if (used[j]) {
+                    u[match[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (match[j0] != 0);
+        do {
+            int j1 = way[j0];
+            match[j0] = match[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+    countedFree(ALLOC_SITE_MATCHUP, u);
+    countedFree(ALLOC_SITE_MATCHUP, used);
+    return 1;
+}
+
+// Returns 0 if memory ran out
+static int matchupExact(const TeamMember *mine, int mineCount, const TeamMember *theirs, int theirCount,
+                        MatchupResult *result) {
+    int rowsAreMine = mineCount <= theirCount;
+    const TeamMember *rowTeam = rowsAreMine ? mine : theirs;
+    const TeamMember *colTeam = rowsAreMine ? theirs : mine;
+    int rows = rowsAreMine ? mineCount : theirCount;
+    int cols = rowsAreMine ? theirCount : mineCount;
+    // match by column, then the row and column scores, in one block
+    int *match = (int *)countedMalloc(ALLOC_SITE_MATCHUP, sizeof(int) * ((size_t)rows + 2 * (size_t)cols + 1));
+    if (match == NULL)
+        return 0;
+    int *rowScore = match + cols + 1, *colScore = rowScore + rows;
+    // The solver scores rows against columns; when the rows are the opponent,
+    // negating every score turns its wins into ours
+    int sign = rowsAreMine ? 1 : -1;
+    for (int i = 0; i < rows; i++)
+        rowScore[i] = sign * rowTeam[i].score;
+    for (int j = 0; j < cols; j++)
+        colScore[j] = sign * colTeam[j].score;
+    int ok = hungarian(rowScore, rows, colScore, cols, match);
+    for (int j = 1; ok && j <= cols; j++) {
+        if (match[j] == 0)
+            continue;
+        const TeamMember *row = &rowTeam[match[j] - 1];
+        const TeamMember *col = &colTeam[j - 1];
+        addBout(result, rowsAreMine ? row : col, rowsAreMine ? col : row);
+    }
+    countedFree(ALLOC_SITE_MATCHUP, match);
+    return ok;
+}
+
+PokeStatus pokedexTeamMatchup(Registry *reg, OwnerNode *mine, OwnerNode *theirs, MatchupMethod method,
+                              MatchupResult *result) {
+    if (result == NULL)
+        return POKE_ERR_INVALID_ARG;
+    result->bouts = NULL;
+    result->boutCount = 0;
+    result->wins = result->ties = result->losses = 0;
+    if (reg == NULL || mine == NULL || theirs == NULL || (method != MATCHUP_GREEDY && method != MATCHUP_EXACT))
+        return POKE_ERR_INVALID_ARG;
+    if (mine == theirs)
+        return POKE_ERR_SAME_OWNER;
+    // Both snapshots under one lock: the two sides as of the same moment
+    rcuWriteLock(reg);
+    PokemonNode *mineRoot = shareRoot(mine);
+    PokemonNode *theirRoot = shareRoot(theirs);
+    rcuWriteUnlock(reg);
+    int mineSize = nodeSize(mineRoot), theirSize = nodeSize(theirRoot);
+    if (mineSize == 0 || theirSize == 0) {
+        pokedexSnapshotRelease(mineRoot);
+        pokedexSnapshotRelease(theirRoot);
+        return POKE_ERR_EMPTY;
+    }
+    TeamMember *mineTeam = (TeamMember *)countedMalloc(ALLOC_SITE_MATCHUP,
+                                                       sizeof(TeamMember) * ((size_t)mineSize + theirSize));
+    result->bouts = (MatchupBout *)countedMalloc(ALLOC_SITE_MATCHUP,
+                                                 sizeof(MatchupBout) * (mineSize < theirSize ? mineSize : theirSize));
+    if (mineTeam == NULL || result->bouts == NULL) {
+        pokedexSnapshotRelease(mineRoot);
+        pokedexSnapshotRelease(theirRoot);
+        countedFree(ALLOC_SITE_MATCHUP, mineTeam);
+        matchupResultFree(result);
+        return POKE_ERR_NO_MEMORY;
+    }
+    TeamMember *theirTeam = mineTeam + mineSize;
+    int mineCount = fillTeam(mineRoot, mineTeam, 0, mineSize);
+    int theirCount = fillTeam(theirRoot, theirTeam, 0, theirSize);
+    pokedexSnapshotRelease(mineRoot);
+    pokedexSnapshotRelease(theirRoot);
+
+    int ok = 1;
+    if (method == MATCHUP_GREEDY) {
+        qsort(mineTeam, mineCount, sizeof(TeamMember), compareMembersByScore);
+        qsort(theirTeam, theirCount, sizeof(TeamMember), compareMembersByScore);
+        matchupGreedy(mineTeam, mineCount, theirTeam, theirCount, result);
+    } else {
+        ok = matchupExact(mineTeam, mineCount, theirTeam, theirCount, result);
+    }
+    countedFree(ALLOC_SITE_MATCHUP, mineTeam);
+    if (!ok) {
+        matchupResultFree(result);
+        return POKE_ERR_NO_MEMORY;
+    }
+    qsort(result->bouts, result->boutCount, sizeof(MatchupBout), compareBoutsById);
+    for (int i = 0; i < result->boutCount; i++) {
+        result->wins += result->bouts[i].outcome > 0;
+        result->ties += result->bouts[i].outcome == 0;
+        result->losses += result->bouts[i].outcome < 0;
+    }
+    return POKE_OK;
+}
+
+void matchupResultFree(MatchupResult *result) {
+    if (result == NULL)
+        return;
+    countedFree(ALLOC_SITE_MATCHUP, result->bouts);
+    result->bouts = NULL;
+    result->boutCount = 0;
+}
+
+void teamMatchupMenu(Registry *reg) {
+    if(reg->head->next == reg->head) {
+        printf("Not enough owners for a matchup.\n");
+        return;
+    }
+    printf("Enter name of your owner: ");
+    InternedName *mineName = readInternedName(reg);
+    printf("Enter name of the opponent: ");
+    InternedName *theirName = readInternedName(reg);
+    if (mineName == NULL || theirName == NULL) {
+        printf("Memory allocation failed.\n");
+        releaseName(mineName);
+        releaseName(theirName);
+        return;
+    }
+    OwnerNode *mine = findOwnerByInterned(reg, mineName);
+    OwnerNode *theirs = findOwnerByInterned(reg, theirName);
+    int method = readIntSafe("Solver (1 = greedy, 2 = exact): ");
+    MatchupResult result;
+    PokeStatus status = POKE_ERR_NOT_FOUND;
+    if (method != 1 && method != 2)
+        status = POKE_ERR_INVALID_ARG;
+    else if (mine != NULL && theirs != NULL)
+        status = pokedexTeamMatchup(reg, mine, theirs, method == 1 ? MATCHUP_GREEDY : MATCHUP_EXACT, &result);
+    switch (status) {
+    case POKE_OK:
+        printf("%s's lineup against %s:\n", mineName->text, theirName->text);
+        for (int i = 0; i < result.boutCount; i++) {
+            const MatchupBout *bout = &result.bouts[i];
+            printf("%s vs %s: %s\n", bout->mine->name, bout->theirs->name,
+                   bout->outcome > 0 ? "win" : bout->outcome < 0 ? "loss" : "tie");
+        }
+        printf("Result: %d wins, %d ties, %d losses\n", result.wins, result.ties, result.losses);
+        matchupResultFree(&result);
+        break;
+    case POKE_ERR_NOT_FOUND:
+        printf("One or both owners not found.\n");
+        break;
+    case POKE_ERR_SAME_OWNER:
+        printf("An owner cannot face itself.\n");
+        break;
+    case POKE_ERR_EMPTY:
+        printf("Both Pokedexes need at least one Pokemon.\n");
+        break;
+    case POKE_ERR_INVALID_ARG:
+        printf("Invalid choice.\n");
+        break;
+    default:
+        printf("Memory allocation failed.\n");
+    }
+    releaseName(mineName);
+    releaseName(theirName);
+}
+
+//--------------- Paginated display ---------------
+#define VISIT_STACK_INLINE 64
+
+// Explicit stack (or BFS queue) for the page fetches and the visitor walks.
+// The inline slots cover any reasonably balanced tree; degenerate ones spill
+// to the heap.
+typedef struct
+{
+    PokemonNode *slots[VISIT_STACK_INLINE];
+    PokemonNode **items;
+    int top;
+    int cap;
+    int failed;               // a push ran out of memory
+} VisitStack;
+
+static void visitStackInit(VisitStack *stack) {
+    stack->items = stack->slots;
+    stack->top = 0;
+    stack->cap = VISIT_STACK_INLINE;
+    stack->failed = 0;
+}
+
+static void visitStackFree(VisitStack *stack) {
+    if (stack->items != stack->slots)
+        countedFree(ALLOC_SITE_VISIT, stack->items);
+}
+
+static int visitStackGrow(VisitStack *stack) {
+    int cap = stack->cap * 2;
+    PokemonNode **bigger;
+    if (stack->items == stack->slots) {
+        bigger = (PokemonNode **)countedMalloc(ALLOC_SITE_VISIT, sizeof(PokemonNode *) * cap);
+        if (bigger != NULL)
+            memcpy(bigger, stack->slots, sizeof(stack->slots));
+    } else {
+        bigger = (PokemonNode **)countedRealloc(ALLOC_SITE_VISIT, stack->items, sizeof(PokemonNode *) * cap);
+    }
+    if (bigger == NULL) {
+        stack->failed = 1;
+        return 0;
+    }
+    stack->items = bigger;
+    stack->cap = cap;
+    return 1;
+}
+
+static inline int visitStackPush(VisitStack *stack, PokemonNode *node) {
+    if (stack->top == stack->cap && !visitStackGrow(stack))
+        return 0;
+    stack->items[stack->top++] = node;
+    return 1;
+}
+
+// root is a snapshot, so the subtree sizes the fetches steer by stand still.
+// Each returns how many entries it wrote, or -1 if a stack ran out of memory
+// (the cursor may have moved then). Up to max IDs after cursor->lastId.
+static int fetchInOrder(PokemonNode *root, PokedexCursor *cursor, const PokemonData **out, int max) {
+    VisitStack stack; // ancestors still to visit
+    visitStackInit(&stack);
+    for (PokemonNode *node = root; node != NULL;) {
+        if (node->id > cursor->lastId) {
+            if (!visitStackPush(&stack, node))
+                break;
+            node = RCU_DEREF(node->left);
+        } else {
+            node = RCU_DEREF(node->right);
+        }
+    }
+    int count = 0;
+    while (count < max && stack.top > 0) {
+        PokemonNode *node = stack.items[--stack.top];
+        out[count++] = node->data;
+        cursor->lastId = node->id;
+        for (node = RCU_DEREF(node->right); node != NULL; node = RCU_DEREF(node->left)) {
+            if (!visitStackPush(&stack, node))
+                break;
+        }
+    }
+    int failed = stack.failed;
+    visitStackFree(&stack);
+    return failed ? -1 : count;
+}
+
+static int fetchPreOrder(PokemonNode *root, PokedexCursor *cursor, const PokemonData **out, int max) {
+    VisitStack pending; // right children still to visit
+    visitStackInit(&pending);
+    PokemonNode *node = root;
+    // Select the entry at the position: the node itself, then its left subtree
+    for (int skip = cursor->position; node != NULL && skip > 0;) {
+        PokemonNode *left = RCU_DEREF(node->left);
+        PokemonNode *right = RCU_DEREF(node->right);
+        skip--;
+        if (skip < nodeSize(left)) {
+            if (right != NULL && !visitStackPush(&pending, right))
+                node = NULL;
+            else
+                node = left;
+        } else {
+            skip -= nodeSize(left);
+            node = right;
+        }
+    }
+    int count = 0;
+    while (node != NULL && count < max) {
+        out[count++] = node->data;
+        PokemonNode *left = RCU_DEREF(node->left);
+        PokemonNode *right = RCU_DEREF(node->right);
+        if (right != NULL && !visitStackPush(&pending, right))
+            break;
+        node = left != NULL ? left : pending.top > 0 ? pending.items[--pending.top] : NULL;
+    }
+    int failed = pending.failed;
+    visitStackFree(&pending);
+    cursor->position += count;
+    return failed ? -1 : count;
+}
+
+static int fetchPostOrder(PokemonNode *root, PokedexCursor *cursor, const PokemonData **out, int max) {
+    if (root == NULL || cursor->position >= root->size)
+        return 0;
+    VisitStack path; // ancestors of node
+    visitStackInit(&path);
+    PokemonNode *node = root;
+    // Select the entry at the position: left subtree, right subtree, then the node
+    for (int skip = cursor->position; node != NULL;) {
+        PokemonNode *left = RCU_DEREF(node->left);
+        PokemonNode *right = RCU_DEREF(node->right);
+        if (left != NULL && skip < nodeSize(left)) {
+            node = visitStackPush(&path, node) ? left : NULL;
+        } else if (right != NULL && skip < nodeSize(left) + nodeSize(right)) {
+            skip -= nodeSize(left);
+            node = visitStackPush(&path, node) ? right : NULL;
+        } else {
+            break;
+        }
+    }
+    int count = 0;
+    while (node != NULL && count < max) {
+        out[count++] = node->data;
+        if (path.top == 0)
+            break;
+        PokemonNode *parent = path.items[path.top - 1];
+        PokemonNode *sibling = RCU_DEREF(parent->right);
+        if (node == RCU_DEREF(parent->left) && sibling != NULL) {
+            // Next comes the first node of the right subtree in post-order
+            node = sibling;
+            for (;;) {
+                PokemonNode *left = RCU_DEREF(node->left);
+                PokemonNode *right = RCU_DEREF(node->right);
+                if (left == NULL && right == NULL)
+                    break;
+                if (!visitStackPush(&path, node)) {
+                    node = NULL;
+                    break;
+                }
+                node = left != NULL ? left : right;
+            }
+        } else {
+            node = parent;
+            path.top--;
+        }
+    }
+    int failed = path.failed;
+    visitStackFree(&path);
+    cursor->position += count;
+    return failed ? -1 : count;
+}
+
+// Appends the nodes `depth` levels below node whose IDs are above afterId,
+// left to right. A node at or below afterId has nothing above it on its left.
+static int fetchLevel(PokemonNode *node, int depth, int afterId, PokedexCursor *cursor,
+                      const PokemonData **out, int max, int count) {
+    if (node == NULL || count >= max)
+        return count;
+    if (depth == 0) {
+        if (node->id > afterId) {
+            out[count++] = node->data;
+            cursor->lastId = node->id;
+        }
+        return count;
+    }
+    if (node->id > afterId)
+        count = fetchLevel(RCU_DEREF(node->left), depth - 1, afterId, cursor, out, max, count);
+    return fetchLevel(RCU_DEREF(node->right), depth - 1, afterId, cursor, out, max, count);
+}
+
+static int fetchBFS(PokemonNode *root, PokedexCursor *cursor, const PokemonData **out, int max) {
+    int count = 0;
+    while (count < max) {
+        int before = count;
+        count = fetchLevel(root, cursor->depth, cursor->lastId, cursor, out, max, count);
+        if (count == max)
+            break;
+        // A level with no node at all: nothing lies deeper
+        if (count == before && cursor->lastId == 0)
+            break;
+        cursor->depth++;
+        cursor->lastId = 0;
+    }
+    return count;
+}
+
+static int compareRanks(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Collects the name ranks above after of every node in the subtree, up to
+// room of them
+static void collectRanksAfter(PokemonNode *root, const uint32_t *nameRank, long after, uint32_t *ranks, int *count,
+                              int room) {
+    while (root != NULL && *count < room) {
+        if ((long)nameRank[root->id - 1] > after)
+            ranks[(*count)++] = nameRank[root->id - 1];
+        collectRanksAfter(RCU_DEREF(root->left), nameRank, after, ranks, count, room);
+        root = RCU_DEREF(root->right);
+    }
+}
+
+// Steps through the catalog's name index, probing the tree, unless the
+// Pokedex is much smaller than what is left of the catalog: then its own
+// nodes are ranked instead.
+static int fetchAlphabetical(PokemonNode *root, PokedexCursor *cursor, const PokemonData **out, int max) {
+    const SpeciesCatalog *cat = speciesCatalog();
+    int count = 0;
+    int rank = cursor->lastId > 0 && cursor->lastId <= cat->count ? (int)cat->nameRank[cursor->lastId - 1] + 1 : 0;
+    int size = root != NULL ? root->size : 0;
+    uint32_t *ranks = NULL;
+    if (size > 0 && (long)size * 8 < cat->count - rank)
+        ranks = (uint32_t *)countedMalloc(ALLOC_SITE_VISIT, sizeof(uint32_t) * size);
+    if (ranks != NULL) {
+        int found = 0;
+        collectRanksAfter(root, cat->nameRank, rank - 1, ranks, &found, size);
+        qsort(ranks, found, sizeof(ranks[0]), compareRanks);
+        for (; count < found && count < max; count++) {
+            out[count] = findSpecies((int)cat->byName[ranks[count]]);
+            cursor->lastId = out[count]->id;
+        }
+        countedFree(ALLOC_SITE_VISIT, ranks);
+        return count;
+    }
+    // (Also the fallback when the rank array could not be allocated)
+    for (; rank < cat->count && count < max; rank++) {
+        PokemonNode *node = searchPokemon(root, (int)cat->byName[rank]);
+        if (node != NULL) {
+            out[count++] = node->data;
+            cursor->lastId = node->id;
+        }
+    }
+    return count;
+}
+
+static int fetchPage(PokemonNode *root, PokedexCursor *cursor, const PokemonData **out, int max) {
+    switch (cursor->order) {
+    case ORDER_BFS:
+        return fetchBFS(root, cursor, out, max);
+    case ORDER_PRE:
+        return fetchPreOrder(root, cursor, out, max);
+    case ORDER_IN:
+        return fetchInOrder(root, cursor, out, max);
+    case ORDER_POST:
+        return fetchPostOrder(root, cursor, out, max);
+    case ORDER_ALPHA:
+        return fetchAlphabetical(root, cursor, out, max);
+    }
+    return 0;
+}
+
+void pokedexCursorInit(PokedexCursor *cursor, TraversalOrder order) {
+    cursor->order = order;
+    cursor->lastId = 0;
+    cursor->depth = 0;
+    cursor->position = 0;
+    cursor->done = 0;
+}
+
+PokeStatus pokedexNextPage(Registry *reg, OwnerNode *owner, PokedexCursor *cursor, const PokemonData **entries,
+                           int max, int *count) {
+    if (reg == NULL || owner == NULL || cursor == NULL || entries == NULL || count == NULL || max <= 0
+        || cursor->order < ORDER_BFS || cursor->order > ORDER_ALPHA)
+        return POKE_ERR_INVALID_ARG;
+    *count = 0;
+    if (cursor->done)
+        return POKE_OK;
+    // Writers edit the sizes of nodes only they can reach, in place; a
+    // snapshot's nodes are shared, so they are copied before any edit
+    PokemonNode *root = pokedexSnapshot(reg, owner);
+    // Read on a copy: a page cut short by memory leaves the cursor alone
+    PokedexCursor next = *cursor;
+    int fetched = fetchPage(root, &next, entries, max);
+    // Peek one entry ahead on another copy, so the caller knows this was the last page
+    PokedexCursor peek = next;
+    const PokemonData *after;
+    int ahead = fetched < 0 ? -1 : fetchPage(root, &peek, &after, 1);
+    pokedexSnapshotRelease(root);
+    if (ahead < 0)
+        return POKE_ERR_NO_MEMORY;
+    *cursor = next;
+    cursor->done = ahead == 0;
+    *count = fetched;
+    return POKE_OK;
+}
+
+void pagedDisplayMenu(Registry *reg, OwnerNode *owner) {
+    if (!owner->pokedexRoot) {
+        printf("Pokedex is empty.\n");
+        return;
+    }
+    printf("Display:\n");
+    printf("1. BFS (Level-Order)\n");
+    printf("2. Pre-Order\n");
+    printf("3. In-Order\n");
+    printf("4. Post-Order\n");
+    printf("5. Alphabetical (by name)\n");
+    int choice = readIntSafe("Your choice: ");
+    if (choice < ORDER_BFS || choice > ORDER_ALPHA) {
+        printf("Invalid choice.\n");
+        return;
+    }
+    int size = readIntSafe("Entries per page: ");
+    if (size < 1) {
+        printf("Invalid page size.\n");
+        return;
+    }
+    // No page can hold more than the whole table
+    if (size > speciesCount())
+        size = speciesCount();
+    const PokemonData **page = (const PokemonData **)countedMalloc(ALLOC_SITE_VISIT, sizeof(PokemonData *) * size);
+    if (page == NULL) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    PokedexCursor cursor;
+    pokedexCursorInit(&cursor, (TraversalOrder)choice);
+    for (int number = 1;; number++) {
+        int count = 0;
+        if (pokedexNextPage(reg, owner, &cursor, page, size, &count) != POKE_OK) {
+            printf("Memory allocation failed.\n");
+            break;
+        }
+        printf("-- Page %d --\n", number);
+        for (int i = 0; i < count; i++)
+            printf(POKEMON_LINE_FMT, page[i]->id, page[i]->name, getTypeName(page[i]->TYPE), page[i]->hp,
+                   page[i]->attack, (page[i]->CAN_EVOLVE == CAN_EVOLVE) ? "Yes" : "No");
+        if (cursor.done) {
+            printf("-- End of Pokedex --\n");
+            break;
+        }
+        if (readIntSafe("Show the next page? (1 = yes, 0 = no): ") != 1)
+            break;
+    }
+    countedFree(ALLOC_SITE_VISIT, page);
+}
+
+// ------------ visitors with context ------------
+
+// Nodes wait here until a full batch (or the end of the walk) goes out
+typedef struct
+{
+    PokemonNode *nodes[VISIT_BATCH];
+    int count;
+    VisitBatchFunc visit;
+    void *context;
+} VisitBatch;
+
+// Returns 0 once the visitor has asked to stop
+static int visitBatchFlush(VisitBatch *batch) {
+    int count = batch->count;
+    if (count == 0)
+        return 1;
+    batch->count = 0;
+    STAT_ADD(traversalVisits, count);
+    return batch->visit(batch->nodes, count, batch->context) == VISIT_CONTINUE;
+}
+
+static inline int visitBatchPush(VisitBatch *batch, PokemonNode *node) {
+    batch->nodes[batch->count++] = node;
+    return batch->count < VISIT_BATCH || visitBatchFlush(batch);
+}
+
+static int walkBFS(PokemonNode *root, VisitBatch *batch, VisitStack *queue) {
+    int front = 0;
+    if (!visitStackPush(queue, root))
+        return 1;
+    while (front < queue->top) {
+        PokemonNode *node = queue->items[front++];
+        if (!visitBatchPush(batch, node))
+            return 0;
+        PokemonNode *left = RCU_DEREF(node->left);
+        PokemonNode *right = RCU_DEREF(node->right);
+        if ((left != NULL && !visitStackPush(queue, left)) || (right != NULL && !visitStackPush(queue, right)))
+            return 1;
+    }
+    return 1;
+}
+
+static int walkPreOrder(PokemonNode *root, VisitBatch *batch, VisitStack *stack) {
+    if (!visitStackPush(stack, root))
+        return 1;
+    while (stack->top > 0) {
+        PokemonNode *node = stack->items[--stack->top];
+        if (!visitBatchPush(batch, node))
+            return 0;
+        PokemonNode *left = RCU_DEREF(node->left);
+        PokemonNode *right = RCU_DEREF(node->right);
+        // Right first, so the left subtree comes off the stack next
+        if ((right != NULL && !visitStackPush(stack, right)) || (left != NULL && !visitStackPush(stack, left)))
+            return 1;
+    }
+    return 1;
+}
+
+static int walkInOrder(PokemonNode *root, VisitBatch *batch, VisitStack *stack) {
+    PokemonNode *node = root;
+    while (node != NULL || stack->top > 0) {
+        while (node != NULL) {
+            if (!visitStackPush(stack, node))
+                return 1;
+            node = RCU_DEREF(node->left);
+        }
+        node = stack->items[--stack->top];
+        if (!visitBatchPush(batch, node))
+            return 0;
+        node = RCU_DEREF(node->right);
+    }
+    return 1;
+}
+
+// A node on top of the stack is emitted once its right subtree is done,
+// which is exactly when the last node emitted is its right child
+static int walkPostOrder(PokemonNode *root, VisitBatch *batch, VisitStack *stack) {
+    PokemonNode *node = root;
+    PokemonNode *last = NULL;
+    while (node != NULL || stack->top > 0) {
+        if (node != NULL) {
+            if (!visitStackPush(stack, node))
+                return 1;
+            node = RCU_DEREF(node->left);
+            continue;
+        }
+        PokemonNode *top = stack->items[stack->top - 1];
+        PokemonNode *right = RCU_DEREF(top->right);
+        if (right != NULL && right != last) {
+            node = right;
+        } else {
+            if (!visitBatchPush(batch, top))
+                return 0;
+            last = top;
+            stack->top--;
+        }
+    }
+    return 1;
+}
+
+// The sorted array already is a run of batches, so it goes out in slices
+static VisitResult walkAlphabetical(PokemonNode *root, VisitBatchFunc visit, void *context) {
+    NodeArray na;
+    initNodeArray(&na, sizeOfBinTree(root));
+    if (na.nodes == NULL)
+        return VISIT_CONTINUE;
+    collectAll(root, &na);
+    qsort(na.nodes, na.size, sizeof(PokemonNode *), compareByNameNode);
+    VisitResult result = VISIT_CONTINUE;
+    for (int i = 0; i < na.size && result == VISIT_CONTINUE; i += VISIT_BATCH) {
+        int count = (na.size - i < VISIT_BATCH) ? na.size - i : VISIT_BATCH;
+        result = visit(na.nodes + i, count, context);
+    }
+    countedFree(ALLOC_SITE_NODE_ARRAY, na.nodes);
+    return result;
+}
+
+VisitResult traverseBatched(PokemonNode *root, TraversalOrder order, VisitBatchFunc visit, void *context) {
+    if (root == NULL || visit == NULL)
+        return VISIT_CONTINUE;
+    if (order == ORDER_ALPHA)
+        return walkAlphabetical(root, visit, context);
+    VisitBatch batch;
+    batch.count = 0;
+    batch.visit = visit;
+    batch.context = context;
+    VisitStack stack;
+    visitStackInit(&stack);
+    int more = 1;
+    switch (order) {
+    case ORDER_BFS:
+        more = walkBFS(root, &batch, &stack);
+        break;
+    case ORDER_PRE:
+        more = walkPreOrder(root, &batch, &stack);
+        break;
+    case ORDER_IN:
+        more = walkInOrder(root, &batch, &stack);
+        break;
+    case ORDER_POST:
+        more = walkPostOrder(root, &batch, &stack);
+        break;
+    default:
+        break;
+    }
+    visitStackFree(&stack);
+    if (more)
+        more = visitBatchFlush(&batch);
+    return more ? VISIT_CONTINUE : VISIT_STOP;
+}
+
+typedef struct
+{
+    VisitNodeCtxFunc visit;
+    void *context;
+} NodeVisitor;
+
+static VisitResult visitEachInBatch(PokemonNode **nodes, int count, void *context) {
+    const NodeVisitor *visitor = (const NodeVisitor *)context;
+    for (int i = 0; i < count; i++) {
+        if (visitor->visit(nodes[i], visitor->context) == VISIT_STOP)
+            return VISIT_STOP;
+    }
+    return VISIT_CONTINUE;
+}
+
+// Runs on the batched walk: a stop can leave up to VISIT_BATCH - 1 nodes
+// walked but not visited, which is far cheaper than an indirect call each
+VisitResult traverseWith(PokemonNode *root, TraversalOrder order, VisitNodeCtxFunc visit, void *context) {
+    if (visit == NULL)
+        return VISIT_CONTINUE;
+    NodeVisitor visitor = {visit, context};
+    return traverseBatched(root, order, visitEachInBatch, &visitor);
+}
+
+// ------------ species catalog ------------
+
+// Built-in name index, filled the first time anyone asks for names
+static pthread_once_t nameIndexOnce = PTHREAD_ONCE_INIT;
+static uint32_t builtinByName[POKEDEX_SIZE];
+static uint32_t builtinNameRank[POKEDEX_SIZE];
+
+static int compareIdsByName(const void *a, const void *b) {
+    return strcmp(pokedex[*(const uint32_t *)a - 1].name, pokedex[*(const uint32_t *)b - 1].name);
+}
+
+// A loaded catalog brings its own index, so only the built-in table needs one
+static void buildNameIndex(void) {
+    if (catalog.byName != NULL)
+        return;
+    for (int i = 0; i < POKEDEX_SIZE; i++)
+        builtinByName[i] = (uint32_t)(i + 1);
+    qsort(builtinByName, POKEDEX_SIZE, sizeof(builtinByName[0]), compareIdsByName);
+    for (int i = 0; i < POKEDEX_SIZE; i++)
+        builtinNameRank[builtinByName[i] - 1] = (uint32_t)i;
+    catalog.byName = builtinByName;
+    catalog.nameRank = builtinNameRank;
+}
+
+const SpeciesCatalog *speciesCatalog(void) {
+    pthread_once(&nameIndexOnce, buildNameIndex);
+    return &catalog;
+}
+
+int speciesCount(void) {
+    return catalog.count;
+}
+
+const PokemonData *findSpeciesByName(const char *name) {
+    if (name == NULL)
+        return NULL;
+    const SpeciesCatalog *cat = speciesCatalog();
+    int low = 0, high = cat->count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        const PokemonData *species = &cat->species[cat->byName[mid] - 1];
+        int cmp = strcmp(name, species->name);
+        if (cmp == 0)
+            return species;
+        if (cmp < 0)
+            high = mid - 1;
+        else
+            low = mid + 1;
+    }
+    return NULL;
+}
+
+const PokemonData *speciesEvolution(const PokemonData *species) {
+    if (species == NULL || species->CAN_EVOLVE != CAN_EVOLVE)
+        return NULL;
+    int next = catalog.evolvesTo ? (int)catalog.evolvesTo[species->id - 1] : species->id + 1;
+    return findSpecies(next);
+}
+
+// Checks a mapped catalog file and builds the species records over it. The
+// names stay in the mapping; nothing else of it is copied.
+static PokeStatus catalogFromImage(const unsigned char *image, size_t size, SpeciesCatalog *out) {
+    CatalogFileHeader header;
+    if (size < sizeof(header))
+        return POKE_ERR_BAD_CATALOG;
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, CATALOG_MAGIC, sizeof(header.magic)) != 0 || header.version != CATALOG_VERSION
+        || header.byteOrder != CATALOG_BYTE_ORDER || header.count < 1 || header.count > SPECIES_MAX
+        || header.namesSize < 2)
+        return POKE_ERR_BAD_CATALOG;
+    size_t count = header.count;
+    size_t recordsAt = sizeof(header);
+    size_t byNameAt = recordsAt + count * sizeof(CatalogFileRecord);
+    size_t namesAt = byNameAt + count * sizeof(uint32_t);
+    if (size != namesAt + header.namesSize)
+        return POKE_ERR_BAD_CATALOG;
+    const CatalogFileRecord *records = (const CatalogFileRecord *)(image + recordsAt);
+    const uint32_t *byName = (const uint32_t *)(image + byNameAt);
+    const char *names = (const char *)(image + namesAt);
+    // The pool ends in a NUL, so every in-range offset starts a terminated name
+    if (names[header.namesSize - 1] != '\0')
+        return POKE_ERR_BAD_CATALOG;
+
+    PokemonData *species = (PokemonData *)countedMalloc(ALLOC_SITE_CATALOG, sizeof(PokemonData) * count);
+    uint32_t *nameRank = (uint32_t *)countedMalloc(ALLOC_SITE_CATALOG, sizeof(uint32_t) * count);
+    uint32_t *evolvesTo = (uint32_t *)countedMalloc(ALLOC_SITE_CATALOG, sizeof(uint32_t) * count);
+    PokeStatus status = (species && nameRank && evolvesTo) ? POKE_OK : POKE_ERR_NO_MEMORY;
+    for (size_t i = 0; i < count && status == POKE_OK; i++) {
+        const CatalogFileRecord *record = &records[i];
+        if (record->nameOffset >= header.namesSize || names[record->nameOffset] == '\0'
+            || record->type >= POKEMON_TYPE_COUNT || record->hp < 0 || record->hp > CATALOG_MAX_STAT
+            || record->attack < 0 || record->attack > CATALOG_MAX_STAT || record->evolvesTo > count
+            || record->evolvesTo == i + 1) {
+            status = POKE_ERR_BAD_CATALOG;
+            break;
+        }
+        evolvesTo[i] = record->evolvesTo;
+        species[i].id = (int)(i + 1);
+        species[i].name = (char *)(names + record->nameOffset);
+        species[i].TYPE = (PokemonType)record->type;
+        species[i].hp = record->hp;
+        species[i].attack = record->attack;
+        species[i].CAN_EVOLVE = record->evolvesTo != 0 ? CAN_EVOLVE : CANNOT_EVOLVE;
+        nameRank[i] = UINT32_MAX;
+    }
+    // byName must list every ID once, in strictly increasing name order
+    for (size_t i = 0; i < count && status == POKE_OK; i++) {
+        uint32_t id = byName[i];
+        if (id < 1 || id > count || nameRank[id - 1] != UINT32_MAX
+            || (i > 0 && strcmp(species[byName[i - 1] - 1].name, species[id - 1].name) >= 0))
+            status = POKE_ERR_BAD_CATALOG;
+        else
+            nameRank[id - 1] = (uint32_t)i;
+    }
+    if (status != POKE_OK) {
+        countedFree(ALLOC_SITE_CATALOG, species);
+        countedFree(ALLOC_SITE_CATALOG, nameRank);
+        countedFree(ALLOC_SITE_CATALOG, evolvesTo);
+        return status;
+    }
+    out->species = species;
+    out->count = (int)count;
+    out->evolvesTo = evolvesTo;
+    out->byName = byName;
+    out->nameRank = nameRank;
+    return POKE_OK;
+}
+
+PokeStatus speciesCatalogLoad(const char *path) {
+    static int loaded = 0;
+    if (path == NULL)
+        return POKE_ERR_INVALID_ARG;
+    if (loaded)
+        return POKE_ERR_CATALOG_LOCKED;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return POKE_ERR_BAD_CATALOG;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CatalogFileHeader)) {
+        close(fd);
+        return POKE_ERR_BAD_CATALOG;
+    }
+    size_t size = (size_t)st.st_size;
+    void *image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+        return POKE_ERR_BAD_CATALOG;
+    SpeciesCatalog loadedCatalog;
+    PokeStatus status = catalogFromImage((const unsigned char *)image, size, &loadedCatalog);
+    if (status != POKE_OK) {
+        munmap(image, size);
+        return status;
+    }
+    // The mapping is never unmapped: species names live in it
+    catalog = loadedCatalog;
+    loaded = 1;
+    return POKE_OK;
+}
+
+// ------------ merge many owners ------------
+int registryFindOwners(Registry *reg, const char *pattern, OwnerNode **out, int max) {
+    if (reg == NULL || pattern == NULL)
+        return 0;
+    int found = 0;
+    rcuReadLock();
+    OwnerNode *head = RCU_DEREF(reg->head);
+    int limit = RCU_DEREF(reg->count);
+    OwnerNode *current = head;
+    for (int i = 0; current != NULL && i < limit; i++) {
+        if (fnmatch(pattern, current->ownerName, 0) == 0) {
+            if (found < max)
+                out[found] = current;
+            found++;
+        }
+        current = RCU_DEREF(current->next);
+        if (current == head)
+            break;
+    }
+    rcuReadUnlock();
+    return found;
+}
+
+typedef struct
+{
+    OwnerNode **sources;
+    int count;
+    int chunkCount;
+    int nextChunk;          // claimed with an atomic add, like the report
+    int nextRow;
+    unsigned char *seen;    // one row of catalog.count + 1 flags per worker
+} MergeJob;
+
+// The writer lock is held throughout, so the source trees stand still
+static void *mergeWorker(void *arg) {
+    MergeJob *job = (MergeJob *)arg;
+    int row = __atomic_fetch_add(&job->nextRow, 1, __ATOMIC_RELAXED);
+    unsigned char *seen = job->seen + (size_t)row * (catalog.count + 1);
+    for (;;) {
+        int chunk = __atomic_fetch_add(&job->nextChunk, 1, __ATOMIC_RELAXED);
+        if (chunk >= job->chunkCount)
+            break;
+        int first = chunk * MERGE_CHUNK_OWNERS;
+        int last = first + MERGE_CHUNK_OWNERS < job->count ? first + MERGE_CHUNK_OWNERS : job->count;
+        for (int i = first; i < last; i++)
+            markOwned(job->sources[i]->pokedexRoot, seen);
+    }
+    perfFlushThread();
+    rcuThreadOffline();
+    return NULL;
+}
+
+static int compareOwnerAddresses(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(OwnerNode *const *)a, y = (uintptr_t)*(OwnerNode *const *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts the sources by address so repeats sit together, then drops repeats,
+// NULLs and the target; returns how many are left
+static int uniqueSources(OwnerNode **sources, int count, const OwnerNode *into) {
+    qsort(sources, count, sizeof(sources[0]), compareOwnerAddresses);
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (sources[i] != NULL && sources[i] != into && (kept == 0 || sources[kept - 1] != sources[i]))
+            sources[kept++] = sources[i];
+    }
+    return kept;
+}
+
+// Marks every source's IDs, on several threads when the work is worth it.
+// Returns the flag rows (rows of them) or NULL if memory ran out.
+static unsigned char *flattenSources(OwnerNode **sources, int count, int threads, int *rows) {
+    long pokemon = 0;
+    for (int i = 0; i < count; i++)
+        pokemon += sources[i]->pokedexRoot ? sources[i]->pokedexRoot->size : 0;
+    MergeJob job;
+    job.sources = sources;
+    job.count = count;
+    job.chunkCount = (count + MERGE_CHUNK_OWNERS - 1) / MERGE_CHUNK_OWNERS;
+    job.nextChunk = 0;
+    job.nextRow = 0;
+    if (pokemon < MERGE_PARALLEL_MIN)
+        threads = 1;
+    else if (threads <= 0)
+        threads = workerThreadCount();
+    if (threads > job.chunkCount)
+        threads = job.chunkCount;
+    size_t rowBytes = (size_t)catalog.count + 1;
+    job.seen = (unsigned char *)countedMalloc(ALLOC_SITE_MERGE_QUEUE, rowBytes * threads);
+    if (job.seen == NULL)
+        return NULL;
+    memset(job.seen, 0, rowBytes * threads);
+    pthread_t *workers = threads > 1 ? (pthread_t *)countedMalloc(ALLOC_SITE_MERGE_QUEUE, sizeof(pthread_t) * threads)
+                                     : NULL;
+    int started = 0;
+    // The calling thread is worker number 0
+    for (int i = 1; workers != NULL && i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, mergeWorker, &job) != 0)
+            break;
+        started++;
+    }
+    mergeWorker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+    countedFree(ALLOC_SITE_MERGE_QUEUE, workers);
+    *rows = started + 1;
+    return job.seen;
+}
+
+PokeStatus registryMergeMany(Registry *reg, OwnerNode *into, OwnerNode *const *sources, int count, int threads,
+                             MergeManyResult *result) {
+    if (reg == NULL || into == NULL || count < 0 || (sources == NULL && count > 0))
+        return POKE_ERR_INVALID_ARG;
+    if (result != NULL) {
+        result->ownersMerged = 0;
+        result->pokemonAdded = 0;
+    }
+    OwnerNode **unique = (OwnerNode **)countedMalloc(ALLOC_SITE_MERGE_QUEUE, sizeof(OwnerNode *) * (count + 1));
+    if (unique == NULL)
+        return POKE_ERR_NO_MEMORY;
+    if (count > 0)
+        memcpy(unique, sources, sizeof(OwnerNode *) * count);
+    count = uniqueSources(unique, count, into);
+    if (count == 0) {
+        countedFree(ALLOC_SITE_MERGE_QUEUE, unique);
+        return POKE_ERR_TOO_FEW_OWNERS;
+    }
+
+    rcuWriteLock(reg);
+    int rows = 0;
+    unsigned char *seen = flattenSources(unique, count, threads, &rows);
+    int species = catalog.count;
+    unsigned char *owned = (unsigned char *)countedMalloc(ALLOC_SITE_MERGE_QUEUE, species + 1);
+    const PokemonData **sorted = (const PokemonData **)countedMalloc(ALLOC_SITE_MERGE_QUEUE,
+                                                                     sizeof(PokemonData *) * species);
+    if (owned == NULL || sorted == NULL) {
+        countedFree(ALLOC_SITE_MERGE_QUEUE, seen);
+        seen = NULL;
+    } else {
+        memset(owned, 0, species + 1);
+        markOwned(into->pokedexRoot, owned);
+    }
+    int total = 0, added = 0;
+    // The ID table is the k-way merge: one pass in ID order, each ID once
+    for (int id = 1; seen != NULL && id <= species; id++) {
+        int any = owned[id];
+        for (int r = 0; r < rows && !any; r++)
+            any = seen[(size_t)r * (species + 1) + id];
+        if (!any)
+            continue;
+        sorted[total++] = &catalog.species[id - 1];
+        if (!owned[id])
+            added++;
+    }
+    countedFree(ALLOC_SITE_MERGE_QUEUE, seen);
+    int ok = seen != NULL;
+    PokemonNode *root = ok && added > 0 ? buildBalanced(sorted, total, &ok) : NULL;
+    if (!ok) {
+        rcuWriteUnlock(reg);
+        freePokemonTree(root);
+        countedFree(ALLOC_SITE_MERGE_QUEUE, unique);
+        countedFree(ALLOC_SITE_MERGE_QUEUE, owned);
+        countedFree(ALLOC_SITE_MERGE_QUEUE, sorted);
+        return POKE_ERR_NO_MEMORY;
+    }
+    // Nothing new: the target keeps its tree (and its undo history) as it is
+    if (added > 0) {
+        recordUndo(reg, into);
+        treeChanged(into);
+        PokemonNode *old = into->pokedexRoot;
+        RCU_ASSIGN(into->pokedexRoot, root);
+        freePokemonTree(old);
+        for (int i = 0; i < total; i++) {
+            if (!owned[sorted[i]->id])
+                into->typeCount[sorted[i]->TYPE]++;
+        }
+        int height = treeHeight(root);
+        if (height > into->maxDepth)
+            into->maxDepth = height;
+    }
+    for (int i = 0; i < count; i++)
+        removeOwnerFromCircularList(reg, unique[i]);
+    treeSettled(reg, into);
+    rcuWriteUnlock(reg);
+    countedFree(ALLOC_SITE_MERGE_QUEUE, unique);
+    countedFree(ALLOC_SITE_MERGE_QUEUE, owned);
+    countedFree(ALLOC_SITE_MERGE_QUEUE, sorted);
+    if (result != NULL) {
+        result->ownersMerged = count;
+        result->pokemonAdded = added;
+    }
+    return POKE_OK;
+}
+
+// Owners named in a comma-separated list; *missing gets the first unknown
+// name's interned copy (the caller releases it). Returns how many were found.
+static int collectNamedOwners(Registry *reg, StrView list, OwnerNode ***out, InternedName **missing) {
+    int count = 0, cap = 0;
+    *missing = NULL;
+    while (list.len > 0 && *missing == NULL) {
+        const char *comma = (const char *)memchr(list.text, ',', list.len);
+        size_t len = comma ? (size_t)(comma - list.text) : list.len;
+        StrView piece = {list.text, len};
+        piece = trimView(piece);
+        list.text += comma ? len + 1 : len;
+        list.len -= comma ? len + 1 : len;
+        if (piece.len == 0)
+            continue;
+        InternedName *name = internName(&reg->names, piece.text, piece.len);
+        OwnerNode *owner = name ? findOwnerByInterned(reg, name) : NULL;
+        if (owner == NULL) {
+            *missing = name;
+            break;
+        }
+        releaseName(name);
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            OwnerNode **bigger = (OwnerNode **)countedRealloc(ALLOC_SITE_MERGE_QUEUE, *out, sizeof(OwnerNode *) * cap);
+            if (bigger == NULL)
+                return -1;
+            *out = bigger;
+        }
+        (*out)[count++] = owner;
+    }
+    return count;
+}
+
+static int isPattern(StrView text) {
+    for (size_t i = 0; i < text.len; i++) {
+        if (text.text[i] == '*' || text.text[i] == '?' || text.text[i] == '[')
+            return 1;
+    }
+    return 0;
+}
+
+void mergeManyMenu(Registry *reg) {
+    printf("Enter name of the owner to merge into: ");
+    InternedName *target = readInternedName(reg);
+    if (target == NULL) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    OwnerNode *into = findOwnerByInterned(reg, target);
+    if (into == NULL) {
+        printf("Owner '%s' not found.\n", target->text);
+        releaseName(target);
+        return;
+    }
+    printf("Enter owners to merge (names separated by commas, or a pattern such as Kanto*): ");
+    StrView line = {"", 0};
+    if (readLineView(&line))
+        line = trimView(line);
+    OwnerNode **sources = NULL;
+    int count = 0;
+    if (isPattern(line)) {
+        char *pattern = (char *)countedMalloc(ALLOC_SITE_INPUT, line.len + 1);
+        if (pattern != NULL) {
+            memcpy(pattern, line.text, line.len);
+            pattern[line.len] = '\0';
+            // Sized first, then filled; only this thread changes the ring
+            count = registryFindOwners(reg, pattern, NULL, 0);
+            sources = (OwnerNode **)countedMalloc(ALLOC_SITE_MERGE_QUEUE, sizeof(OwnerNode *) * (count + 1));
+            if (sources != NULL)
+                count = registryFindOwners(reg, pattern, sources, count);
+        }
+        countedFree(ALLOC_SITE_INPUT, pattern);
+        if (pattern == NULL || sources == NULL)
+            count = -1;
+    } else {
+        InternedName *missing = NULL;
+        count = collectNamedOwners(reg, line, &sources, &missing);
+        if (missing != NULL) {
+            printf("Owner '%s' not found.\n", missing->text);
+            releaseName(missing);
+            countedFree(ALLOC_SITE_MERGE_QUEUE, sources);
+            releaseName(target);
+            return;
+        }
+    }
+    MergeManyResult result;
+    PokeStatus status = count < 0 ? POKE_ERR_NO_MEMORY
+                                  : registryMergeMany(reg, into, sources, count, 0, &result);
+    if (status == POKE_OK) {
+        printf("Merged %d owner%s into %s (%d new Pokemon).\n", result.ownersMerged,
+               result.ownersMerged == 1 ? "" : "s", target->text, result.pokemonAdded);
+    } else if (status == POKE_ERR_TOO_FEW_OWNERS) {
+        printf("No other owners to merge.\n");
+    } else {
+        printf("Memory allocation failed.\n");
+    }
+    countedFree(ALLOC_SITE_MERGE_QUEUE, sources);
+    releaseName(target);
+}
+
+// ------------ pluggable allocators ------------
+PokeStatus allocatorSet(AllocTag tag, const Allocator *allocator) {
+    if (tag < 0 || tag >= ALLOC_TAG_COUNT)
+        return POKE_ERR_INVALID_ARG;
+    if (allocator == NULL)
+        allocator = &mallocAllocators[tag];
+    if (allocator->alloc == NULL || allocator->release == NULL)
+        return POKE_ERR_INVALID_ARG;
+    __atomic_store_n(&tagAllocators[tag], allocator, __ATOMIC_RELEASE);
+    return POKE_OK;
+}
+
+const Allocator *allocatorGet(AllocTag tag) {
+    if (tag < 0 || tag >= ALLOC_TAG_COUNT)
+        return NULL;
+    return __atomic_load_n(&tagAllocators[tag], __ATOMIC_ACQUIRE);
+}
+
+void allocatorFree(void *ptr) {
+    countedFree(ALLOC_SITE_STRDUP, ptr);
+}
+
+const char *getAllocTagName(AllocTag tag) {
+    static const char *names[ALLOC_TAG_COUNT] = {"owners", "nodes", "names", "scratch", "input"};
+    return (tag >= 0 && tag < ALLOC_TAG_COUNT) ? names[tag] : "unknown";
+}
+
+// Slabs and chunks keep the blocks behind them 16-byte aligned
+#define ALIGN16(n) (((n) + 15) & ~(size_t)15)
+
+typedef struct PoolSlab
+{
+    struct PoolSlab *next;
+} PoolSlab;
+
+typedef struct
+{
+    Allocator base;
+    pthread_mutex_t lock;
+    size_t blockSize;  // bytes per block, header included
+    int blocksPerSlab;
+    void *freeList;    // each free block starts with the next one's address
+    PoolSlab *slabs;
+    size_t reserved;
+    long live;
+} PoolAllocator;
+
+static void *poolAlloc(void *state, size_t size) {
+    PoolAllocator *pool = (PoolAllocator *)state;
+    pthread_mutex_lock(&pool->lock);
+    void *block = NULL;
+    if (size > pool->blockSize) {
+        block = malloc(size);
+        if (block != NULL)
+            pool->reserved += size;
+    } else {
+        if (pool->freeList == NULL) {
+            size_t bytes = ALIGN16(sizeof(PoolSlab)) + pool->blockSize * pool->blocksPerSlab;
+            PoolSlab *slab = (PoolSlab *)malloc(bytes);
+            if (slab != NULL) {
+                slab->next = pool->slabs;
+                pool->slabs = slab;
+                pool->reserved += bytes;
+                char *first = (char *)slab + ALIGN16(sizeof(PoolSlab));
+                // Threaded back to front so blocks come out in address order
+                for (int i = pool->blocksPerSlab - 1; i >= 0; i--) {
+                    void **slot = (void **)(first + (size_t)i * pool->blockSize);
+                    *slot = pool->freeList;
+                    pool->freeList = slot;
+                }
+            }
+        }
+        if (pool->freeList != NULL) {
+            block = pool->freeList;
+            pool->freeList = *(void **)block;
+        }
+    }
+    if (block != NULL)
+        pool->live++;
+    pthread_mutex_unlock(&pool->lock);
+    return block;
+}
+
+static void poolRelease(void *state, void *ptr, size_t size) {
+    PoolAllocator *pool = (PoolAllocator *)state;
+    pthread_mutex_lock(&pool->lock);
+    if (size > pool->blockSize) {
+        free(ptr);
+        pool->reserved -= size;
+    } else {
+        *(void **)ptr = pool->freeList;
+        pool->freeList = ptr;
+    }
+    pool->live--;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static size_t poolReserved(void *state) {
+    PoolAllocator *pool = (PoolAllocator *)state;
+    pthread_mutex_lock(&pool->lock);
+    size_t reserved = pool->reserved;
+    pthread_mutex_unlock(&pool->lock);
+    return reserved;
+}
+
+Allocator *poolAllocatorCreate(size_t blockSize, int blocksPerSlab) {
+    if (blockSize == 0 || blockSize > UINT32_MAX || blocksPerSlab < 0)
+        return NULL;
+    PoolAllocator *pool = (PoolAllocator *)malloc(sizeof(PoolAllocator));
+    if (pool == NULL)
+        return NULL;
+    pool->base.name = "pool";
+    pool->base.state = pool;
+    pool->base.alloc = poolAlloc;
+    pool->base.resize = NULL;
+    pool->base.release = poolRelease;
+    pool->base.reserved = poolReserved;
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->blockSize = ALIGN16(ALLOC_HEADER_SIZE + blockSize);
+    pool->blocksPerSlab = blocksPerSlab ? blocksPerSlab : POOL_BLOCKS_PER_SLAB;
+    pool->freeList = NULL;
+    pool->slabs = NULL;
+    pool->reserved = 0;
+    pool->live = 0;
+    return &pool->base;
+}
+
+typedef struct BumpChunk
+{
+    struct BumpChunk *next;
+    size_t used;
+} BumpChunk;
+
+typedef struct
+{
+    Allocator base;
+    pthread_mutex_t lock;
+    size_t chunkSize;   // usable bytes per chunk
+    BumpChunk *first;
+    BumpChunk *current; // chunks after it are empty
+    size_t reserved;
+    long live;
+} BumpAllocator;
+
+static void *bumpAlloc(void *state, size_t size) {
+    BumpAllocator *bump = (BumpAllocator *)state;
+    size = ALIGN16(size);
+    pthread_mutex_lock(&bump->lock);
+    void *block = NULL;
+    if (size > bump->chunkSize) {
+        block = malloc(size);
+        if (block != NULL)
+            bump->reserved += size;
+    } else {
+        BumpChunk *chunk = bump->current;
+        while (chunk != NULL && chunk->used + size > bump->chunkSize && chunk->next != NULL)
+            chunk = chunk->next;
+        if (chunk == NULL || chunk->used + size > bump->chunkSize) {
+            BumpChunk *fresh = (BumpChunk *)malloc(ALIGN16(sizeof(BumpChunk)) + bump->chunkSize);
+            if (fresh != NULL) {
+                fresh->next = NULL;
+                fresh->used = 0;
+                bump->reserved += ALIGN16(sizeof(BumpChunk)) + bump->chunkSize;
+                if (chunk == NULL)
+                    bump->first = fresh;
+                else
+                    chunk->next = fresh;
+            }
+            chunk = fresh;
+        }
+        if (chunk != NULL) {
+            bump->current = chunk;
+            block = (char *)chunk + ALIGN16(sizeof(BumpChunk)) + chunk->used;
+            chunk->used += size;
+        }
+    }
+    if (block != NULL)
+        bump->live++;
+    pthread_mutex_unlock(&bump->lock);
+    return block;
+}
+
+static void bumpRelease(void *state, void *ptr, size_t size) {
+    BumpAllocator *bump = (BumpAllocator *)state;
+    size = ALIGN16(size);
+    pthread_mutex_lock(&bump->lock);
+    if (size > bump->chunkSize) {
+        free(ptr);
+        bump->reserved -= size;
+    }
+    // The last block out rewinds every chunk
+    if (--bump->live == 0) {
+        for (BumpChunk *chunk = bump->first; chunk != NULL; chunk = chunk->next)
+            chunk->used = 0;
+        bump->current = bump->first;
+    }
+    pthread_mutex_unlock(&bump->lock);
+}
+
+static size_t bumpReserved(void *state) {
+    BumpAllocator *bump = (BumpAllocator *)state;
+    pthread_mutex_lock(&bump->lock);
+    size_t reserved = bump->reserved;
+    pthread_mutex_unlock(&bump->lock);
+    return reserved;
+}
+
+Allocator *bumpAllocatorCreate(size_t chunkSize) {
+    if (chunkSize > UINT32_MAX)
+        return NULL;
+    BumpAllocator *bump = (BumpAllocator *)malloc(sizeof(BumpAllocator));
+    if (bump == NULL)
+        return NULL;
+    bump->base.name = "bump";
+    bump->base.state = bump;
+    bump->base.alloc = bumpAlloc;
+    bump->base.resize = NULL;
+    bump->base.release = bumpRelease;
+    bump->base.reserved = bumpReserved;
+    pthread_mutex_init(&bump->lock, NULL);
+    bump->chunkSize = ALIGN16(chunkSize ? chunkSize : BUMP_CHUNK_SIZE);
+    bump->first = NULL;
+    bump->current = NULL;
+    bump->reserved = 0;
+    bump->live = 0;
+    return &bump->base;
+}
+
+PokeStatus allocatorDestroy(Allocator *allocator) {
+    if (allocator == NULL || (allocator->alloc != poolAlloc && allocator->alloc != bumpAlloc))
+        return POKE_ERR_INVALID_ARG;
+    for (int tag = 0; tag < ALLOC_TAG_COUNT; tag++) {
+        if (allocatorGet((AllocTag)tag) == allocator)
+            return POKE_ERR_ALLOCATOR_BUSY;
+    }
+    if (allocator->alloc == poolAlloc) {
+        PoolAllocator *pool = (PoolAllocator *)allocator->state;
+        if (pool->live > 0)
+            return POKE_ERR_ALLOCATOR_BUSY;
+        while (pool->slabs != NULL) {
+            PoolSlab *next = pool->slabs->next;
+            free(pool->slabs);
+            pool->slabs = next;
+        }
+        pthread_mutex_destroy(&pool->lock);
+        free(pool);
+    } else {
+        BumpAllocator *bump = (BumpAllocator *)allocator->state;
+        if (bump->live > 0)
+            return POKE_ERR_ALLOCATOR_BUSY;
+        while (bump->first != NULL) {
+            BumpChunk *next = bump->first->next;
+            free(bump->first);
+            bump->first = next;
+        }
+        pthread_mutex_destroy(&bump->lock);
+        free(bump);
+    }
+    return POKE_OK;
+}
+
+// Pool block size when allocatorConfigure is not given one
+static size_t defaultPoolBlock(AllocTag tag) {
+    switch (tag) {
+    case ALLOC_TAG_OWNERS:
+        return sizeof(OwnerNode);
+    case ALLOC_TAG_NODES:
+        return sizeof(PokemonNode);
+    case ALLOC_TAG_NAMES:
+        return sizeof(InternedName) + 16; // names up to 15 characters
+
+    case ALLOC_TAG_INPUT:
+        return 64;
+    default:
+        return 256;
+    }
+}
+
+// One "tag=kind[:size]" item; *kind is 0 malloc, 1 pool, 2 bump
+static int parseAllocatorItem(StrView item, AllocTag *tag, int *kind, size_t *size) {
+    static const char *kinds[] = {"malloc", "pool", "bump"};
+    const char *eq = (const char *)memchr(item.text, '=', item.len);
+    if (eq == NULL)
+        return 0;
+    StrView key = {item.text, (size_t)(eq - item.text)};
+    StrView value = {eq + 1, item.len - key.len - 1};
+    key = trimView(key);
+    value = trimView(value);
+    *tag = ALLOC_TAG_COUNT;
+    for (int t = 0; t < ALLOC_TAG_COUNT; t++) {
+        const char *name = getAllocTagName((AllocTag)t);
+        if (strlen(name) == key.len && memcmp(name, key.text, key.len) == 0)
+            *tag = (AllocTag)t;
+    }
+    const char *colon = (const char *)memchr(value.text, ':', value.len);
+    size_t kindLen = colon ? (size_t)(colon - value.text) : value.len;
+    *kind = -1;
+    for (int k = 0; k < 3; k++) {
+        if (strlen(kinds[k]) == kindLen && memcmp(kinds[k], value.text, kindLen) == 0)
+            *kind = k;
+    }
+    *size = 0;
+    if (colon != NULL) {
+        const char *digits = colon + 1;
+        const char *end = value.text + value.len;
+        if (digits == end || *kind == 0)
+            return 0;
+        for (; digits < end; digits++) {
+            if (*digits < '0' || *digits > '9' || *size > UINT32_MAX / 10)
+                return 0;
+            *size = *size * 10 + (size_t)(*digits - '0');
+        }
+        if (*size == 0 || *size > UINT32_MAX)
+            return 0;
+    }
+    return *tag != ALLOC_TAG_COUNT && *kind >= 0;
+}
+
+PokeStatus allocatorConfigure(const char *spec) {
+    if (spec == NULL)
+        return POKE_ERR_INVALID_ARG;
+    int kinds[ALLOC_TAG_COUNT];
+    size_t sizes[ALLOC_TAG_COUNT];
+    for (int t = 0; t < ALLOC_TAG_COUNT; t++)
+        kinds[t] = -1;
+    // Check everything first so a typo changes nothing
+    StrView rest = {spec, strlen(spec)};
+    while (rest.len > 0) {
+        const char *comma = (const char *)memchr(rest.text, ',', rest.len);
+        size_t len = comma ? (size_t)(comma - rest.text) : rest.len;
+        StrView item = {rest.text, len};
+        item = trimView(item);
+        rest.text += comma ? len + 1 : len;
+        rest.len -= comma ? len + 1 : len;
+        if (item.len == 0)
+            continue;
+        AllocTag tag;
+        int kind;
+        size_t size;
+        if (!parseAllocatorItem(item, &tag, &kind, &size))
+            return POKE_ERR_INVALID_ARG;
+        kinds[tag] = kind;
+        sizes[tag] = size;
+    }
+    Allocator *made[ALLOC_TAG_COUNT] = {NULL};
+    for (int t = 0; t < ALLOC_TAG_COUNT; t++) {
+        if (kinds[t] == 1)
+            made[t] = poolAllocatorCreate(sizes[t] ? sizes[t] : defaultPoolBlock((AllocTag)t), 0);
+        else if (kinds[t] == 2)
+            made[t] = bumpAllocatorCreate(sizes[t]);
+        if (kinds[t] > 0 && made[t] == NULL) {
+            while (t-- > 0)
+                allocatorDestroy(made[t]);
+            return POKE_ERR_NO_MEMORY;
+        }
+    }
+    // The ones these replace may still hold blocks, so they are kept
+    for (int t = 0; t < ALLOC_TAG_COUNT; t++) {
+        if (kinds[t] >= 0)
+            allocatorSet((AllocTag)t, made[t]);
+    }
+    return POKE_OK;
+}
+
+// ------------ queries ------------
+const char *getQueryAccessName(QueryAccess access) {
+    static const char *names[QUERY_ACCESS_COUNT] = {"ID scan", "type index", "HP index", "attack index",
+                                                    "name index"};
+    return (access >= 0 && access < QUERY_ACCESS_COUNT) ? names[access] : "unknown";
+}
+
+static void queryError(Query *query, const char *what, StrView term) {
+    snprintf(query->error, sizeof(query->error), "%s: %.*s", what, (int)(term.len < 48 ? term.len : 48), term.text);
+}
+
+// Copies a value into a fixed field, dropping surrounding double quotes
+static int copyQueryText(StrView value, char *out) {
+    if (value.len >= 2 && value.text[0] == '"' && value.text[value.len - 1] == '"') {
+        value.text++;
+        value.len -= 2;
+    }
+    if (value.len >= QUERY_TEXT_MAX)
+        return 0;
+    memcpy(out, value.text, value.len);
+    out[value.len] = '\0';
+    return 1;
+}
+
+// Narrows [*low, *high] by "op value"
+static void narrowRange(int *low, int *high, StrView op, int value) {
+    if (viewEquals(op, "=") || viewEquals(op, ">=") || viewEquals(op, ">")) {
+        long long bound = viewEquals(op, ">") ? (long long)value + 1 : value;
+        if (bound > *low)
+            *low = bound > INT_MAX ? INT_MAX : (int)bound;
+        // x > INT_MAX holds for nothing
+        if (bound > INT_MAX)
+            *high = INT_MIN;
+    }
+    if (viewEquals(op, "=") || viewEquals(op, "<=") || viewEquals(op, "<")) {
+        long long bound = viewEquals(op, "<") ? (long long)value - 1 : value;
+        if (bound < *high)
+            *high = bound < INT_MIN ? INT_MIN : (int)bound;
+    }
+}
+
+static int parseQueryTerm(StrView term, Query *query) {
+    if (viewEquals(term, "explain")) {
+        query->explain = 1;
+        return 1;
+    }
+    size_t at = 0;
+    while (at < term.len && strchr("<>=", term.text[at]) == NULL)
+        at++;
+    size_t opLen = at + 1 < term.len && term.text[at + 1] == '=' && term.text[at] != '=' ? 2 : 1;
+    if (at == 0 || at == term.len) {
+        queryError(query, "Expected field=value", term);
+        return 0;
+    }
+    StrView field = {term.text, at};
+    StrView op = {term.text + at, opLen};
+    StrView value = {term.text + at + opLen, term.len - at - opLen};
+    int number;
+    int isEquals = viewEquals(op, "=");
+    if (viewEquals(field, "id") || viewEquals(field, "hp") || viewEquals(field, "attack")) {
+        if (!parseIntView(value, &number)) {
+            queryError(query, "Expected a number", term);
+            return 0;
+        }
+        if (viewEquals(field, "id"))
+            narrowRange(&query->idMin, &query->idMax, op, number);
+        else if (viewEquals(field, "hp"))
+            narrowRange(&query->hpMin, &query->hpMax, op, number);
+        else
+            narrowRange(&query->attackMin, &query->attackMax, op, number);
+        return 1;
+    }
+    if (!isEquals) {
+        queryError(query, "Only = works here", term);
+        return 0;
+    }
+    if (viewEquals(field, "owner") || viewEquals(field, "name")) {
+        if (!copyQueryText(value, viewEquals(field, "owner") ? query->owner : query->name)) {
+            queryError(query, "Value too long", term);
+            return 0;
+        }
+        return 1;
+    }
+    if (viewEquals(field, "type")) {
+        for (int type = 0; type < POKEMON_TYPE_COUNT; type++) {
+            const char *name = getTypeName((PokemonType)type);
+            size_t i = 0;
+            while (i < value.len && name[i] == toupper((unsigned char)value.text[i]))
+                i++;
+            if (i == value.len && name[i] == '\0') {
+                query->type = type;
+                return 1;
+            }
+        }
+        queryError(query, "Unknown type", term);
+        return 0;
+    }
+    if (viewEquals(field, "sort")) {
+        static const char *keys[] = {"id", "hp", "attack", "name"};
+        query->descending = value.len > 0 && value.text[0] == '-';
+        if (query->descending) {
+            value.text++;
+            value.len--;
+        }
+        for (int k = 0; k < 4; k++) {
+            if (viewEquals(value, keys[k])) {
+                query->sort = (QuerySort)(QUERY_SORT_ID + k);
+                return 1;
+            }
+        }
+        queryError(query, "Sort by id, hp, attack or name", term);
+        return 0;
+    }
+    if (viewEquals(field, "limit")) {
+        if (!parseIntView(value, &number) || number <= 0) {
+            queryError(query, "Expected a positive limit", term);
+            return 0;
+        }
+        query->limit = number;
+        return 1;
+    }
+    queryError(query, "Unknown term", term);
+    return 0;
+}
+
+PokeStatus queryCompile(const char *text, Query *query) {
+    if (query == NULL)
+        return POKE_ERR_INVALID_ARG;
+    memset(query, 0, sizeof(*query));
+    query->type = -1;
+    query->idMin = query->hpMin = query->attackMin = 0;
+    query->idMax = query->hpMax = query->attackMax = INT_MAX;
+    if (text == NULL) {
+        snprintf(query->error, sizeof(query->error), "No query");
+        return POKE_ERR_INVALID_ARG;
+    }
+    const char *at = text;
+    while (*at != '\0') {
+        while (*at == ' ' || *at == '\t')
+            at++;
+        if (*at == '\0')
+            break;
+        // A term runs to the next blank outside double quotes
+        const char *end = at;
+        int quoted = 0;
+        while (*end != '\0' && (quoted || (*end != ' ' && *end != '\t'))) {
+            if (*end == '"')
+                quoted = !quoted;
+            end++;
+        }
+        StrView term = {at, (size_t)(end - at)};
+        if (!parseQueryTerm(term, query))
+            return POKE_ERR_INVALID_ARG;
+        at = end;
+    }
+    return POKE_OK;
+}
+
+// Species IDs in the orders the planner can walk, for the current catalog
+typedef struct
+{
+    const PokemonData *species; // Catalog these were built for
+    uint32_t *byHp;             // (hp, ID) order
+    uint32_t *byAttack;         // (attack, ID) order
+    uint32_t *byType;           // grouped by type, ID order inside a group
+    int typeStart[POKEMON_TYPE_COUNT + 1];
+} QueryIndex;
+
+static QueryIndex queryIndex;
+static pthread_mutex_t queryIndexLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int compareIdsByHp(const void *a, const void *b) {
+    const PokemonData *x = findSpecies((int)*(const uint32_t *)a), *y = findSpecies((int)*(const uint32_t *)b);
+    return x->hp != y->hp ? (x->hp > y->hp) - (x->hp < y->hp) : (x->id > y->id) - (x->id < y->id);
+}
+
+static int compareIdsByAttack(const void *a, const void *b) {
+    const PokemonData *x = findSpecies((int)*(const uint32_t *)a), *y = findSpecies((int)*(const uint32_t *)b);
+    return x->attack != y->attack ? (x->attack > y->attack) - (x->attack < y->attack)
+                                  : (x->id > y->id) - (x->id < y->id);
+}
+
+// Built on first use, and again if a catalog was loaded since
+static const QueryIndex *queryIndexFor(void) {
+    pthread_mutex_lock(&queryIndexLock);
+    if (queryIndex.species != catalog.species) {
+        int count = catalog.count;
+        uint32_t *byHp = (uint32_t *)countedMalloc(ALLOC_SITE_QUERY, sizeof(uint32_t) * count);
+        uint32_t *byAttack = (uint32_t *)countedMalloc(ALLOC_SITE_QUERY, sizeof(uint32_t) * count);
+        uint32_t *byType = (uint32_t *)countedMalloc(ALLOC_SITE_QUERY, sizeof(uint32_t) * count);
+        if (byHp == NULL || byAttack == NULL || byType == NULL) {
+            countedFree(ALLOC_SITE_QUERY, byHp);
+            countedFree(ALLOC_SITE_QUERY, byAttack);
+            countedFree(ALLOC_SITE_QUERY, byType);
+            pthread_mutex_unlock(&queryIndexLock);
+            return NULL;
+        }
+        int typeCount[POKEMON_TYPE_COUNT] = {0};
+        for (int i = 0; i < count; i++) {
+            byHp[i] = byAttack[i] = (uint32_t)(i + 1);
+            typeCount[catalog.species[i].TYPE]++;
+        }
+        qsort(byHp, count, sizeof(uint32_t), compareIdsByHp);
+        qsort(byAttack, count, sizeof(uint32_t), compareIdsByAttack);
+        queryIndex.typeStart[0] = 0;
+        for (int type = 0; type < POKEMON_TYPE_COUNT; type++)
+            queryIndex.typeStart[type + 1] = queryIndex.typeStart[type] + typeCount[type];
+        int fill[POKEMON_TYPE_COUNT];
+        memcpy(fill, queryIndex.typeStart, sizeof(fill));
+        for (int i = 0; i < count; i++)
+            byType[fill[catalog.species[i].TYPE]++] = (uint32_t)(i + 1);
+        countedFree(ALLOC_SITE_QUERY, queryIndex.byHp);
+        countedFree(ALLOC_SITE_QUERY, queryIndex.byAttack);
+        countedFree(ALLOC_SITE_QUERY, queryIndex.byType);
+        queryIndex.byHp = byHp;
+        queryIndex.byAttack = byAttack;
+        queryIndex.byType = byType;
+        queryIndex.species = catalog.species;
+    }
+    pthread_mutex_unlock(&queryIndexLock);
+    return &queryIndex;
+}
+
+static int speciesMatches(const Query *query, const PokemonData *species) {
+    return species->id >= query->idMin && species->id <= query->idMax && species->hp >= query->hpMin
+           && species->hp <= query->hpMax && species->attack >= query->attackMin
+           && species->attack <= query->attackMax && (query->type < 0 || (int)species->TYPE == query->type)
+           && (query->name[0] == '\0' || fnmatch(query->name, species->name, 0) == 0);
+}
+
+// The key an index (or the scan) orders species by
+static long accessKey(QueryAccess access, const PokemonData *species) {
+    switch (access) {
+    case QUERY_ACCESS_HP:
+        return species->hp;
+    case QUERY_ACCESS_ATTACK:
+        return species->attack;
+    case QUERY_ACCESS_NAME:
+        return catalog.nameRank[species->id - 1];
+    default:
+        return species->id;
+    }
+}
+
+// One index's species list, cut down to the query's range on its key
+typedef struct
+{
+    const uint32_t *ids;
+    int first, last; // [first, last)
+} SpeciesSlice;
+
+static int lowerBound(const uint32_t *ids, int first, int last, QueryAccess access, long key) {
+    while (first < last) {
+        int mid = first + (last - first) / 2;
+        if (accessKey(access, findSpecies((int)ids[mid])) < key)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+    return first;
+}
+
+static SpeciesSlice sliceFor(const QueryIndex *index, const Query *query, QueryAccess access) {
+    SpeciesSlice slice = {NULL, 0, 0};
+    long low, high;
+    switch (access) {
+    case QUERY_ACCESS_TYPE:
+        slice.ids = index->byType;
+        slice.first = index->typeStart[query->type];
+        slice.last = index->typeStart[query->type + 1];
+        low = query->idMin;
+        high = query->idMax;
+        break;
+    case QUERY_ACCESS_HP:
+        slice.ids = index->byHp;
+        slice.last = catalog.count;
+        low = query->hpMin;
+        high = query->hpMax;
+        break;
+    case QUERY_ACCESS_ATTACK:
+        slice.ids = index->byAttack;
+        slice.last = catalog.count;
+        low = query->attackMin;
+        high = query->attackMax;
+        break;
+    default:
+        slice.ids = catalog.byName;
+        slice.last = catalog.count;
+        return slice;
+    }
+    int first = lowerBound(slice.ids, slice.first, slice.last, access, low);
+    slice.last = lowerBound(slice.ids, first, slice.last, access, high + 1);
+    slice.first = first;
+    if (slice.last < slice.first)
+        slice.last = slice.first;
+    return slice;
+}
+
+// Pokemon in the tree with IDs up to bound, from the subtree sizes
+static int countAtMost(PokemonNode *root, long bound) {
+    int count = 0;
+    while (root != NULL) {
+        PokemonNode *left = RCU_DEREF(root->left);
+        if (root->id <= bound) {
+            count += 1 + (left ? left->size : 0);
+            root = RCU_DEREF(root->right);
+        } else {
+            root = left;
+        }
+    }
+    return count;
+}
+
+typedef struct
+{
+    QueryRow row;
+    long key;        // Sort key, negated for a descending sort
+} QueryMatch;
+
+typedef struct
+{
+    const Query *query;
+    OwnerNode *owner;
+    int position;
+    QueryMatch *matches;
+    int count;
+    int cap;
+    int ownerFound;  // Rows from the current owner
+    int stopAfter;   // Stop the current owner at this many rows
+    int ordered;     // The current owner's rows arrive in sort order
+    int cutOff;      // The kept rows already fill the limit...
+    long cutKey;     // ...so a row keyed at or past this cannot make it
+    int failed;
+    long found;      // Rows matched, kept or not
+    long steps;
+} QueryRun;
+
+static long sortKey(const Query *query, const PokemonData *species) {
+    static const QueryAccess byKey[] = {QUERY_ACCESS_SCAN, QUERY_ACCESS_SCAN, QUERY_ACCESS_HP, QUERY_ACCESS_ATTACK,
+                                        QUERY_ACCESS_NAME};
+    long key = query->sort == QUERY_SORT_NONE ? 0 : accessKey(byKey[query->sort], species);
+    return query->descending ? -key : key;
+}
+
+static void addMatch(QueryRun *run, const PokemonData *species) {
+    long key = sortKey(run->query, species);
+    run->found++;
+    if (run->cutOff && key >= run->cutKey) {
+        // Rows only get worse from here when they arrive in order
+        if (run->ordered)
+            run->ownerFound = run->stopAfter;
+        return;
+    }
+    if (run->count == run->cap) {
+        int cap = run->cap ? run->cap * 2 : 64;
+        QueryMatch *bigger = (QueryMatch *)countedRealloc(ALLOC_SITE_QUERY, run->matches, sizeof(QueryMatch) * cap);
+        if (bigger == NULL) {
+            run->failed = 1;
+            return;
+        }
+        run->matches = bigger;
+        run->cap = cap;
+    }
+    QueryMatch *match = &run->matches[run->count++];
+    match->row.owner = run->owner;
+    match->row.ownerPosition = run->position;
+    match->row.species = species;
+    match->key = key;
+    run->ownerFound++;
+}
+
+static int ownerDone(const QueryRun *run) {
+    return run->failed || run->ownerFound >= run->stopAfter;
+}
+
+// In-order (reversed for a descending walk), skipping subtrees that hold no
+// ID in the query's range
+static void scanRange(PokemonNode *node, QueryRun *run, int descending) {
+    if (node == NULL || ownerDone(run))
+        return;
+    run->steps++;
+    STAT_ADD(traversalVisits, 1);
+    const Query *query = run->query;
+    int id = node->id;
+    PokemonNode *left = RCU_DEREF(node->left), *right = RCU_DEREF(node->right);
+    if (descending ? id < query->idMax : id > query->idMin)
+        scanRange(descending ? right : left, run, descending);
+    if (!ownerDone(run) && id >= query->idMin && id <= query->idMax && speciesMatches(query, node->data))
+        addMatch(run, node->data);
+    if (descending ? id > query->idMin : id < query->idMax)
+        scanRange(descending ? left : right, run, descending);
+}
+
+static int probeTree(PokemonNode *root, int id, QueryRun *run) {
+    while (root != NULL) {
+        run->steps++;
+        STAT_ADD(searchVisits, 1);
+        if (id == root->id)
+            return 1;
+        root = id < root->id ? RCU_DEREF(root->left) : RCU_DEREF(root->right);
+    }
+    return 0;
+}
+
+// Walks a slice forwards, or backwards one run of equal keys at a time so
+// ties still come out in ID order
+static void probeSlice(PokemonNode *root, SpeciesSlice slice, QueryAccess access, int descending, QueryRun *run) {
+    int at = descending ? slice.last - 1 : slice.first;
+    while (!ownerDone(run) && at >= slice.first && at < slice.last) {
+        int runFirst = at, runLast = at + 1;
+        if (descending) {
+            long key = accessKey(access, findSpecies((int)slice.ids[at]));
+            while (runFirst > slice.first && accessKey(access, findSpecies((int)slice.ids[runFirst - 1])) == key)
+                runFirst--;
+        }
+        for (int i = runFirst; i < runLast && !ownerDone(run); i++) {
+            const PokemonData *species = findSpecies((int)slice.ids[i]);
+            if (speciesMatches(run->query, species) && probeTree(root, species->id, run))
+                addMatch(run, species);
+        }
+        at = descending ? runFirst - 1 : runLast;
+    }
+}
+
+// Does the path hand out an owner's rows in the order they are sorted by?
+static int accessFollowsSort(const Query *query, QueryAccess access) {
+    switch (query->sort) {
+    case QUERY_SORT_NONE:
+        return access == QUERY_ACCESS_SCAN || access == QUERY_ACCESS_TYPE ? 1 : 0;
+    case QUERY_SORT_ID:
+        return access == QUERY_ACCESS_SCAN || access == QUERY_ACCESS_TYPE;
+    case QUERY_SORT_HP:
+        return access == QUERY_ACCESS_HP;
+    case QUERY_SORT_ATTACK:
+        return access == QUERY_ACCESS_ATTACK;
+    default:
+        return access == QUERY_ACCESS_NAME;
+    }
+}
+
+typedef struct
+{
+    QueryAccess access;
+    double cost;    // Steps plus a little for each index entry read
+    long steps;     // Planned node visits
+} AccessChoice;
+
+// Catalog-wide facts one query's plans share
+typedef struct
+{
+    const QueryIndex *index;
+    SpeciesSlice slices[QUERY_ACCESS_COUNT];
+    int usable[QUERY_ACCESS_COUNT];
+    int speciesMatching;  // Species that pass every filter
+} QueryContext;
+
+// One selected owner as of the moment the query started. The planner steers
+// by subtree sizes, which writers edit in place on nodes only they can reach,
+// so it reads a snapshot, never the live tree.
+typedef struct
+{
+    OwnerNode *owner;
+    int position;         // Place in the ring, from 1
+    PokemonNode *root;    // Snapshot
+    int maxDepth;
+    int ofType;           // Pokemon of the query's type (-1: no type asked)
+} QuerySource;
+
+static AccessChoice chooseAccess(const QueryContext *ctx, const Query *query, const QuerySource *source,
+                                 int inRange, int stopAfter) {
+    PokemonNode *root = source->root;
+    int depth = source->maxDepth > 0 ? source->maxDepth : 1;
+    // Rows this owner should yield if its Pokemon are spread like the catalog
+    double expected = (double)ctx->speciesMatching * root->size / (catalog.count > 0 ? catalog.count : 1);
+    if (expected < 0.5)
+        expected = 0.5;
+    AccessChoice best = {QUERY_ACCESS_SCAN, 0, 0};
+    for (int a = 0; a < QUERY_ACCESS_COUNT; a++) {
+        if (!ctx->usable[a])
+            continue;
+        QueryAccess access = (QueryAccess)a;
+        int early = stopAfter != INT_MAX && accessFollowsSort(query, access);
+        double steps, entries;
+        if (access == QUERY_ACCESS_SCAN) {
+            // Every Pokemon in the range is visited, plus the way down
+            steps = inRange + depth;
+            if (early && stopAfter * (double)inRange / expected < steps)
+                steps = stopAfter * (double)inRange / expected + depth;
+            entries = 0;
+        } else {
+            // Only species that pass every filter are probed
+            double probes = ctx->speciesMatching;
+            entries = ctx->slices[a].last - ctx->slices[a].first;
+            if (early && stopAfter * probes / expected < probes) {
+                entries *= stopAfter / expected;
+                probes = stopAfter * probes / expected;
+            }
+            steps = probes * depth;
+        }
+        double cost = steps + entries / 8;
+        if (a == QUERY_ACCESS_SCAN || cost < best.cost) {
+            best.access = access;
+            best.cost = cost;
+            best.steps = (long)(steps + 0.5);
+        }
+    }
+    return best;
+}
+
+// Plans and runs one owner; returns 0 if it was ruled out untouched
+// Caller holds the writer lock
+static void addQuerySource(QuerySource *source, OwnerNode *owner, int position, const Query *query) {
+    source->owner = owner;
+    source->position = position;
+    source->root = shareRoot(owner);
+    source->maxDepth = owner->maxDepth;
+    source->ofType = query->type >= 0 ? owner->typeCount[query->type] : -1;
+}
+
+static int queryOwner(QueryContext *ctx, QueryRun *run, const QuerySource *source, QueryPlan *plan) {
+    const Query *query = run->query;
+    PokemonNode *root = source->root;
+    int ofType = source->ofType;
+    if (root == NULL || ctx->speciesMatching == 0 || ofType == 0)
+        return 0;
+    int inRange = countAtMost(root, query->idMax) - countAtMost(root, (long)query->idMin - 1);
+    if (inRange <= 0)
+        return 0;
+    run->owner = source->owner;
+    run->position = source->position;
+    run->ownerFound = 0;
+    run->stopAfter = INT_MAX;
+    if (query->limit > 0) {
+        if (query->sort == QUERY_SORT_NONE)
+            run->stopAfter = query->limit - run->count;
+        else
+            run->stopAfter = query->limit;
+    }
+    AccessChoice choice = chooseAccess(ctx, query, source, inRange, run->stopAfter);
+    run->ordered = accessFollowsSort(query, choice.access);
+    if (!run->ordered)
+        run->stopAfter = INT_MAX;
+    // All of the type found: nothing else can match when that is the only filter
+    if (query->type >= 0 && query->name[0] == '\0' && query->idMin <= 1 && query->idMax >= catalog.count
+        && query->hpMin <= 0 && query->hpMax == INT_MAX && query->attackMin <= 0 && query->attackMax == INT_MAX
+        && ofType > 0 && ofType < run->stopAfter)
+        run->stopAfter = ofType;
+    plan->ownersByAccess[choice.access]++;
+    plan->estimatedSteps += choice.steps;
+    int descending = query->descending && query->sort != QUERY_SORT_NONE;
+    if (choice.access == QUERY_ACCESS_SCAN)
+        scanRange(root, run, descending);
+    else
+        probeSlice(root, ctx->slices[choice.access], choice.access, descending, run);
+    return 1;
+}
+
+static int compareQueryMatches(const void *a, const void *b) {
+    const QueryMatch *x = (const QueryMatch *)a, *y = (const QueryMatch *)b;
+    if (x->key != y->key)
+        return (x->key > y->key) - (x->key < y->key);
+    if (x->row.ownerPosition != y->row.ownerPosition)
+        return (x->row.ownerPosition > y->row.ownerPosition) - (x->row.ownerPosition < y->row.ownerPosition);
+    return (x->row.species->id > y->row.species->id) - (x->row.species->id < y->row.species->id);
+}
+
+// Keeps the best limit rows once twice that many piled up; earlier owners win
+// ties, so the row at the limit then bounds every later owner
+static void trimMatches(QueryRun *run) {
+    const Query *query = run->query;
+    if (query->sort == QUERY_SORT_NONE || query->limit <= 0 || run->count < 2 * query->limit)
+        return;
+    qsort(run->matches, run->count, sizeof(QueryMatch), compareQueryMatches);
+    run->count = query->limit;
+    run->cutOff = 1;
+    run->cutKey = run->matches[query->limit - 1].key;
+}
+
+static void prepareContext(QueryContext *ctx, const Query *query) {
+    memset(ctx, 0, sizeof(*ctx));
+    speciesCatalog(); // makes sure the name index exists
+    ctx->index = queryIndexFor();
+    for (int id = 1; id <= catalog.count; id++)
+        ctx->speciesMatching += speciesMatches(query, &catalog.species[id - 1]);
+    ctx->usable[QUERY_ACCESS_SCAN] = 1;
+    if (ctx->index == NULL)
+        return;
+    ctx->usable[QUERY_ACCESS_TYPE] = query->type >= 0;
+    ctx->usable[QUERY_ACCESS_HP] = query->hpMin > 0 || query->hpMax != INT_MAX || query->sort == QUERY_SORT_HP;
+    ctx->usable[QUERY_ACCESS_ATTACK] = query->attackMin > 0 || query->attackMax != INT_MAX
+                                       || query->sort == QUERY_SORT_ATTACK;
+    ctx->usable[QUERY_ACCESS_NAME] = query->sort == QUERY_SORT_NAME;
+    for (int a = 1; a < QUERY_ACCESS_COUNT; a++) {
+        if (ctx->usable[a])
+            ctx->slices[a] = sliceFor(ctx->index, query, (QueryAccess)a);
+    }
+}
+
+PokeStatus queryRun(Registry *reg, const Query *query, QueryResult *result) {
+    if (result != NULL)
+        memset(result, 0, sizeof(*result));
+    if (reg == NULL || query == NULL || result == NULL)
+        return POKE_ERR_INVALID_ARG;
+    QueryContext ctx;
+    prepareContext(&ctx, query);
+    QueryRun run;
+    memset(&run, 0, sizeof(run));
+    run.query = query;
+    QueryPlan *plan = &result->plan;
+    int hasPattern = strpbrk(query->owner, "*?[") != NULL;
+    // Snapshot the selected owners under the writer lock: O(1) each, and every
+    // plan then reads sizes no writer is changing
+    rcuWriteLock(reg);
+    QuerySource *sources = (QuerySource *)countedMalloc(ALLOC_SITE_QUERY,
+                                                        sizeof(QuerySource) * (reg->count > 0 ? reg->count : 1));
+    if (sources == NULL) {
+        rcuWriteUnlock(reg);
+        return POKE_ERR_NO_MEMORY;
+    }
+    int selected = 0;
+    if (query->owner[0] != '\0' && !hasPattern) {
+        // One named owner: the name table finds it without a ring walk
+        OwnerNode *owner = findOwnerByName(reg, query->owner);
+        if (owner != NULL)
+            addQuerySource(&sources[selected++], owner, 1, query);
+    } else {
+        OwnerNode *current = reg->head;
+        for (int i = 0; current != NULL && i < reg->count; i++) {
+            if (query->owner[0] == '\0' || fnmatch(query->owner, current->ownerName, 0) == 0)
+                addQuerySource(&sources[selected++], current, i + 1, query);
+            current = current->next;
+            if (current == reg->head)
+                break;
+        }
+    }
+    rcuWriteUnlock(reg);
+
+    plan->ownersMatched = selected;
+    for (int i = 0; i < selected && !run.failed; i++) {
+        // In ring order a limit is met once, for every owner after
+        if (query->sort == QUERY_SORT_NONE && query->limit > 0 && run.count >= query->limit)
+            plan->ownersSkipped++;
+        else
+            plan->ownersSkipped += !queryOwner(&ctx, &run, &sources[i], plan);
+        trimMatches(&run);
+    }
+    for (int i = 0; i < selected; i++)
+        pokedexSnapshotRelease(sources[i].root);
+    countedFree(ALLOC_SITE_QUERY, sources);
+    if (run.failed) {
+        countedFree(ALLOC_SITE_QUERY, run.matches);
+        return POKE_ERR_NO_MEMORY;
+    }
+    if (run.count > 1)
+        qsort(run.matches, run.count, sizeof(QueryMatch), compareQueryMatches);
+    int count = query->limit > 0 && run.count > query->limit ? query->limit : run.count;
+    result->rows = (QueryRow *)countedMalloc(ALLOC_SITE_QUERY, sizeof(QueryRow) * (count + 1));
+    if (result->rows == NULL) {
+        countedFree(ALLOC_SITE_QUERY, run.matches);
+        return POKE_ERR_NO_MEMORY;
+    }
+    for (int i = 0; i < count; i++)
+        result->rows[i] = run.matches[i].row;
+    result->count = count;
+    plan->perOwnerStop = query->limit;
+    plan->actualSteps = run.steps;
+    plan->matched = run.found;
+    countedFree(ALLOC_SITE_QUERY, run.matches);
+    return POKE_OK;
+}
+
+void queryResultFree(QueryResult *result) {
+    if (result == NULL)
+        return;
+    countedFree(ALLOC_SITE_QUERY, result->rows);
+    result->rows = NULL;
+    result->count = 0;
+}
+
+static void printQueryPlan(const Query *query, const QueryPlan *plan) {
+    static const char *sortNames[] = {"owner, then ID", "ID", "HP", "attack", "name"};
+    printf("Plan: %d owner%s selected, %d ruled out without a walk.\n", plan->ownersMatched,
+           plan->ownersMatched == 1 ? "" : "s", plan->ownersSkipped);
+    for (int a = 0; a < QUERY_ACCESS_COUNT; a++) {
+        if (plan->ownersByAccess[a] > 0)
+            printf("  %s: %d owner%s\n", getQueryAccessName((QueryAccess)a), plan->ownersByAccess[a],
+                   plan->ownersByAccess[a] == 1 ? "" : "s");
+    }
+    printf("  Sorted by %s%s", sortNames[query->sort],
+           query->descending && query->sort != QUERY_SORT_NONE ? " (descending)" : "");
+    if (query->limit > 0)
+        printf(", first %d", query->limit);
+    printf("\n  Nodes visited: %ld planned, %ld actual; %ld row%s matched\n", plan->estimatedSteps,
+           plan->actualSteps, plan->matched, plan->matched == 1 ? "" : "s");
+}
+
+void queryMenu(Registry *reg) {
+    printf("Enter query (e.g. owner=Ash type=FIRE hp>50 sort=-attack limit=10, add explain for the plan): ");
+    StrView line = {"", 0};
+    if (readLineView(&line))
+        line = trimView(line);
+    char *text = (char *)countedMalloc(ALLOC_SITE_INPUT, line.len + 1);
+    if (text == NULL) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    memcpy(text, line.text, line.len);
+    text[line.len] = '\0';
+    Query query;
+    PokeStatus status = queryCompile(text, &query);
+    countedFree(ALLOC_SITE_INPUT, text);
+    if (status != POKE_OK) {
+        printf("%s.\n", query.error);
+        return;
+    }
+    QueryResult result;
+    if (queryRun(reg, &query, &result) != POKE_OK) {
+        printf("Memory allocation failed.\n");
+        return;
+    }
+    if (query.explain)
+        printQueryPlan(&query, &result.plan);
+    for (int i = 0; i < result.count; i++) {
+        const PokemonData *species = result.rows[i].species;
+        printf("%s: ", result.rows[i].owner->ownerName);
+        printf(POKEMON_LINE_FMT, species->id, species->name, getTypeName(species->TYPE), species->hp,
+               species->attack, (species->CAN_EVOLVE == CAN_EVOLVE) ? "Yes" : "No");
+    }
+    if (result.count == 0)
+        printf("No Pokemon match.\n");
+    else if (result.plan.matched > result.count)
+        printf("Showing %d of %ld or more matches.\n", result.count, result.plan.matched);
+    else
+        printf("%d match%s.\n", result.count, result.count == 1 ? "" : "es");
+    queryResultFree(&result);
 }
@@ -1,7 +1,13 @@
 #ifndef EX6_H
 #define EX6_H
 
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,6 +32,8 @@ typedef enum
     ICE
 } PokemonType;
 
+#define POKEMON_TYPE_COUNT 15
+
 typedef enum
 {
     CANNOT_EVOLVE,
@@ -42,25 +50,108 @@ typedef struct PokemonData
     EvolutionStatus CAN_EVOLVE;
 } PokemonData;
 
-// Binary Tree Node (for Pokédex)
+// Binary Tree Node (for Pokédex). The key and both links come first so a
+// search touches nothing else; display fields stay in the species table.
+// Nodes may be shared by several versions of a tree (see section 21).
 typedef struct PokemonNode
 {
-    PokemonData *data;
+    int id;                   // Species ID, the BST key
+    int refs;                 // Parents and roots pointing here (atomic)
     struct PokemonNode *left;
     struct PokemonNode *right;
+    const PokemonData *data;  // Species record in the species catalog (shared)
+    // Aggregates over the subtree rooted here (see section 24)
+    int size;
+    int sumHp;
+    int sumAttack;
+    int bestScore;            // Fight score of best, times ten
+    const PokemonData *best;  // Highest fight score, lower ID on a tie
 } PokemonNode;
 
+// Read-optimized copy of a Pokedex (see section 20)
+typedef struct FrozenPokedex FrozenPokedex;
+
+// An owner's place on the power leaderboard (see section 25)
+typedef struct RankNode RankNode;
+
+// An owner's totals as readers see them (see section 24)
+typedef struct PokedexSummary PokedexSummary;
+
+// An owner name stored once per registry (see section 19). Two owners have
+// the same name exactly when they point at the same InternedName.
+typedef struct InternedName
+{
+    struct InternedName *next;   // Hash chain
+    struct NameTable *table;     // Table it lives in
+    unsigned long long hash;     // FNV-1a of the text
+    unsigned long long prefix;   // First 8 bytes, big-endian, zero padded
+    size_t len;
+    int refs;
+    struct OwnerNode *owner;     // Owner in the ring by this name, or NULL
+    char text[];                 // NUL-terminated name
+} InternedName;
+
+typedef struct NameTable
+{
+    InternedName **buckets;
+    size_t bucketCount;          // Power of two
+    size_t size;
+    pthread_mutex_t lock;
+} NameTable;
+
+// Number of species in the pokedex table at the end of this file
+#define POKEDEX_SIZE 151
+
+// Most species a catalog may hold (see section 30). Arrays indexed by ID and
+// tree depths are bounded by it; the IDs in use are 1..speciesCount().
+#ifndef SPECIES_MAX
+#define SPECIES_MAX 4096
+#endif
+
+// Earlier versions of a Pokedex kept for undo (see section 21)
+#define POKEDEX_UNDO_DEPTH 8
+
 // Linked List Node (for Owners)
 typedef struct OwnerNode
 {
-    char *ownerName;          // Owner's name
+    char *ownerName;          // Owner's name (name->text)
+    InternedName *name;       // Interned name; the owner holds one reference
     PokemonNode *pokedexRoot; // Pointer to the root of the owner's Pokédex
     struct OwnerNode *next;   // Next owner in the linked list
     struct OwnerNode *prev;   // Previous owner in the linked list
+    int maxDepth;             // Deepest the Pokédex BST has ever been
+    FrozenPokedex *frozen;    // Optional frozen copy; dropped on any change
+    PokemonNode *undo[POKEDEX_UNDO_DEPTH]; // Earlier roots, oldest first
+    int undoCount;
+    unsigned long version;    // Bumped on every change to the Pokédex (section 23)
+    int typeCount[POKEMON_TYPE_COUNT]; // Pokemon per type (section 24)
+    RankNode *rank;           // Leaderboard entry (section 25)
+    PokedexSummary *summary;  // Totals for lock-free readers, replaced whole (section 24)
+    unsigned long serial;     // Never reused, unlike the address (section 23)
 } OwnerNode;
 
-// Global head pointer for the linked list of owners
-OwnerNode *ownerHead = NULL;
+// Every owner of a registry ordered by power (see section 25)
+typedef struct
+{
+    RankNode *head;           // Sentinel; its links start every level
+    int level;                // Levels in use
+    int length;               // Owners ranked
+    pthread_rwlock_t lock;    // Held for writing only while entries move
+} Leaderboard;
+
+// A registry of owners: the circular list plus everything needed to change it
+// safely. Every operation takes the registry explicitly, so a program may keep
+// several of them (see section 18 for the prompt-free library calls).
+typedef struct Registry
+{
+    OwnerNode *head;          // First owner in the circular list (NULL when empty)
+    int count;                // Owners in the ring; readers bound their walks by it
+    pthread_mutex_t writer;   // Serializes writers (see rcuWriteLock)
+    NameTable names;          // Every owner name, stored once
+    int undoDepth;            // Versions each owner keeps (0..POKEDEX_UNDO_DEPTH, default 0)
+    Leaderboard ranking;      // Owners by power, kept current by every writer
+    unsigned long ownersRemoved; // Bumped when owners leave the ring (section 23)
+} Registry;
 
 /* ------------------------------------------------------------
    1) Safe Input + Utility
@@ -76,7 +167,8 @@ void trimWhitespace(char *str);
 /**
  * @brief C99-friendly strdup replacement.
  * @param src source string
- * @return newly allocated copy of src
+ * @return newly allocated copy of src (release it with allocatorFree), or
+ *         NULL if memory ran out
  * Why we made it: Some old systems lack strdup; we do it ourselves.
  */
 char *myStrdup(const char *src);
@@ -89,12 +181,55 @@ char *myStrdup(const char *src);
  */
 int readIntSafe(const char *prompt);
 
+// A slice of a longer buffer; text is not NUL-terminated.
+typedef struct
+{
+    const char *text;
+    size_t len;
+} StrView;
+
+/**
+ * @brief Next stdin line as a view into the input buffer (no '\n', no final '\r').
+ * @param line receives the view; valid until the next line is read
+ * @return 1 if a line was read, 0 at end of input
+ * Why we made it: stdin is read in large blocks and lines are found with
+ * memchr, so a long command stream costs no per-line allocation or copy.
+ */
+int readLineView(StrView *line);
+
+/**
+ * @brief Drop leading/trailing spaces, tabs and '\r' from a view.
+ * @param view the view
+ * @return the trimmed view (same memory)
+ */
+StrView trimView(StrView view);
+
 /**
- * @brief Read a line from stdin, store in malloc'd buffer, trim whitespace.
- * @return pointer to the newly allocated string (caller frees)
- * Why we made it: We need flexible name input that handles CR/LF etc.
+ * @brief Parse a whole view as a decimal int, like strtol with nothing left over.
+ * @param view text to parse (leading whitespace and a sign are allowed)
+ * @param value receives the number
+ * @return 1 on success, 0 if the view is not exactly one int
+ * Why we made it: Integers are parsed in place, straight from the input buffer.
  */
-char *getDynamicInput(void);
+int parseIntView(StrView view, int *value);
+
+/**
+ * @brief Compare a view with a C string.
+ * @return 1 if they hold the same bytes
+ */
+int viewEquals(StrView view, const char *text);
+
+/**
+ * @brief Parse a list of IDs and ranges such as "1-10, 25 30".
+ * @param text the list; items are separated by commas and/or blanks, and a
+ *             reversed range such as "10-1" is read as "1-10"
+ * @param ids receives the IDs in the order given (duplicates kept)
+ * @param capacity room in ids
+ * @param outOfRange optional, counts IDs outside 1..speciesCount() (not stored)
+ * @return number of IDs stored, or -1 if the text is malformed or too long
+ * Why we made it: Bulk commands take many IDs on one line.
+ */
+int parseIdList(StrView text, int *ids, int capacity, int *outOfRange);
 
 /**
  * @brief Return a string for a given PokemonType enum.
@@ -109,33 +244,35 @@ const char *getTypeName(PokemonType type);
    ------------------------------------------------------------ */
 
 /**
- * @brief Create a BST node with a copy of the given PokemonData.
- * @param data pointer to PokemonData (like from the global pokedex)
- * @return newly allocated PokemonNode*
+ * @brief Create a BST node for the species with the given name.
+ * @param name species name (like from the global pokedex)
+ * @return newly allocated PokemonNode* pointing at the species record, or
+ *         NULL for an unknown name or if memory ran out
  * Why we made it: We need a standard way to allocate BST nodes.
  */
 PokemonNode *createPokemonNode(const char* name);
 
 /**
  * @brief Create an OwnerNode for the circular owners list.
- * @param ownerName the dynamically allocated name
+ * @param name interned name; the owner takes over this reference
  * @param starter BST root for the starter Pokemon
- * @return newly allocated OwnerNode*
+ * @return newly allocated OwnerNode*, or NULL if memory ran out
  * Why we made it: Each user is represented as an OwnerNode.
  */
-OwnerNode *createOwner(char *ownerName, PokemonNode *starter);
+OwnerNode *createOwner(InternedName *name, PokemonNode *starter);
 
 /**
- * @brief Free one PokemonNode (including name).
+ * @brief Free one PokemonNode (the species record is shared and stays).
  * @param node pointer to node
  * Why we made it: Avoid memory leaks for single nodes.
  */
 void freePokemonNode(PokemonNode *node);
 
 /**
- * @brief Recursively free a BST of PokemonNodes.
+ * @brief Drop one reference to a BST; nodes no other version shares are freed.
  * @param root BST root
  * Why we made it: Clearing a user’s entire Pokedex means freeing a tree.
+ * Freeing waits for rcuRetire, so readers still inside the tree are safe.
  */
 void freePokemonTree(PokemonNode *root);
 
@@ -152,6 +289,7 @@ void freeOwnerNode(OwnerNode *owner);
 
 /**
  * @brief Insert a PokemonNode into BST by ID; duplicates freed.
+ * Shared nodes on the way down are copied first (see section 21).
  * @param root pointer to BST root
  * @param newNode node to insert
  * @return updated BST root
@@ -192,7 +330,7 @@ PokemonNode *removeNodeBST(PokemonNode *root, int id);
  * Why we made it: BFS confirms existence, then removeNodeBST does the removal.
  */
 PokemonNode *removePokemonByID(PokemonNode *root, int id);
-void releasePokemon(OwnerNode *owner);
+void releasePokemon(Registry *reg, OwnerNode *owner);
 
 /* ------------------------------------------------------------
    4) Generic BST Traversals (Function Pointers)
@@ -257,6 +395,7 @@ typedef struct
  * @brief Initialize a NodeArray with given capacity.
  * @param na pointer to NodeArray
  * @param cap initial capacity
+ *        (na->nodes is NULL if memory ran out)
  * Why we made it: We store pointers to PokemonNodes for alphabetical sorting.
  */
 void initNodeArray(NodeArray *na, int cap);
@@ -264,7 +403,7 @@ void initNodeArray(NodeArray *na, int cap);
 /**
  * @brief Add a PokemonNode pointer to NodeArray, realloc if needed.
  * @param na pointer to NodeArray
- * @param node pointer to the node
+ * @param node pointer to the node (left out if the array cannot grow)
  * Why we made it: We want a dynamic list of BST nodes for sorting.
  */
 void addNode(NodeArray *na, PokemonNode *node);
@@ -337,14 +476,14 @@ void pokemonFight(OwnerNode *owner);
  * @param owner pointer to the Owner
  * Why we made it: Demonstrates removing an old ID, inserting the next ID.
  */
-void evolvePokemon(OwnerNode *owner);
+void evolvePokemon(Registry *reg, OwnerNode *owner);
 
 /**
  * @brief Prompt for an ID, BFS-check duplicates, then insert into BST.
  * @param owner pointer to the Owner
  * Why we made it: Primary user function for adding new Pokemon to an owner’s Pokedex.
  */
-void addPokemon(OwnerNode *owner);
+void addPokemon(Registry *reg, OwnerNode *owner);
 
 /**
  * @brief Prompt for ID, remove that Pokemon from BST by ID.
@@ -365,22 +504,16 @@ void freePokemon(OwnerNode *owner);
 void displayMenu(OwnerNode *owner);
 
 /* ------------------------------------------------------------
-   8) Sorting Owners (Bubble Sort on Circular List)
+   8) Sorting Owners (Relinking the Circular List)
    ------------------------------------------------------------ */
 
 /**
- * @brief Sort the circular owners list by name.
+ * @brief Sort the circular owners list by name and report the outcome.
+ * @param reg the registry
  * Why we made it: Another demonstration of pointer manipulation + sorting logic.
+ * The work is done by registrySortOwners().
  */
-void sortOwners(void);
-
-/**
- * @brief Helper to swap name & pokedexRoot in two OwnerNode.
- * @param a pointer to first owner
- * @param b pointer to second owner
- * Why we made it: Used internally by bubble sort to swap data.
- */
-void swapOwnerData(OwnerNode *a, OwnerNode *b);
+void sortOwners(Registry *reg);
 
 /* ------------------------------------------------------------
    9) Circular List Linking & Searching
@@ -388,25 +521,30 @@ void swapOwnerData(OwnerNode *a, OwnerNode *b);
 
 /**
  * @brief Insert a new owner into the circular list. If none exist, it's alone.
+ * @param reg the registry (caller holds its writer lock)
  * @param newOwner pointer to newly created OwnerNode
  * Why we made it: We need a standard approach to keep the list circular.
  */
-void linkOwnerInCircularList(OwnerNode *newOwner);
+void linkOwnerInCircularList(Registry *reg, OwnerNode *newOwner);
 
 /**
  * @brief Remove a specific OwnerNode from the circular list, possibly updating head.
+ * @param reg the registry (caller holds its writer lock)
  * @param target pointer to the OwnerNode
  * Why we made it: Deleting or merging owners requires removing them from the ring.
  */
-void removeOwnerFromCircularList(OwnerNode *target);
+void removeOwnerFromCircularList(Registry *reg, OwnerNode *target);
 
 /**
  * @brief Find an owner by name in the circular list.
+ * @param reg the registry
  * @param name string to match
  * @return pointer to the matching OwnerNode or NULL
- * Why we made it: We often need to locate an owner quickly.
+ * Why we made it: We often need to locate an owner quickly. The interned
+ * name points at its owner, so no ring walk is needed and a concurrent sort
+ * cannot make the owner look absent.
  */
-OwnerNode *findOwnerByName(const char *name);
+OwnerNode *findOwnerByName(Registry *reg, const char *name);
 
 /* ------------------------------------------------------------
    10) Owner Menus
@@ -416,46 +554,63 @@ OwnerNode *findOwnerByName(const char *name);
  * @brief Let user pick an existing Pokedex (owner) by number, then sub-menu.
  * Why we made it: This is the main interface for adding/fighting/evolving, etc.
  */
-void enterExistingPokedexMenu(void);
+void enterExistingPokedexMenu(Registry *reg);
 
 /**
  * @brief Creates a new Pokedex (prompt for name, check uniqueness, choose starter).
  * Why we made it: The main entry for building a brand-new Pokedex.
  */
-void openPokedexMenu(void);
+void openPokedexMenu(Registry *reg);
 
 /**
  * @brief Delete an entire Pokedex (owner) from the list.
  * Why we made it: Let user pick which Pokedex to remove and free everything.
  */
-void deletePokedex(void);
+void deletePokedex(Registry *reg);
 
 /**
  * @brief Merge the second owner's Pokedex into the first, then remove the second owner.
  * Why we made it: BFS copy demonstration plus removing an owner.
  */
-void mergePokedexMenu(void);
+void mergePokedexMenu(Registry *reg);
 
 /* ------------------------------------------------------------
    11) Printing Owners in a Circle
    ------------------------------------------------------------ */
 
+// Long runs come from one cycle of the ring: the names are copied once, and
+// the lines go out in chunks of about CIRCULAR_CHUNK bytes with only the line
+// numbers filled in.
+#define CIRCULAR_CHUNK (64 * 1024)
+
 /**
  * @brief Print owners left or right from head, repeating as many times as user wants.
  * Why we made it: Demonstrates stepping through a circular list in a chosen direction.
  */
-void printOwnersCircular();
-void printOwners();
+void printOwnersCircular(Registry *reg);
+
+/**
+ * @brief Write "[i] name" lines walking the ring from head, count lines in all.
+ * @param reg the registry
+ * @param out destination stream
+ * @param forward nonzero to follow next, zero to follow prev
+ * @param count number of lines
+ * Why we made it: A million lines over a small ring cost a few dozen fwrite
+ * calls, not a million printf calls.
+ */
+void writeOwnersCircular(Registry *reg, FILE *out, int forward, int count);
+void printOwners(Registry *reg);
 
 /* ------------------------------------------------------------
    12) Cleanup All Owners at Program End
    ------------------------------------------------------------ */
 
 /**
- * @brief Frees every remaining owner in the circular list, setting ownerHead = NULL.
+ * @brief Frees every remaining owner in the circular list, leaving the registry empty.
+ * @param reg the registry
  * Why we made it: Ensures a squeaky-clean exit with no leftover memory.
  */
-void freeAllOwners(void);
+void freeAllOwners(Registry *reg);
 
 /* ------------------------------------------------------------
    13) The Main Menu
@@ -463,9 +618,1515 @@ void freeAllOwners(void);
 
 /**
  * @brief The main driver loop for the program (new pokedex, merge, fight, etc.).
+ * @param reg the registry the menus work on
  * Why we made it: Our top-level UI that keeps the user engaged until they exit.
  */
-void mainMenu(void);
+void mainMenu(Registry *reg);
+
+/**
+ * @brief Merge ownerB's Pokedex into ownerA's (ownerB is left untouched).
+ * @param ownerA destination owner (caller holds the writer lock)
+ * @param ownerB source owner
+ * @return POKE_OK, or POKE_ERR_NO_MEMORY if some Pokemon could not be copied
+ * Why we made it: The copy step of mergePokedexMenu, callable without prompts.
+ */
+int mergePokeDex(OwnerNode *ownerA, OwnerNode *ownerB);
+
+// Build with -DEX6_NO_MAIN to link everything except main() into another
+// program (the benchmark and workload tools do this).
+
+/* ------------------------------------------------------------
+   14) Concurrent Readers (RCU-style Epoch Reclamation)
+   ------------------------------------------------------------ */
+
+// Readers (printing, searching, traversals) never block on writers. They wrap
+// their walk in rcuReadLock()/rcuReadUnlock() and load shared links with
+// RCU_DEREF. Writers serialize on rcuWriteLock(), publish fully built nodes
+// with RCU_ASSIGN and hand unlinked memory to rcuRetire() instead of free().
+
+#define RCU_MAX_READERS 64
+
+#define RCU_DEREF(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define RCU_ASSIGN(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+typedef void (*RcuReclaimFunc)(void *);
+
+/**
+ * @brief Enter a read-side critical section (nestable, lock-free).
+ * Why we made it: Pins the current epoch so nothing we can see gets freed.
+ */
+void rcuReadLock(void);
+
+/**
+ * @brief Leave a read-side critical section.
+ * Why we made it: Lets writers reclaim memory retired before we entered.
+ */
+void rcuReadUnlock(void);
+
+/**
+ * @brief Release this thread's reader slot early (it is also released when
+ *        the thread exits); a no-op inside a read section.
+ * Why we made it: The reader table is fixed-size, so slots must be recycled.
+ */
+void rcuThreadOffline(void);
+
+/**
+ * @brief Serialize writers of one registry (readers are not blocked).
+ * @param reg the registry about to change
+ * Why we made it: Only one thread may relink the ring or a tree at a time.
+ */
+void rcuWriteLock(Registry *reg);
+
+/**
+ * @brief Release the writer lock; reclaim once enough memory is waiting.
+ * @param reg the registry that changed
+ * Why we made it: Pairs with rcuWriteLock(). Reclaiming in batches keeps the
+ * reader-slot scan off the path of every single write.
+ */
+void rcuWriteUnlock(Registry *reg);
+
+/**
+ * @brief Defer freeing an unlinked object until no reader can still see it.
+ * @param ptr object that is no longer reachable from its registry
+ * @param reclaim function that finally frees it
+ * Why we made it: Readers may still be standing on a node we just removed.
+ */
+void rcuRetire(void *ptr, RcuReclaimFunc reclaim);
+
+/**
+ * @brief Free every retired object whose grace period has elapsed.
+ * Why we made it: Cheap, non-blocking cleanup writers run after each change.
+ */
+void rcuReclaim(void);
+
+/**
+ * @brief Wait one grace period, then free everything retired before the call
+ *        (and whatever freeing it retires). Never call it inside a read section.
+ * Why we made it: Used at shutdown so the limbo list never leaks; objects
+ * other threads retire meanwhile wait for the next reclaim.
+ */
+void rcuSynchronize(void);
+
+/* ------------------------------------------------------------
+   15) Whole-Registry Report (Parallel)
+   ------------------------------------------------------------ */
+
+// Same numbering as the options in displayMenu.
+typedef enum
+{
+    ORDER_BFS = 1,
+    ORDER_PRE,
+    ORDER_IN,
+    ORDER_POST,
+    ORDER_ALPHA
+} TraversalOrder;
+
+#define REPORT_CHUNK_OWNERS 64
+
+// Growable text buffer a report worker formats into.
+typedef struct
+{
+    char *text;
+    size_t len;
+    size_t cap;
+} StrBuf;
+
+/**
+ * @brief Append printf-style text to a StrBuf, growing it as needed.
+ * @param sb buffer (zero-initialized before first use)
+ * @param fmt format string
+ * @return 1 on success, 0 if memory ran out
+ * Why we made it: Workers format privately and the buffers are stitched later.
+ */
+int sbAppendf(StrBuf *sb, const char *fmt, ...);
+
+/**
+ * @brief Release the memory held by a StrBuf.
+ * @param sb buffer
+ */
+void sbFree(StrBuf *sb);
+
+/**
+ * @brief Alphabetical traversal that calls visit() on each node in name order.
+ * @param root BST root
+ * @param visit function pointer
+ * Why we made it: Lets the alphabetical display reuse any visit function.
+ */
+void alphabeticalGeneric(PokemonNode *root, VisitNodeFunc visit);
+
+/**
+ * @brief Number of worker threads to use (online CPUs, at least 1).
+ * Why we made it: Shared by every parallel command.
+ */
+int workerThreadCount(void);
+
+/**
+ * @brief Dump every owner's Pokedex, formatted in parallel and written in ring order.
+ * @param reg the registry
+ * @param out destination stream
+ * @param order which traversal to use per Pokedex
+ * @param threads worker threads (<= 0 means workerThreadCount())
+ * Why we made it: Nightly full dumps over huge registries must scale with cores.
+ */
+void generateRegistryReport(Registry *reg, FILE *out, TraversalOrder order, int threads);
+
+/**
+ * @brief Main-menu command: pick a traversal and print the whole-registry report.
+ * @param reg the registry
+ * Why we made it: UI entry for generateRegistryReport().
+ */
+void registryReportMenu(Registry *reg);
+
+/* ------------------------------------------------------------
+   16) Command Observer (Latency Hooks)
+   ------------------------------------------------------------ */
+
+// One entry per command the menus dispatch. Sub-menu commands are reported on
+// their own; "select Pokedex" covers only listing owners and picking one.
+typedef enum
+{
+    CMD_NEW_POKEDEX,
+    CMD_SELECT_POKEDEX,
+    CMD_DELETE_POKEDEX,
+    CMD_MERGE_POKEDEXES,
+    CMD_SORT_OWNERS,
+    CMD_PRINT_CIRCULAR,
+    CMD_EXIT,
+    CMD_REGISTRY_REPORT,
+    CMD_STATS,
+    CMD_ADD_POKEMON,
+    CMD_DISPLAY_POKEDEX,
+    CMD_RELEASE_POKEMON,
+    CMD_FIGHT,
+    CMD_EVOLVE,
+    CMD_BACK_TO_MAIN,
+    CMD_CLONE_POKEDEX,
+    CMD_UNDO,
+    CMD_BULK_ADD,
+    CMD_BULK_RELEASE,
+    CMD_LEADERBOARD,
+    CMD_SIMULATE,
+    CMD_MATCHUP,
+    CMD_PAGED_DISPLAY,
+    CMD_MERGE_MANY,
+    CMD_QUERY,
+    CMD_INVALID,
+    CMD_COUNT
+} CommandKind;
+
+typedef void (*CommandObserver)(CommandKind kind, unsigned long long elapsedNs);
+
+/**
+ * @brief Install (or clear, with NULL) a callback told how long each command took.
+ * @param observer function pointer
+ * Why we made it: Lets a replay driver measure the real menu dispatch.
+ */
+void setCommandObserver(CommandObserver observer);
+
+/**
+ * @brief Return a short stable name for a CommandKind ("add", "fight", ...).
+ * @param kind the enum
+ * Why we made it: Report labels for latency tables.
+ */
+const char *getCommandName(CommandKind kind);
+
+/* ------------------------------------------------------------
+   17) Hot-Path Counters & Statistics
+   ------------------------------------------------------------ */
+
+// Where heap memory is requested (and released again). Each site belongs to
+// one subsystem tag below, whose allocator serves it (see section 32).
+typedef enum
+{
+    ALLOC_SITE_STRDUP,       // myStrdup (Pokemon names)
+    ALLOC_SITE_INPUT,        // the stdin buffer and copies of answers to prompts
+    ALLOC_SITE_POKEMON_NODE, // createPokemonNode, removal replacement nodes, path copies
+    ALLOC_SITE_OWNER,        // createOwner, leaderboard entries, owner summaries
+    ALLOC_SITE_NODE_ARRAY,   // initNodeArray/addNode
+    ALLOC_SITE_BFS_QUEUE,    // BFSGeneric
+    ALLOC_SITE_MERGE_QUEUE,  // mergePokeDex
+    ALLOC_SITE_SORT,         // sortOwners scratch array
+    ALLOC_SITE_RCU_LIMBO,    // rcuRetire bookkeeping
+    ALLOC_SITE_REPORT,       // registry report buffers
+    ALLOC_SITE_NAMES,        // interned owner names and their hash table
+    ALLOC_SITE_FROZEN,       // frozen Pokedex arrays
+    ALLOC_SITE_BATTLE,       // battle simulator workers
+    ALLOC_SITE_VISIT,        // traverseBatched stacks and queues beyond the inline ones
+    ALLOC_SITE_CATALOG,      // species records and name ranks of a loaded catalog
+    ALLOC_SITE_CIRCULAR,     // circular print chunks and line offsets
+    ALLOC_SITE_QUERY,        // query rows and the species indexes behind the planner
+    ALLOC_SITE_BULK,         // bulk add/release ID lists, tables and results
+    ALLOC_SITE_MATCHUP,      // team matchup score arrays and bouts
+    ALLOC_SITE_COUNT
+} AllocSite;
+
+// Subsystems that can each have their own allocator
+typedef enum
+{
+    ALLOC_TAG_OWNERS,  // owners, the ranking and the registry itself
+    ALLOC_TAG_NODES,   // Pokemon nodes and frozen copies
+    ALLOC_TAG_NAMES,   // Pokemon and owner names, the species catalog
+    ALLOC_TAG_SCRATCH, // buffers that live for one command, the RCU limbo
+    ALLOC_TAG_INPUT,   // stdin buffer and answers to prompts
+    ALLOC_TAG_COUNT
+} AllocTag;
+
+typedef struct
+{
+    unsigned long long searchVisits;    // nodes touched by searchPokemon
+    unsigned long long insertVisits;    // nodes touched by insertPokemonNode
+    unsigned long long removeVisits;    // nodes touched by removeNodeBST
+    unsigned long long traversalVisits; // nodes visited by the generic traversals
+    unsigned long long sortComparisons; // name comparisons in sortOwners
+    unsigned long long findComparisons; // names resolved by findOwnerByName
+    unsigned long long pathCopies;      // shared nodes copied before a change
+    unsigned long long allocs[ALLOC_SITE_COUNT];
+    unsigned long long frees[ALLOC_SITE_COUNT];
+    unsigned long long tagAllocs[ALLOC_TAG_COUNT];
+    unsigned long long tagFrees[ALLOC_TAG_COUNT];
+    unsigned long long tagBytes[ALLOC_TAG_COUNT];      // requested, reallocs included
+    unsigned long long tagFreedBytes[ALLOC_TAG_COUNT]; // given back
+} PerfCounters;
+
+// Counters are plain per-thread increments (compile with -DEX6_NO_STATS to
+// drop them). Worker threads fold theirs into the global totals on exit.
+#ifdef EX6_NO_STATS
+#define STAT_ADD(field, n) ((void)(n))
+#else
+extern __thread PerfCounters threadCounters;
+#define STAT_ADD(field, n) (threadCounters.field += (n))
+#endif
+
+/**
+ * @brief Fold this thread's counters into the process-wide totals.
+ * Why we made it: Worker threads call it before exiting so nothing is lost.
+ */
+void perfFlushThread(void);
+
+/**
+ * @brief Read the process-wide counters (including the calling thread's).
+ * @param out filled with the totals
+ * Why we made it: One consistent view for the stats command and the dump.
+ */
+void perfSnapshot(PerfCounters *out);
+
+/**
+ * @brief Name of an allocation site, for reports.
+ * @param site the enum
+ */
+const char *getAllocSiteName(AllocSite site);
+
+/**
+ * @brief Height of a BST (0 for empty).
+ * @param root BST root
+ * Why we made it: Spot owners whose trees degenerated into lists.
+ */
+int treeHeight(PokemonNode *root);
+
+/**
+ * @brief Write counters, allocations and per-owner depths as JSON.
+ * @param reg the registry whose owners are listed
+ * @param out destination stream
+ * Why we made it: Machine-readable dump for dashboards and scripts.
+ */
+void dumpStatsJSON(Registry *reg, FILE *out);
+
+/**
+ * @brief Main-menu command: show the statistics as a table or as JSON.
+ * @param reg the registry
+ * Why we made it: Makes the counters visible without a debugger.
+ */
+void statsMenu(Registry *reg);
+
+/* ------------------------------------------------------------
+   18) Library API (No Prompts, Status Codes)
+   ------------------------------------------------------------ */
+
+// These calls never read stdin or print. They take every argument explicitly,
+// report the outcome as a PokeStatus and hand results back through
+// out-parameters. The menus above are thin wrappers around them. Each call
+// is thread-safe: writers to the same registry are serialized, readers never
+// block. OwnerNode pointers stay valid until that owner is deleted or merged
+// away; sorting relinks the owners and keeps every OwnerNode.
+
+typedef enum
+{
+    POKE_OK = 0,
+    POKE_ERR_INVALID_ARG,    // NULL registry/owner/name
+    POKE_ERR_INVALID_ID,     // not an ID from the species catalog
+    POKE_ERR_NO_MEMORY,
+    POKE_ERR_EMPTY,          // the owner's Pokedex has no Pokemon
+    POKE_ERR_NOT_FOUND,      // the ID is not in the owner's Pokedex
+    POKE_ERR_DUPLICATE,      // the ID is already in the owner's Pokedex
+    POKE_ERR_CANNOT_EVOLVE,
+    POKE_ERR_OWNER_EXISTS,
+    POKE_ERR_SAME_OWNER,
+    POKE_ERR_TOO_FEW_OWNERS,
+    POKE_ERR_NOTHING_TO_UNDO, // the owner has no earlier version kept
+    POKE_ERR_BAD_CATALOG,    // catalog file missing, unreadable or malformed
+    POKE_ERR_CATALOG_LOCKED, // a catalog was already loaded
+    POKE_ERR_ALLOCATOR_BUSY, // the allocator is installed or still holds memory
+    POKE_STATUS_COUNT
+} PokeStatus;
+
+// Species records point into the species catalog and never go away.
+typedef struct
+{
+    const PokemonData *first;
+    const PokemonData *second;
+    double firstScore;
+    double secondScore;
+    int winner; // 1 or 2, 0 for a tie
+} FightResult;
+
+typedef struct
+{
+    const PokemonData *from;
+    const PokemonData *to;
+    int alreadyOwned; // 1 if "to" was owned, so "from" was released instead
+} EvolveResult;
+
+/**
+ * @brief Allocate an empty registry.
+ * @return the registry, or NULL if memory ran out
+ * Why we made it: The handle every library call works on.
+ */
+Registry *registryCreate(void);
+
+/**
+ * @brief Free every owner and then the registry itself.
+ * @param reg registry from registryCreate (NULL is ignored)
+ */
+void registryDestroy(Registry *reg);
+
+/**
+ * @brief Short English description of a status code.
+ * @param status the code
+ * Why we made it: Callers can log failures without their own tables.
+ */
+const char *getStatusMessage(PokeStatus status);
+
+/**
+ * @brief Look up a species in the species catalog.
+ * @param id Pokemon ID
+ * @return the species, or NULL if the ID is out of range
+ */
+const PokemonData *findSpecies(int id);
+
+/**
+ * @brief Create an owner with one starter Pokemon and append it to the ring.
+ * @param reg the registry
+ * @param name owner name (copied)
+ * @param starterId species ID of the starter
+ * @param created optional, receives the new owner
+ * @return POKE_OK, POKE_ERR_OWNER_EXISTS, POKE_ERR_INVALID_ID, ...
+ */
+PokeStatus registryAddOwner(Registry *reg, const char *name, int starterId, OwnerNode **created);
+
+/**
+ * @brief The owner at a 1-based position in ring order.
+ * @param reg the registry
+ * @param position 1 .. reg->count
+ * @return the owner, or NULL if the position is out of range
+ */
+OwnerNode *registryOwnerAt(Registry *reg, int position);
+
+/**
+ * @brief Unlink an owner and free it with its whole Pokedex.
+ * @param reg the registry the owner belongs to
+ * @param owner the owner
+ * @return POKE_OK or POKE_ERR_INVALID_ARG
+ */
+PokeStatus registryDeleteOwner(Registry *reg, OwnerNode *owner);
+
+/**
+ * @brief Copy every Pokemon of "from" into "into", then delete "from".
+ * @param reg the registry both owners belong to
+ * @param into destination owner
+ * @param from source owner (kept if the copy runs out of memory)
+ * @return POKE_OK, POKE_ERR_SAME_OWNER, POKE_ERR_NO_MEMORY, ...
+ */
+PokeStatus registryMergeOwners(Registry *reg, OwnerNode *into, OwnerNode *from);
+
+/**
+ * @brief Sort the ring by owner name.
+ * @param reg the registry
+ * @return POKE_OK, POKE_ERR_TOO_FEW_OWNERS or POKE_ERR_NO_MEMORY
+ * Why we made it: The owners are relinked in place under the writer lock, so
+ * every OwnerNode pointer stays valid. A reader walking the ring meanwhile
+ * may meet an owner twice or miss one, but never leaves the ring; its walk is
+ * bounded by the owner count. Lookups by name do not walk the ring, so a
+ * sort never hides an owner from them.
+ */
+PokeStatus registrySortOwners(Registry *reg);
+
+/**
+ * @brief Add one Pokemon to an owner's Pokedex.
+ * @param reg the registry
+ * @param owner the owner
+ * @param id Pokemon ID
+ * @param added optional, receives the species added
+ * @return POKE_OK, POKE_ERR_INVALID_ID, POKE_ERR_DUPLICATE or POKE_ERR_NO_MEMORY
+ */
+PokeStatus pokedexAddPokemon(Registry *reg, OwnerNode *owner, int id, const PokemonData **added);
+
+/**
+ * @brief Release one Pokemon from an owner's Pokedex.
+ * @param reg the registry
+ * @param owner the owner
+ * @param id Pokemon ID
+ * @param released optional, receives the species released
+ * @return POKE_OK, POKE_ERR_EMPTY or POKE_ERR_NOT_FOUND
+ */
+PokeStatus pokedexReleasePokemon(Registry *reg, OwnerNode *owner, int id, const PokemonData **released);
+
+/**
+ * @brief Evolve a Pokemon (ID -> ID+1); if ID+1 is owned, release ID instead.
+ * @param reg the registry
+ * @param owner the owner
+ * @param id Pokemon ID
+ * @param result receives both species (from is set for POKE_ERR_CANNOT_EVOLVE too)
+ * @return POKE_OK, POKE_ERR_EMPTY, POKE_ERR_NOT_FOUND, POKE_ERR_CANNOT_EVOLVE, ...
+ */
+PokeStatus pokedexEvolvePokemon(Registry *reg, OwnerNode *owner, int id, EvolveResult *result);
+
+/**
+ * @brief Score two of an owner's Pokemon against each other (read-only).
+ * @param owner the owner
+ * @param firstId ID of the first Pokemon
+ * @param secondId ID of the second Pokemon
+ * @param result receives the species, scores and winner
+ * @return POKE_OK or POKE_ERR_NOT_FOUND
+ */
+PokeStatus pokedexFight(OwnerNode *owner, int firstId, int secondId, FightResult *result);
+
+/* ------------------------------------------------------------
+   19) Interned Owner Names
+   ------------------------------------------------------------ */
+
+// Each registry keeps one copy of every owner name with its length, hash and
+// an 8-byte ordering prefix. Name equality is a pointer compare, ordering
+// usually settles on the prefix, and a lookup for a name nobody has is a miss
+// in the hash table without walking the ring. Entries are reference counted
+// and handed to rcuRetire() when the last reference goes, so a reader holding
+// a pointer it looked up never sees the address reused.
+
+/**
+ * @brief Prepare an empty table.
+ * @param table the table
+ * @return 1 on success, 0 if memory ran out
+ */
+int nameTableInit(NameTable *table);
+
+/**
+ * @brief Free the bucket array (every name must have been released).
+ * @param table the table
+ */
+void nameTableFree(NameTable *table);
+
+/**
+ * @brief Get the interned copy of a name, creating it if needed.
+ * @param table the table
+ * @param text name bytes (need not be NUL-terminated)
+ * @param len number of bytes
+ * @return a new reference to the entry, or NULL if memory ran out
+ * Why we made it: Reading a name that already exists allocates nothing.
+ */
+InternedName *internName(NameTable *table, const char *text, size_t len);
+
+/**
+ * @brief Find a name without creating it or taking a reference.
+ * @param table the table
+ * @param text name bytes
+ * @param len number of bytes
+ * @return the entry or NULL; only valid inside rcuReadLock()
+ */
+const InternedName *lookupName(NameTable *table, const char *text, size_t len);
+
+/**
+ * @brief Take another reference to an entry the caller already holds.
+ * @param name the entry
+ * @return name
+ */
+InternedName *retainName(InternedName *name);
+
+/**
+ * @brief Drop a reference taken by internName (NULL is ignored).
+ * @param name the entry
+ */
+void releaseName(InternedName *name);
+
+/**
+ * @brief strcmp-compatible ordering of two interned names.
+ * @return <0, 0 or >0
+ * Why we made it: The cached prefixes decide most comparisons without
+ * touching the text.
+ */
+int compareInternedNames(const InternedName *a, const InternedName *b);
+
+/* ------------------------------------------------------------
+   20) Frozen Pokedex (Eytzinger Array)
+   ------------------------------------------------------------ */
+
+// A Pokedex that is mostly queried can be frozen into a flat array laid out
+// in Eytzinger (level) order: the root at index 1, the children of i at 2i
+// and 2i+1. Searching it is branch-free and the first levels share cache
+// lines. The frozen copy is dropped by the next change to that Pokedex.
+struct FrozenPokedex
+{
+    int count;
+    int *keys;                   // keys[1..count]; keys[0] is unused
+    const PokemonData **species; // species[i] belongs to keys[i]
+};
+
+/**
+ * @brief Build a frozen copy of a BST.
+ * @param root BST root
+ * @return the copy (NULL for an empty tree or if memory ran out)
+ */
+FrozenPokedex *freezeTree(PokemonNode *root);
+
+/**
+ * @brief Free a frozen copy (NULL is ignored).
+ * @param frozen the copy
+ */
+void freeFrozen(FrozenPokedex *frozen);
+
+/**
+ * @brief Branch-free search of a frozen copy.
+ * @param frozen the copy
+ * @param id Pokemon ID
+ * @return the species, or NULL if the ID is not in it
+ */
+const PokemonData *frozenSearch(const FrozenPokedex *frozen, int id);
+
+/**
+ * @brief Freeze an owner's Pokedex for fast lookups until it next changes.
+ * @param reg the registry
+ * @param owner the owner
+ * @return POKE_OK, POKE_ERR_EMPTY or POKE_ERR_NO_MEMORY
+ */
+PokeStatus pokedexFreeze(Registry *reg, OwnerNode *owner);
+
+/**
+ * @brief Look up one Pokemon (uses the frozen copy when there is one).
+ * @param owner the owner
+ * @param id Pokemon ID
+ * @param found optional, receives the species
+ * @return POKE_OK or POKE_ERR_NOT_FOUND
+ */
+PokeStatus pokedexFindPokemon(OwnerNode *owner, int id, const PokemonData **found);
+
+/* ------------------------------------------------------------
+   21) Persistent Pokedexes (Snapshots, Clones, Undo)
+   ------------------------------------------------------------ */
+
+// Every node counts the parents and roots pointing at it, so one subtree can
+// belong to several versions of a Pokedex. Taking a version is O(1): bump the
+// root's count. A change copies only the shared nodes on its search path
+// (O(log n) of them in a balanced tree) and edits private nodes in place, so
+// a version nobody else holds costs nothing extra. Nodes reachable from a
+// held version are never written again, which makes a snapshot safe to walk
+// without rcuReadLock(). Each owner keeps its last reg->undoDepth versions
+// for pokedexUndo(). A new registry keeps none: with history on, every change
+// copies its whole search path, which on a degenerate tree is the whole tree.
+// The interactive program turns it on.
+
+/**
+ * @brief Take another reference to a whole tree (NULL is fine).
+ * @param root BST root
+ * @return root
+ */
+PokemonNode *retainTree(PokemonNode *root);
+
+/**
+ * @brief Point-in-time copy of an owner's Pokedex in O(1).
+ * @param reg the registry
+ * @param owner the owner
+ * @return the root of the frozen version (NULL if empty); release it with
+ *         pokedexSnapshotRelease()
+ * Why we made it: Long reads see one consistent Pokedex and never hold up
+ * the writers or memory reclamation.
+ */
+PokemonNode *pokedexSnapshot(Registry *reg, OwnerNode *owner);
+
+/**
+ * @brief Give back a snapshot (NULL is ignored).
+ * @param root what pokedexSnapshot returned
+ */
+void pokedexSnapshotRelease(PokemonNode *root);
+
+/**
+ * @brief Add an owner whose Pokedex starts as a copy of another's, in O(1).
+ * @param reg the registry
+ * @param source owner to copy
+ * @param name the new owner's name
+ * @param created optional, receives the new owner
+ * @return POKE_OK, POKE_ERR_OWNER_EXISTS, POKE_ERR_NO_MEMORY, ...
+ */
+PokeStatus registryCloneOwner(Registry *reg, OwnerNode *source, const char *name, OwnerNode **created);
+
+/**
+ * @brief Put back the owner's Pokedex as it was before the last change.
+ * @param reg the registry
+ * @param owner the owner
+ * @return POKE_OK or POKE_ERR_NOTHING_TO_UNDO
+ */
+PokeStatus pokedexUndo(Registry *reg, OwnerNode *owner);
+
+/**
+ * @brief Set how many earlier versions each owner keeps (clamped to
+ *        0..POKEDEX_UNDO_DEPTH; 0 turns undo off and every change in place).
+ * @param reg the registry
+ * @param depth versions per owner
+ */
+void registrySetUndoDepth(Registry *reg, int depth);
+
+/**
+ * @brief Main-menu command: clone a Pokedex under a new owner name.
+ * @param reg the registry
+ */
+void clonePokedexMenu(Registry *reg);
+
+/**
+ * @brief Sub-menu command: undo the owner's last change.
+ * @param reg the registry
+ * @param owner the owner
+ */
+void undoLastChange(Registry *reg, OwnerNode *owner);
+
+/* ------------------------------------------------------------
+   22) Bulk Add & Release
+   ------------------------------------------------------------ */
+
+// IDs are deduplicated and sorted by marking them in a table indexed by ID,
+// so a bulk command costs O(k + speciesCount()) before it touches the tree,
+// and the tree is changed once under the writer lock however many IDs come.
+
+// What a bulk command did, ID by ID, each list in ascending order. The lists
+// are sized to the IDs asked for; release them with bulkResultFree.
+typedef struct
+{
+    int *done;                 // IDs added / released
+    int doneCount;
+    int *skipped;              // IDs already in the Pokedex / not in it
+    int skippedCount;
+    int invalidCount;          // IDs not in the species catalog
+} BulkResult;
+
+/**
+ * @brief Add many Pokemon at once and rebuild the Pokedex as a balanced tree.
+ * @param reg the registry
+ * @param owner the owner
+ * @param ids IDs in any order, duplicates allowed
+ * @param count number of IDs
+ * @param result receives what was added and what was skipped
+ * @return POKE_OK (see result), POKE_ERR_NO_MEMORY or POKE_ERR_INVALID_ARG
+ * Why we made it: The existing nodes and the new IDs are merged in ID order
+ * and the tree is rebuilt in O(n + k), instead of k root-to-leaf inserts
+ * that turn into a list when the IDs come sorted.
+ */
+PokeStatus pokedexAddMany(Registry *reg, OwnerNode *owner, const int *ids, int count, BulkResult *result);
+
+/**
+ * @brief Sub-menu command: read an ID list and add every Pokemon on it.
+ * @param reg the registry
+ * @param owner the owner
+ */
+void bulkAddPokemon(Registry *reg, OwnerNode *owner);
+
+/**
+ * @brief Release many Pokemon at once.
+ * @param reg the registry
+ * @param owner the owner
+ * @param ids IDs in any order, duplicates allowed
+ * @param count number of IDs
+ * @param result receives what was released and what was not found
+ * @return POKE_OK (see result), POKE_ERR_NO_MEMORY or POKE_ERR_INVALID_ARG
+ * Why we made it: Each run of consecutive IDs is cut out of the tree with
+ * two splits and one join, O(log n) plus freeing what was cut, instead of
+ * a search and a removal per ID. Splits copy only their own path, so clones,
+ * snapshots and readers keep the tree they had.
+ */
+PokeStatus pokedexReleaseMany(Registry *reg, OwnerNode *owner, const int *ids, int count, BulkResult *result);
+
+/**
+ * @brief Free the lists of a BulkResult (safe after a failed call too).
+ * @param result the result
+ * Why we made it: The lists are sized to the request, not to the largest
+ * catalog, so they live on the heap.
+ */
+void bulkResultFree(BulkResult *result);
+
+/**
+ * @brief Sub-menu command: read an ID list and release every Pokemon on it.
+ * @param reg the registry
+ * @param owner the owner
+ */
+void bulkReleasePokemon(Registry *reg, OwnerNode *owner);
+
+/* ------------------------------------------------------------
+   23) Pokemon Handles
+   ------------------------------------------------------------ */
+
+#define HANDLE_PATH_MAX 64 // Ancestors a handle keeps; deeper Pokemon are edited by ID
+
+// A handle remembers where a search found a Pokemon, so releasing or
+// replacing it afterwards needs no second descent. It is trusted only while
+// owner->version is the one it was taken at; after any other change the
+// handle searches again by ID. Sorting the owners leaves it valid. Once the
+// owner is deleted or merged away the handle answers POKE_ERR_NOT_FOUND:
+// if any owner left the ring since it was taken, the owner is looked up in
+// the ring by address and serial before anything is dereferenced.
+typedef struct
+{
+    OwnerNode *owner;
+    unsigned long serial;       // owner->serial when the handle was taken
+    unsigned long ownersRemoved; // reg->ownersRemoved the owner was last seen at
+    int id;                     // ID the handle refers to
+    const PokemonData *species; // Species at that ID
+    unsigned long version;      // owner->version the fields below belong to
+    PokemonNode **link;         // Where the node hangs in the tree
+    PokemonNode *path[HANDLE_PATH_MAX]; // Its ancestors, root first, if they fit
+    int depth;                  // Ancestors, kept or not
+    int prevId;                 // In-order neighbours (0 if none)
+    int nextId;
+    int shared;                 // Some node on the path is shared (section 21)
+} PokemonHandle;
+
+/**
+ * @brief Find a Pokemon and take a handle to it.
+ * @param reg the registry
+ * @param owner the owner
+ * @param id Pokemon ID
+ * @param handle receives the handle
+ * @return POKE_OK, POKE_ERR_EMPTY or POKE_ERR_NOT_FOUND
+ * Why we made it: Search once, then act on the result without searching
+ * again.
+ */
+PokeStatus pokedexFindHandle(Registry *reg, OwnerNode *owner, int id, PokemonHandle *handle);
+
+/**
+ * @brief Release the Pokemon a handle refers to.
+ * @param reg the registry
+ * @param handle a handle from pokedexFindHandle
+ * @param released optional, receives the species released
+ * @return POKE_OK, POKE_ERR_NOT_FOUND (it or its owner is gone) or POKE_ERR_NO_MEMORY
+ * Why we made it: A fresh handle goes straight to the node's link.
+ */
+PokeStatus pokedexReleaseHandle(Registry *reg, PokemonHandle *handle, const PokemonData **released);
+
+/**
+ * @brief Replace the Pokemon a handle refers to with another species.
+ * @param reg the registry
+ * @param handle a handle from pokedexFindHandle; refers to newId afterwards
+ * @param newId ID of the new species
+ * @return POKE_OK, POKE_ERR_INVALID_ID, POKE_ERR_DUPLICATE, POKE_ERR_NOT_FOUND
+ *         or POKE_ERR_NO_MEMORY (the old Pokemon is still there)
+ * Why we made it: When no owned ID lies between the two, a new node takes
+ * the old one's place and children, with no rebalancing walk; otherwise it
+ * is an add plus a release, in that order.
+ */
+PokeStatus pokedexReplaceHandle(Registry *reg, PokemonHandle *handle, int newId);
+
+/* ------------------------------------------------------------
+   24) Pokedex Aggregates
+   ------------------------------------------------------------ */
+
+// Every node keeps the size, HP and attack totals and the strongest species
+// of its subtree, recomputed from its children on the way back up from each
+// edit, so the root always holds the totals for the whole Pokedex. The type
+// histogram lives in the owner and changes by one per Pokemon added or
+// released. Both are edited in place under the writer lock, so once a change
+// is done the writer copies them into a fresh summary record and publishes
+// it with RCU_ASSIGN. Readers take that record whole, O(1) per owner.
+
+struct PokedexSummary
+{
+    int count;
+    int totalHp;
+    int totalAttack;
+    const PokemonData *strongest; // Highest fight score (NULL if empty)
+    int maxDepth;                 // Deepest the tree has been, as in OwnerNode
+    int typeCount[POKEMON_TYPE_COUNT];
+};
+
+/**
+ * @brief Read an owner's totals without walking the Pokedex.
+ * @param reg the registry
+ * @param owner the owner
+ * @param summary receives the totals
+ * @return POKE_OK or POKE_ERR_INVALID_ARG
+ * Why we made it: Dashboards poll every owner; this costs the same for one
+ * Pokemon or a full catalog, and runs as a reader, never waiting for writers
+ * (unless memory ran out at the owner's last change).
+ */
+PokeStatus pokedexSummary(Registry *reg, OwnerNode *owner, PokedexSummary *summary);
+
+/* ------------------------------------------------------------
+   25) Power Leaderboard
+   ------------------------------------------------------------ */
+
+// A skip list of owners ordered by power (highest first, then by name). Each
+// link also stores how many owners it jumps over, so the descent that finds
+// an owner counts the owners ahead of it. Every writer that changes a
+// Pokedex moves its owner before releasing the lock: O(log n) per change,
+// and reading a rank or the top of the board never walks the registry.
+// The board has a read-write lock of its own. Writers take it only around
+// the unlink and relink of an entry, never for a whole command, so reads
+// share it with each other and wait at most for one O(log n) move, not for
+// writers still working on their Pokedex.
+
+#define LEADERBOARD_MAX_LEVEL 16 // Enough for 4^16 owners
+
+typedef struct
+{
+    RankNode *next;
+    int span;                 // Owners stepped over, next included
+} RankLink;
+
+struct RankNode
+{
+    OwnerNode *owner;
+    long long power;          // Power when it was last placed
+    int count;                // Pokemon in the Pokedex then
+    int ranked;               // On the board (the owner is in the registry)
+    int level;
+    RankLink links[];         // links[0..level)
+};
+
+typedef struct
+{
+    OwnerNode *owner;
+    int rank;                 // 1 for the strongest owner
+    long long power;          // Sum of fight scores over the Pokedex, times ten
+    int count;                // Pokemon in the Pokedex
+} LeaderboardEntry;
+
+/**
+ * @brief Read part of the leaderboard.
+ * @param reg the registry
+ * @param first rank of the first entry (1 for the top)
+ * @param max room in entries
+ * @param entries receives up to max owners, strongest first
+ * @param count receives how many were written
+ * @return POKE_OK or POKE_ERR_INVALID_ARG
+ * Why we made it: Finding where the page starts costs O(log n); only the
+ * owners on the page are visited after that. Takes the board's read lock,
+ * not the registry's writer lock.
+ */
+PokeStatus registryLeaderboard(Registry *reg, int first, int max, LeaderboardEntry *entries, int *count);
+
+/**
+ * @brief Find an owner's place on the leaderboard.
+ * @param reg the registry
+ * @param owner an owner of that registry
+ * @param entry receives the rank, power and size
+ * @return POKE_OK or POKE_ERR_INVALID_ARG
+ * Why we made it: One descent of the skip list, whatever the owner's rank,
+ * under the board's read lock.
+ */
+PokeStatus registryOwnerRank(Registry *reg, OwnerNode *owner, LeaderboardEntry *entry);
+
+/**
+ * @brief Main-menu command: show the ten strongest owners.
+ * @param reg the registry
+ */
+void leaderboardMenu(Registry *reg);
+
+/* ------------------------------------------------------------
+   26) Battle Simulator
+   ------------------------------------------------------------ */
+
+// A battle is fought in rounds until one side faints. Each round a coin flip
+// picks who strikes first; a hit deals attack times the type multiplier
+// times a random roll (217..255 out of 256, doubled on a 1-in-16 critical),
+// and the other side answers only if it is still standing.
+// BATTLE_LANES battles are stepped side by side, each lane with its own RNG
+// state, in branch-free loops the compiler turns into vector code. Work is
+// handed out in chunks whose seeds come from the caller's seed and the chunk
+// number, so a seed gives the same result on any number of threads.
+
+#define BATTLE_LANES 8          // Battles stepped together
+#define BATTLE_CHUNK 4096       // Battles per work item (a multiple of BATTLE_LANES)
+#define BATTLE_MAX_ROUNDS 100   // Nobody fainted by then: a draw (e.g. both immune)
+
+typedef struct
+{
+    const PokemonData *first;
+    const PokemonData *second;
+    long long battles;
+    long long firstWins;
+    long long secondWins;
+    long long draws;
+    double firstWinRate;        // firstWins / battles
+    double secondWinRate;
+    double averageRounds;
+} BattleStats;
+
+/**
+ * @brief Damage multiplier of an attack of one type against another.
+ * @param attacker attacking type
+ * @param defender defending type
+ * @return 0, 0.5, 1 or 2
+ */
+double typeEffectiveness(PokemonType attacker, PokemonType defender);
+
+/**
+ * @brief Fight two species many times and count the outcomes.
+ * @param first first species
+ * @param second second species
+ * @param battles how many battles to fight (> 0)
+ * @param seed same seed, same result
+ * @param threads worker threads (0 or less: one per core)
+ * @param stats receives the counts and rates
+ * @return POKE_OK, POKE_ERR_INVALID_ARG or POKE_ERR_NO_MEMORY
+ * Why we made it: Win probabilities need millions of battles per matchup;
+ * lanes and threads make that a fraction of a second.
+ */
+PokeStatus simulateBattles(const PokemonData *first, const PokemonData *second, long long battles,
+                           unsigned long long seed, int threads, BattleStats *stats);
+
+/**
+ * @brief simulateBattles for two of an owner's Pokemon (read-only).
+ * @param owner the owner
+ * @param firstId ID of the first Pokemon
+ * @param secondId ID of the second Pokemon
+ * @param battles how many battles to fight (> 0)
+ * @param seed same seed, same result
+ * @param threads worker threads (0 or less: one per core)
+ * @param stats receives the counts and rates
+ * @return POKE_OK, POKE_ERR_NOT_FOUND, POKE_ERR_INVALID_ARG or POKE_ERR_NO_MEMORY
+ */
+PokeStatus pokedexSimulateBattles(OwnerNode *owner, int firstId, int secondId, long long battles,
+                                  unsigned long long seed, int threads, BattleStats *stats);
+
+/**
+ * @brief Sub-menu command: simulate battles between two Pokemon and show the odds.
+ * @param owner the owner
+ */
+void simulateBattlesMenu(OwnerNode *owner);
+
+/* ------------------------------------------------------------
+   27) Team Matchup
+   ------------------------------------------------------------ */
+
+// Two owners line up for min(n, m) one-on-one bouts, each Pokemon fighting
+// at most once; a bout goes to the higher fight score (as in pokedexFight).
+// The lineup is chosen for the first owner, scoring 2 per win and 1 per tie
+// (the same as maximizing wins minus losses). Both Pokedexes are snapshotted
+// and copied into contiguous score arrays once; the solvers only read those,
+// and no bigger scratch than the arrays is needed.
+//
+// The greedy solver sorts both sides and plays the classic "Tian Ji" lineup:
+// beat their best when you can, otherwise spend your weakest on it.
+// O(n log n), and optimal for this scoring. The exact solver runs the
+// Hungarian algorithm on the full win/tie/loss matrix, O(n^2 m), to audit it.
+
+typedef enum
+{
+    MATCHUP_GREEDY,
+    MATCHUP_EXACT
+} MatchupMethod;
+
+typedef struct
+{
+    const PokemonData *mine;    // From the first owner
+    const PokemonData *theirs;  // From the second owner
+    int outcome;                // 1 win, 0 tie, -1 loss for the first owner
+} MatchupBout;
+
+// Bouts in ascending ID order of the first owner's Pokemon; release them
+// with matchupResultFree
+typedef struct
+{
+    MatchupBout *bouts;
+    int boutCount;
+    int wins;
+    int ties;
+    int losses;
+} MatchupResult;
+
+/**
+ * @brief Pick the first owner's best lineup against the second.
+ * @param reg the registry
+ * @param mine the owner the lineup is chosen for
+ * @param theirs the opponent
+ * @param method MATCHUP_GREEDY or MATCHUP_EXACT
+ * @param result receives the bouts and the tally
+ * @return POKE_OK, POKE_ERR_EMPTY, POKE_ERR_SAME_OWNER, POKE_ERR_INVALID_ARG
+ *         or POKE_ERR_NO_MEMORY
+ * Why we made it: Owner-versus-owner battles used to be one hand-picked
+ * pair at a time.
+ */
+PokeStatus pokedexTeamMatchup(Registry *reg, OwnerNode *mine, OwnerNode *theirs, MatchupMethod method,
+                              MatchupResult *result);
+
+/**
+ * @brief Free the bouts of a MatchupResult (safe after a failed call too).
+ * @param result the result
+ * Why we made it: The bouts are sized to the smaller team, so they live on
+ * the heap.
+ */
+void matchupResultFree(MatchupResult *result);
+
+/**
+ * @brief Main-menu command: read two owner names and show the best lineup.
+ * @param reg the registry
+ */
+void teamMatchupMenu(Registry *reg);
+
+/* ------------------------------------------------------------
+   28) Paginated Display (Cursors)
+   ------------------------------------------------------------ */
+
+// A cursor is a plain value: hand it back (or send it over the wire) to get
+// the next page. Each page is read from the live Pokedex in its own read
+// section, and each order resumes without replaying the pages before it:
+// - ID order: descend to the first ID after the last one returned, O(log n).
+// - Pre- and post-order: select the entry at the position by subtree sizes,
+//   O(log n). Positions shift if the Pokedex changes between pages.
+// - BFS: one BST level, left to right, is in ascending ID order, so the
+//   level and the last ID on it are enough to resume.
+// - Alphabetical: the species table in name order, from the last name on.
+// Then a page of k costs O(k) more (alphabetical: one search per species).
+
+typedef struct
+{
+    TraversalOrder order;
+    int lastId;                 // Last ID returned (ID, BFS, alphabetical); 0 at the start
+    int depth;                  // BFS: level of lastId, 0 for the root
+    int position;               // Pre- and post-order: entries returned so far
+    int done;                   // Nothing follows the page just returned
+} PokedexCursor;
+
+/**
+ * @brief Start a cursor at the first entry of an order.
+ * @param cursor the cursor
+ * @param order any TraversalOrder
+ */
+void pokedexCursorInit(PokedexCursor *cursor, TraversalOrder order);
+
+/**
+ * @brief Read the next page of an owner's Pokedex.
+ * @param reg the registry (each page is read from a snapshot taken under its
+ *        writer lock, so concurrent edits never move the sizes it steers by)
+ * @param owner the owner
+ * @param cursor where the previous page ended; advanced past this one
+ * @param entries receives up to max species
+ * @param max page size (> 0)
+ * @param count receives how many were written
+ * @return POKE_OK, POKE_ERR_INVALID_ARG or POKE_ERR_NO_MEMORY (the cursor
+ *         stays where it was)
+ * Why we made it: Latency per page stays bounded however big the Pokedex
+ * is, on a slow terminal or socket.
+ */
+PokeStatus pokedexNextPage(Registry *reg, OwnerNode *owner, PokedexCursor *cursor, const PokemonData **entries,
+                           int max, int *count);
+
+/**
+ * @brief Sub-menu command: show the Pokedex a page at a time in any order.
+ * @param reg the registry
+ * @param owner the owner
+ */
+void pagedDisplayMenu(Registry *reg, OwnerNode *owner);
+
+/* ------------------------------------------------------------
+   29) Visitors with Context
+   ------------------------------------------------------------ */
+
+// The section 4 traversals take a bare function, so a filter or a search has
+// to keep its state in globals and always sees every node. These walkers pass
+// a context pointer along and stop as soon as the visitor says so. The
+// batched form hands over up to VISIT_BATCH nodes per call, so the indirect
+// call is paid once per batch; the per-node form runs on top of it. All five
+// orders are iterative, so deep trees cannot overflow the call stack. As
+// with the other traversals, the caller keeps the tree alive (read section or
+// snapshot).
+
+#define VISIT_BATCH 64
+
+typedef enum
+{
+    VISIT_CONTINUE,
+    VISIT_STOP
+} VisitResult;
+
+typedef VisitResult (*VisitNodeCtxFunc)(PokemonNode *node, void *context);
+typedef VisitResult (*VisitBatchFunc)(PokemonNode **nodes, int count, void *context);
+
+/**
+ * @brief Walk a tree in any order, handing the visitor batches of nodes.
+ * @param root BST root
+ * @param order traversal order
+ * @param visit called with 1..VISIT_BATCH nodes at a time, in order
+ * @param context passed to every call
+ * @return VISIT_STOP if the visitor stopped the walk, else VISIT_CONTINUE
+ * Why we made it: One indirect call per batch instead of per node.
+ */
+VisitResult traverseBatched(PokemonNode *root, TraversalOrder order, VisitBatchFunc visit, void *context);
+
+/**
+ * @brief Walk a tree in any order, one node per call, until the visitor stops.
+ * @param root BST root
+ * @param order traversal order
+ * @param visit called for each node in order
+ * @param context passed to every call
+ * @return VISIT_STOP if the visitor stopped the walk, else VISIT_CONTINUE
+ * Why we made it: Searches and filters keep their state in the context and
+ * end the walk at the first hit.
+ */
+VisitResult traverseWith(PokemonNode *root, TraversalOrder order, VisitNodeCtxFunc visit, void *context);
+
+/* ------------------------------------------------------------
+   30) Species Catalog
+   ------------------------------------------------------------ */
+
+// Every species lookup goes through the active catalog: the pokedex table at
+// the end of this file, unless a catalog file was loaded at startup. A
+// catalog file is memory-mapped and used in place. Its layout, in the byte
+// order of the machine that wrote it:
+//   CatalogFileHeader
+//   CatalogFileRecord[count]   ID i + 1 at index i
+//   uint32_t byName[count]     IDs sorted by name (strcmp)
+//   char names[namesSize]      NUL-terminated names, at record.nameOffset
+// Build one from a CSV list with the catalog tool (catalog.c).
+
+#define CATALOG_MAGIC "EX6CAT\r\n"
+#define CATALOG_VERSION 1
+#define CATALOG_BYTE_ORDER 0x01020304u
+#define CATALOG_MAX_STAT 9999    // hp and attack are 0..CATALOG_MAX_STAT
+
+typedef struct
+{
+    char magic[8];           // CATALOG_MAGIC, without its NUL
+    uint32_t version;        // CATALOG_VERSION
+    uint32_t byteOrder;      // CATALOG_BYTE_ORDER as the writer stored it
+    uint32_t count;          // Species, IDs 1..count
+    uint32_t namesSize;      // Bytes in the name pool
+} CatalogFileHeader;
+
+typedef struct
+{
+    uint32_t nameOffset;     // Into the name pool
+    uint32_t type;           // PokemonType
+    int32_t hp;
+    int32_t attack;
+    uint32_t evolvesTo;      // ID of the next stage, 0 if none
+} CatalogFileRecord;
+
+typedef struct
+{
+    const PokemonData *species;  // species[id - 1]
+    int count;
+    const uint32_t *evolvesTo;   // evolvesTo[id - 1]; NULL means id + 1 when CAN_EVOLVE
+    const uint32_t *byName;      // IDs in name order
+    const uint32_t *nameRank;    // nameRank[id - 1]: position of id in byName
+} SpeciesCatalog;
+
+/**
+ * @brief Replace the built-in species table with a catalog file.
+ * @param path catalog file written by the catalog tool
+ * @return POKE_OK, POKE_ERR_BAD_CATALOG, POKE_ERR_CATALOG_LOCKED or POKE_ERR_NO_MEMORY
+ * Why we made it: Later generations and custom forms without a rebuild.
+ * Call it once at startup, before any other thread runs and before the first
+ * Pokemon exists: nodes keep pointers into the catalog, so it stays mapped
+ * for the life of the process.
+ */
+PokeStatus speciesCatalogLoad(const char *path);
+
+/**
+ * @brief The active catalog, name index included.
+ * @return the catalog (never NULL)
+ */
+const SpeciesCatalog *speciesCatalog(void);
+
+/**
+ * @brief Number of species in the active catalog.
+ * @return the highest valid ID
+ */
+int speciesCount(void);
+
+/**
+ * @brief Look up a species by exact name.
+ * @param name species name
+ * @return the species, or NULL if no species has that name
+ * Why we made it: A binary search over the name index, not a scan.
+ */
+const PokemonData *findSpeciesByName(const char *name);
+
+/**
+ * @brief The species a Pokemon evolves into.
+ * @param species a species from the catalog
+ * @return the next stage, or NULL if it cannot evolve
+ */
+const PokemonData *speciesEvolution(const PokemonData *species);
+
+/* ------------------------------------------------------------
+   31) Merge Many Owners
+   ------------------------------------------------------------ */
+
+// Folding hundreds of owners into one with two-way merges copies the target
+// over and over. Here every source Pokedex is flattened once (by several
+// threads when there is enough of them) into a table indexed by ID, which
+// merges and deduplicates them in one pass; the target is rebuilt as a
+// balanced tree and the sources leave the ring together, all under one
+// writer lock.
+
+// Sources a merge worker claims at a time
+#define MERGE_CHUNK_OWNERS 16
+// Fewer Pokemon than this in all are flattened by the calling thread alone
+#define MERGE_PARALLEL_MIN 32768
+
+typedef struct
+{
+    int ownersMerged;  // Source owners folded in and removed
+    int pokemonAdded;  // Species the target did not have before
+} MergeManyResult;
+
+/**
+ * @brief Collect the owners whose names match a pattern, in ring order.
+ * @param reg the registry
+ * @param pattern shell-style pattern (* ? [...]), as fnmatch() reads it
+ * @param out receives up to max owners (may be NULL when max is 0)
+ * @param max room in out
+ * @return how many owners match, which may be more than max
+ */
+int registryFindOwners(Registry *reg, const char *pattern, OwnerNode **out, int max);
+
+/**
+ * @brief Merge many owners into one and remove them, in one step.
+ * @param reg the registry
+ * @param into owner that receives every Pokemon
+ * @param sources owners to merge away; NULL entries, repeats and into itself are skipped
+ * @param count entries in sources
+ * @param threads workers for the flattening (0 = one per CPU)
+ * @param result optional, what the merge did
+ * @return POKE_OK, POKE_ERR_TOO_FEW_OWNERS (nothing to merge), POKE_ERR_NO_MEMORY, ...
+ * Why we made it: Retiring a whole region costs one pass, not one merge per owner.
+ * On failure nothing changes. Like registryMergeOwners, it can be undone on
+ * the target, but the removed owners do not come back.
+ */
+PokeStatus registryMergeMany(Registry *reg, OwnerNode *into, OwnerNode *const *sources, int count, int threads,
+                             MergeManyResult *result);
+
+/**
+ * @brief Main-menu command: merge a list or a pattern of owners into one.
+ * @param reg the registry
+ */
+void mergeManyMenu(Registry *reg);
+
+/* ------------------------------------------------------------
+   32) Pluggable Allocators
+   ------------------------------------------------------------ */
+
+// Every heap block the program uses comes from the allocator installed for
+// its subsystem tag (malloc unless told otherwise). A small header in front
+// of each block remembers which allocator made it and how big it is, so
+// allocators can be swapped at any time and live bytes are known per tag.
+// Sizes given to an allocator include that header.
+
+typedef struct Allocator
+{
+    const char *name;  // for reports ("malloc", "pool", "bump", ...)
+    void *state;       // passed back to every call
+    void *(*alloc)(void *state, size_t size);
+    // Optional: without it a resize is alloc + copy + release
+    void *(*resize)(void *state, void *ptr, size_t oldSize, size_t newSize);
+    void (*release)(void *state, void *ptr, size_t size);
+    // Optional: bytes currently taken from the system
+    size_t (*reserved)(void *state);
+} Allocator;
+
+// Blocks a pool carves out of each slab it takes from malloc
+#define POOL_BLOCKS_PER_SLAB 256
+// Bytes a bump allocator takes from malloc at a time
+#define BUMP_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Install the allocator that serves a tag from now on.
+ * @param tag subsystem
+ * @param allocator NULL restores malloc; must outlive every block it hands out
+ * @return POKE_OK or POKE_ERR_INVALID_ARG
+ * Why we made it: Swap in pool or bump allocators per subsystem. Blocks
+ * already handed out still go back to the allocator that made them.
+ */
+PokeStatus allocatorSet(AllocTag tag, const Allocator *allocator);
+
+/**
+ * @brief The allocator currently serving a tag (never NULL for a valid tag).
+ * @param tag subsystem
+ */
+const Allocator *allocatorGet(AllocTag tag);
+
+/**
+ * @brief Fixed-size blocks from malloc'd slabs, kept on a free list.
+ * @param blockSize largest request served from the slabs; bigger ones go to malloc
+ * @param blocksPerSlab blocks per slab (0 = POOL_BLOCKS_PER_SLAB)
+ * @return the allocator, or NULL if memory ran out
+ * Why we made it: Nodes and owners all have the same size; a pool packs them
+ * without per-block malloc overhead and its footprint only follows the peak.
+ */
+Allocator *poolAllocatorCreate(size_t blockSize, int blocksPerSlab);
+
+/**
+ * @brief Hands out memory from chunks by bumping an offset.
+ * @param chunkSize bytes per chunk (0 = BUMP_CHUNK_SIZE); bigger requests go to malloc
+ * @return the allocator, or NULL if memory ran out
+ * Why we made it: For scratch memory. Releases only count down; once nothing
+ * is live the chunks are reused from the start, so it never grows past the
+ * busiest command.
+ */
+Allocator *bumpAllocatorCreate(size_t chunkSize);
+
+/**
+ * @brief Free a pool or bump allocator and its memory.
+ * @param allocator from poolAllocatorCreate or bumpAllocatorCreate
+ * @return POKE_OK, POKE_ERR_ALLOCATOR_BUSY (installed or blocks still live) or POKE_ERR_INVALID_ARG
+ */
+PokeStatus allocatorDestroy(Allocator *allocator);
+
+/**
+ * @brief Set allocators from a string such as "nodes=pool,scratch=bump:65536".
+ * @param spec comma-separated tag=kind pairs; kind is malloc, pool[:blockSize] or bump[:chunkSize]
+ * @return POKE_OK, POKE_ERR_INVALID_ARG (nothing is changed then) or POKE_ERR_NO_MEMORY
+ * Why we made it: main reads it from EX6_ALLOCATORS, so no rebuild is needed.
+ */
+PokeStatus allocatorConfigure(const char *spec);
+
+/**
+ * @brief Give back a block the library handed out (myStrdup).
+ * @param ptr the block, or NULL
+ */
+void allocatorFree(void *ptr);
+
+/**
+ * @brief Name of a tag ("owners", "nodes", ...), for reports and allocatorConfigure.
+ * @param tag the enum
+ */
+const char *getAllocTagName(AllocTag tag);
+
+/* ------------------------------------------------------------
+   33) Queries
+   ------------------------------------------------------------ */
+
+// A query is one line of space-separated terms, for one owner or all:
+//   owner=Ash          a name, or a pattern such as Kanto*; every owner if left out
+//   type=FIRE name=Char*   type, and a pattern on the species name
+//   id>=10 hp>50 attack<=80   with =, <, <=, > or >=; ranges narrow each other
+//   sort=attack        id, hp, attack or name; sort=-attack for descending
+//   limit=10 explain   at most 10 rows; explain also shows the plan
+// Without sort=, rows come in ring order of owners, then by ID.
+//
+// queryCompile folds the terms into ranges once. queryRun then plans every
+// owner on its own and picks the cheaper of:
+// - a scan of the BST in ID order that skips subtrees outside the ID range;
+// - probing the BST for each species a species index (by type, HP, attack
+//   or name) lists inside the query's ranges.
+// The estimate uses the owner's size and depth, the subtree sizes (how many
+// of its Pokemon fall in the ID range) and how many species pass every
+// filter. Owners with none of the type asked for are skipped from their
+// type counts, and when a path yields rows already in the sorted order a
+// limit stops each owner after that many rows. Across owners a sorted limit
+// keeps only the best rows so far, and rows that cannot beat them are dropped.
+
+#define QUERY_TEXT_MAX 64
+
+typedef enum
+{
+    QUERY_SORT_NONE,
+    QUERY_SORT_ID,
+    QUERY_SORT_HP,
+    QUERY_SORT_ATTACK,
+    QUERY_SORT_NAME
+} QuerySort;
+
+typedef enum
+{
+    QUERY_ACCESS_SCAN,   // BST in ID order, pruned to the ID range
+    QUERY_ACCESS_TYPE,   // species of the type, in ID order
+    QUERY_ACCESS_HP,     // species by HP
+    QUERY_ACCESS_ATTACK, // species by attack
+    QUERY_ACCESS_NAME,   // species by name
+    QUERY_ACCESS_COUNT
+} QueryAccess;
+
+typedef struct
+{
+    char owner[QUERY_TEXT_MAX]; // Name or pattern; empty for every owner
+    char name[QUERY_TEXT_MAX];  // Species name pattern; empty for any
+    int type;                   // PokemonType, -1 for any
+    int idMin, idMax;           // Inclusive ranges
+    int hpMin, hpMax;
+    int attackMin, attackMax;
+    QuerySort sort;
+    int descending;
+    int limit;                  // 0 for no limit
+    int explain;
+    char error[QUERY_TEXT_MAX + 32]; // Why queryCompile refused the text
+} Query;
+
+typedef struct
+{
+    int ownersMatched;          // Owners the owner term selects
+    int ownersSkipped;          // Ruled out without walking their tree
+    int ownersByAccess[QUERY_ACCESS_COUNT];
+    int perOwnerStop;           // Rows after which an owner stops (0 = no early stop)
+    long estimatedSteps;        // Nodes visited, as planned
+    long actualSteps;           // Nodes visited, as run
+    long matched;               // Rows found before the limit
+} QueryPlan;
+
+typedef struct
+{
+    OwnerNode *owner;
+    int ownerPosition;          // Place in the ring, from 1
+    const PokemonData *species;
+} QueryRow;
+
+typedef struct
+{
+    QueryRow *rows;             // Sorted, at most limit of them
+    int count;
+    QueryPlan plan;
+} QueryResult;
+
+/**
+ * @brief Parse a query line.
+ * @param text the terms
+ * @param query receives the compiled query
+ * @return POKE_OK, or POKE_ERR_INVALID_ARG with the reason in query->error
+ */
+PokeStatus queryCompile(const char *text, Query *query);
+
+/**
+ * @brief Plan and run a compiled query on snapshots of the selected owners.
+ * @param reg the registry
+ * @param query from queryCompile
+ * @param result receives the rows and the plan; free it with queryResultFree
+ * @return POKE_OK, POKE_ERR_INVALID_ARG or POKE_ERR_NO_MEMORY
+ * Why we made it: Answers questions without a one-off scan for each. Rows
+ * point at owners as the leaderboard does, valid while the owner stays.
+ */
+PokeStatus queryRun(Registry *reg, const Query *query, QueryResult *result);
+
+/**
+ * @brief Free the rows of a result (an empty result is fine).
+ * @param result from queryRun
+ */
+void queryResultFree(QueryResult *result);
+
+/**
+ * @brief Short name of an access path, for explain output.
+ * @param access the enum
+ */
+const char *getQueryAccessName(QueryAccess access);
+
+/**
+ * @brief Main-menu command: read a query line and print the rows.
+ * @param reg the registry
+ */
+void queryMenu(Registry *reg);
 
 // Array of Pokemon data
 static const PokemonData pokedex[] = {
@@ -0,0 +1,629 @@
+// Workload generator and replay driver for the Pokedex menus.
+//
+// Build (links everything in ex6.c except main):
+//   gcc -O2 -std=c99 -pthread -DEX6_NO_MAIN ex6.c workload.c -o workload
+//
+// Generate a seeded script (written to stdout):
+//   ./workload gen [--seed N] [--owners N] [--ops N] [--mix add=40,release=10,...]
+// Mix keys: add release evolve fight display merge delete sort print report
+// clone undo bulkadd bulkrelease leaderboard simulate matchup pages mergemany
+// query.
+// Owners are created first, then --ops commands are drawn from the mix.
+//
+// Replay a script through the real mainMenu dispatch and print per-command
+// latency percentiles (menu output goes to /dev/null unless --show is given):
+//   ./workload replay script.txt [--show]
+// EX6_ALLOCATORS is honoured as in ex6 (e.g. nodes=pool,scratch=bump), and the
+// bytes requested and the peak footprint per subsystem follow the latencies.
+//
+// The generator simulates the registry (ring order, sort, merge, evolve rules)
+// so every line it emits is consumed exactly where the menus expect it.
+#include "ex6.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+# define SPECIES 151
+# define NAME_LEN 16
+# define MIX_KINDS 20
+
+typedef enum
+{
+    MIX_ADD,
+    MIX_RELEASE,
+    MIX_EVOLVE,
+    MIX_FIGHT,
+    MIX_DISPLAY,
+    MIX_MERGE,
+    MIX_DELETE,
+    MIX_SORT,
+    MIX_PRINT,
+    MIX_REPORT,
+    MIX_CLONE,
+    MIX_UNDO,
+    MIX_BULK_ADD,
+    MIX_BULK_RELEASE,
+    MIX_LEADERBOARD,
+    MIX_SIMULATE,
+    MIX_MATCHUP,
+    MIX_PAGES,
+    MIX_MERGE_MANY,
+    MIX_QUERY
+} MixKind;
+
+static const char *mixNames[MIX_KINDS] = {"add", "release", "evolve", "fight", "display",
+                                          "merge", "delete", "sort", "print", "report",
+                                          "clone", "undo", "bulkadd", "bulkrelease", "leaderboard",
+                                          "simulate", "matchup", "pages", "mergemany", "query"};
+
+// Default traffic shape: mostly Pokedex edits and lookups, rare owner churn
+static int mixWeights[MIX_KINDS] = {40, 10, 10, 20, 5, 2, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+typedef struct
+{
+    char name[NAME_LEN];
+    unsigned char has[SPECIES + 2]; // has[id] for ids 1..151
+    int count;
+    // Earlier states, oldest first, as the registry keeps them for undo
+    unsigned char undoHas[POKEDEX_UNDO_DEPTH][SPECIES + 2];
+    int undoSize[POKEDEX_UNDO_DEPTH];
+    int undoCount;
+} SimOwner;
+
+typedef struct
+{
+    SimOwner *owners;
+    int count;
+    int cap;
+    int nextName;
+} SimRegistry;
+
+static unsigned long long rngState = 1;
+
+// --------------------------------------------------------------
+// Generator
+// --------------------------------------------------------------
+
+static unsigned int nextRand(void) {
+    // xorshift64*
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (unsigned int)((rngState * 2685821657736338717ULL) >> 32);
+}
+
+static int randBelow(int n) {
+    return (int)(nextRand() % (unsigned int)n);
+}
+
+static int randomOwnedId(const SimOwner *owner) {
+    int pick = randBelow(owner->count);
+    for (int id = 1; id <= SPECIES; id++) {
+        if (owner->has[id] && pick-- == 0)
+            return id;
+    }
+    return 1;
+}
+
+static SimOwner *simNewOwner(SimRegistry *reg) {
+    if (reg->count == reg->cap) {
+        int cap = reg->cap ? reg->cap * 2 : 64;
+        SimOwner *bigger = (SimOwner *)realloc(reg->owners, sizeof(SimOwner) * cap);
+        if (bigger == NULL)
+            return NULL;
+        reg->owners = bigger;
+        reg->cap = cap;
+    }
+    SimOwner *owner = &reg->owners[reg->count++];
+    memset(owner, 0, sizeof(*owner));
+    // Names are drawn out of order so sorting has real work to do
+    snprintf(owner->name, NAME_LEN, "T%05u%04d", nextRand() % 100000u, reg->nextName++);
+    return owner;
+}
+
+static void simAddOwner(SimRegistry *reg) {
+    static const int starters[] = {1, 4, 7};
+    int starter = randBelow(3);
+    SimOwner *owner = simNewOwner(reg);
+    if (owner == NULL)
+        return;
+    owner->has[starters[starter]] = 1;
+    owner->count = 1;
+    printf("1\n%s\n%d\n", owner->name, starter + 1);
+}
+
+static void simRemoveOwner(SimRegistry *reg, int index) {
+    memmove(&reg->owners[index], &reg->owners[index + 1], sizeof(SimOwner) * (reg->count - index - 1));
+    reg->count--;
+}
+
+// Folds the marked owners into target and drops them, as registryMergeMany does
+static int compareSimOwners(const void *a, const void *b) {
+    return strcmp(((const SimOwner *)a)->name, ((const SimOwner *)b)->name);
+}
+
+// Remember the owner's state before a change, dropping the oldest when full
+static void simRecordUndo(SimOwner *owner) {
+    if (owner->undoCount == POKEDEX_UNDO_DEPTH) {
+        memmove(owner->undoHas[0], owner->undoHas[1], sizeof(owner->undoHas[0]) * (POKEDEX_UNDO_DEPTH - 1));
+        memmove(owner->undoSize, owner->undoSize + 1, sizeof(int) * (POKEDEX_UNDO_DEPTH - 1));
+        owner->undoCount--;
+    }
+    memcpy(owner->undoHas[owner->undoCount], owner->has, sizeof(owner->has));
+    owner->undoSize[owner->undoCount++] = owner->count;
+}
+
+static void simMergeMany(SimRegistry *reg, int target, const unsigned char *picked) {
+    SimOwner *into = &reg->owners[target];
+    unsigned char has[SPECIES + 2];
+    memcpy(has, into->has, sizeof(has));
+    int count = into->count;
+    for (int i = 0; i < reg->count; i++) {
+        for (int id = 1; picked[i] && id <= SPECIES; id++) {
+            if (reg->owners[i].has[id] && !has[id]) {
+                has[id] = 1;
+                count++;
+            }
+        }
+    }
+    // Nothing new keeps the target's undo history as it is
+    if (count > into->count) {
+        simRecordUndo(into);
+        memcpy(into->has, has, sizeof(has));
+        into->count = count;
+    }
+    int kept = 0;
+    for (int i = 0; i < reg->count; i++) {
+        if (!picked[i])
+            reg->owners[kept++] = reg->owners[i];
+    }
+    reg->count = kept;
+}
+
+// One sub-menu command against the given owner, mirroring what the menus read
+static void simPokedexCommand(SimOwner *owner, MixKind kind) {
+    switch (kind) {
+    case MIX_ADD: {
+        int id = 1 + randBelow(SPECIES);
+        printf("1\n%d\n", id);
+        if (!owner->has[id]) {
+            simRecordUndo(owner);
+            owner->has[id] = 1;
+            owner->count++;
+        }
+        break;
+    }
+    case MIX_DISPLAY:
+        printf("2\n");
+        if (owner->count > 0)
+            printf("%d\n", 1 + randBelow(5));
+        break;
+    case MIX_RELEASE:
+        printf("3\n");
+        if (owner->count > 0) {
+            // Mostly hits, sometimes a miss
+            int id = randBelow(10) ? randomOwnedId(owner) : 1 + randBelow(SPECIES);
+            printf("%d\n", id);
+            if (owner->has[id]) {
+                simRecordUndo(owner);
+                owner->has[id] = 0;
+                owner->count--;
+            }
+        }
+        break;
+    case MIX_FIGHT:
+        printf("4\n");
+        if (owner->count > 0)
+            printf("%d\n%d\n", randomOwnedId(owner), randomOwnedId(owner));
+        break;
+    case MIX_PAGES: {
+        printf("11\n");
+        if (owner->count == 0)
+            break;
+        int size = 1 + randBelow(20);
+        int pages = (owner->count + size - 1) / size;
+        int shown = 1 + randBelow(pages);
+        printf("%d\n%d\n", 1 + randBelow(5), size);
+        // The menu asks after every page but the last
+        for (int page = 1; page < shown; page++)
+            printf("1\n");
+        if (shown < pages)
+            printf("0\n");
+        break;
+    }
+    case MIX_SIMULATE:
+        printf("10\n");
+        if (owner->count > 0)
+            printf("%d\n%d\n%d\n", randomOwnedId(owner), randomOwnedId(owner), 1000 * (1 + randBelow(100)));
+        break;
+    case MIX_EVOLVE:
+        printf("5\n");
+        if (owner->count > 0) {
+            int id = randomOwnedId(owner);
+            printf("%d\n", id);
+            if (pokedex[id - 1].CAN_EVOLVE == CAN_EVOLVE) {
+                simRecordUndo(owner);
+                owner->has[id] = 0;
+                if (owner->has[id + 1])
+                    owner->count--;
+                else
+                    owner->has[id + 1] = 1;
+            }
+        }
+        break;
+    case MIX_BULK_ADD: {
+        // One range of up to 20 IDs
+        int first = 1 + randBelow(SPECIES);
+        int last = first + randBelow(20);
+        if (last > SPECIES)
+            last = SPECIES;
+        printf("8\n%d-%d\n", first, last);
+        int fresh = 0;
+        for (int id = first; id <= last; id++)
+            fresh += !owner->has[id];
+        if (fresh == 0)
+            break;
+        simRecordUndo(owner);
+        for (int id = first; id <= last; id++)
+            owner->has[id] = 1;
+        owner->count += fresh;
+        break;
+    }
+    case MIX_BULK_RELEASE: {
+        // One range of up to 20 IDs; an empty Pokedex reads nothing
+        if (owner->count == 0)
+            break;
+        int first = 1 + randBelow(SPECIES);
+        int last = first + randBelow(20);
+        if (last > SPECIES)
+            last = SPECIES;
+        printf("9\n%d-%d\n", first, last);
+        int owned = 0;
+        for (int id = first; id <= last; id++)
+            owned += owner->has[id];
+        if (owned == 0)
+            break;
+        simRecordUndo(owner);
+        for (int id = first; id <= last; id++)
+            owner->has[id] = 0;
+        owner->count -= owned;
+        break;
+    }
+    case MIX_UNDO:
+        printf("7\n");
+        if (owner->undoCount > 0) {
+            owner->undoCount--;
+            memcpy(owner->has, owner->undoHas[owner->undoCount], sizeof(owner->has));
+            owner->count = owner->undoSize[owner->undoCount];
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static MixKind drawMix(int total) {
+    int pick = randBelow(total);
+    for (int k = 0; k < MIX_KINDS; k++) {
+        if (pick < mixWeights[k])
+            return (MixKind)k;
+        pick -= mixWeights[k];
+    }
+    return MIX_ADD;
+}
+
+static int parseMix(const char *spec) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", spec);
+    for (char *item = strtok(buffer, ","); item; item = strtok(NULL, ",")) {
+        char *eq = strchr(item, '=');
+        if (eq == NULL)
+            return 0;
+        *eq = '\0';
+        int k = 0;
+        while (k < MIX_KINDS && strcmp(mixNames[k], item) != 0)
+            k++;
+        if (k == MIX_KINDS || atoi(eq + 1) < 0)
+            return 0;
+        mixWeights[k] = atoi(eq + 1);
+    }
+    return 1;
+}
+
+static int generate(int argc, char **argv) {
+    int owners = 1000;
+    long ops = 10000;
+    rngState = 42;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            rngState = strtoull(argv[++i], NULL, 10) * 2654435761ULL + 1;
+        } else if (strcmp(argv[i], "--owners") == 0 && i + 1 < argc) {
+            owners = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            ops = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--mix") == 0 && i + 1 < argc) {
+            if (!parseMix(argv[++i])) {
+                fprintf(stderr, "Invalid --mix, expected e.g. add=40,fight=20\n");
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    int total = 0;
+    for (int k = 0; k < MIX_KINDS; k++)
+        total += mixWeights[k];
+    if (total <= 0) {
+        fprintf(stderr, "The mix must have at least one positive weight\n");
+        return 1;
+    }
+
+    SimRegistry reg = {NULL, 0, 0, 0};
+    for (int i = 0; i < owners; i++)
+        simAddOwner(&reg);
+
+    for (long op = 0; op < ops; op++) {
+        MixKind kind = drawMix(total);
+        // Keep the registry populated as deletes and merges drain it
+        if (reg.count == 0 || (reg.count < owners / 2 && randBelow(4) == 0)) {
+            simAddOwner(&reg);
+            continue;
+        }
+        switch (kind) {
+        case MIX_MERGE: {
+            printf("4\n");
+            if (reg.count < 2)
+                break;
+            int a = randBelow(reg.count);
+            int b = randBelow(reg.count - 1);
+            if (b >= a)
+                b++;
+            printf("%s\n%s\n", reg.owners[a].name, reg.owners[b].name);
+            simRecordUndo(&reg.owners[a]);
+            for (int id = 1; id <= SPECIES; id++) {
+                if (reg.owners[b].has[id] && !reg.owners[a].has[id]) {
+                    reg.owners[a].has[id] = 1;
+                    reg.owners[a].count++;
+                }
+            }
+            simRemoveOwner(&reg, b);
+            break;
+        }
+        case MIX_DELETE: {
+            int index = randBelow(reg.count);
+            printf("3\n%d\n", index + 1);
+            simRemoveOwner(&reg, index);
+            break;
+        }
+        case MIX_SORT:
+            printf("5\n");
+            qsort(reg.owners, reg.count, sizeof(SimOwner), compareSimOwners);
+            break;
+        case MIX_PRINT:
+            printf("6\n%c\n%d\n", randBelow(2) ? 'F' : 'B', 1 + randBelow(2 * reg.count));
+            break;
+        case MIX_REPORT:
+            printf("8\n%d\n", 1 + randBelow(5));
+            break;
+        case MIX_CLONE: {
+            int index = randBelow(reg.count);
+            SimOwner *copy = simNewOwner(&reg);
+            if (copy == NULL)
+                break;
+            // simNewOwner may have moved the array
+            SimOwner *source = &reg.owners[index];
+            memcpy(copy->has, source->has, sizeof(copy->has));
+            copy->count = source->count;
+            printf("10\n%d\n%s\n", index + 1, copy->name);
+            break;
+        }
+        case MIX_LEADERBOARD:
+            printf("11\n");
+            break;
+        case MIX_MATCHUP: {
+            printf("12\n");
+            if (reg.count < 2)
+                break;
+            int a = randBelow(reg.count);
+            int b = randBelow(reg.count - 1);
+            if (b >= a)
+                b++;
+            printf("%s\n%s\n%d\n", reg.owners[a].name, reg.owners[b].name, 1 + randBelow(2));
+            break;
+        }
+        case MIX_MERGE_MANY: {
+            printf("13\n");
+            if (reg.count < 2)
+                break;
+            unsigned char *picked = (unsigned char *)calloc(reg.count, 1);
+            if (picked == NULL)
+                break;
+            int target = randBelow(reg.count);
+            printf("%s\n", reg.owners[target].name);
+            if (randBelow(2)) {
+                // A two-digit prefix picks about one owner in a hundred
+                char prefix[4];
+                snprintf(prefix, sizeof(prefix), "T%02d", randBelow(100));
+                printf("%s*\n", prefix);
+                for (int i = 0; i < reg.count; i++)
+                    picked[i] = i != target && strncmp(reg.owners[i].name, prefix, 3) == 0;
+            } else {
+                int names = 2 + randBelow(3);
+                for (int n = 0; n < names; n++) {
+                    int index = randBelow(reg.count);
+                    printf("%s%s", n ? ", " : "", reg.owners[index].name);
+                    picked[index] = index != target;
+                }
+                printf("\n");
+            }
+            simMergeMany(&reg, target, picked);
+            free(picked);
+            break;
+        }
+        case MIX_QUERY: {
+            // Half ask one owner, half ask everyone; the menu does not change anything
+            static const char *types[] = {"FIRE", "WATER", "GRASS", "NORMAL", "PSYCHIC"};
+            static const char *sorts[] = {"", " sort=id", " sort=-hp", " sort=attack", " sort=name"};
+            printf("14\n");
+            if (randBelow(2))
+                printf("owner=%s ", reg.owners[randBelow(reg.count)].name);
+            if (randBelow(2))
+                printf("type=%s ", types[randBelow(5)]);
+            printf("hp>%d%s limit=%d\n", 20 + randBelow(80), sorts[randBelow(5)], 1 + randBelow(20));
+            break;
+        }
+        default: {
+            // Enter one Pokedex and issue a short burst of sub-menu commands
+            int index = randBelow(reg.count);
+            printf("2\n%d\n", index + 1);
+            int burst = 1 + randBelow(4);
+            simPokedexCommand(&reg.owners[index], kind);
+            for (int b = 1; b < burst && op + 1 < ops; b++, op++) {
+                MixKind next = drawMix(total);
+                if (next <= MIX_DISPLAY || next == MIX_UNDO || next == MIX_BULK_ADD ||
+                    next == MIX_BULK_RELEASE || next == MIX_SIMULATE || next == MIX_PAGES)
+                    simPokedexCommand(&reg.owners[index], next);
+            }
+            printf("6\n");
+            break;
+        }
+        }
+    }
+    printf("7\n");
+    free(reg.owners);
+    return 0;
+}
+
+// --------------------------------------------------------------
+// Replay driver
+// --------------------------------------------------------------
+
+typedef struct
+{
+    unsigned long long *samples;
+    long count;
+    long cap;
+} LatencySeries;
+
+static LatencySeries series[CMD_COUNT];
+// Largest footprint per subsystem seen between commands
+static size_t peakReserved[ALLOC_TAG_COUNT];
+
+static void recordCommand(CommandKind kind, unsigned long long elapsedNs) {
+    for (int t = 0; t < ALLOC_TAG_COUNT; t++) {
+        const Allocator *allocator = allocatorGet((AllocTag)t);
+        size_t reserved = allocator->reserved ? allocator->reserved(allocator->state) : 0;
+        if (reserved > peakReserved[t])
+            peakReserved[t] = reserved;
+    }
+    LatencySeries *s = &series[kind];
+    if (s->count == s->cap) {
+        long cap = s->cap ? s->cap * 2 : 1024;
+        unsigned long long *bigger = (unsigned long long *)realloc(s->samples, sizeof(unsigned long long) * cap);
+        if (bigger == NULL)
+            return;
+        s->samples = bigger;
+        s->cap = cap;
+    }
+    s->samples[s->count++] = elapsedNs;
+}
+
+static unsigned long long nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static int compareU64(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+static unsigned long long percentile(const LatencySeries *s, double p) {
+    long index = (long)(p * (double)(s->count - 1) + 0.5);
+    return s->samples[index];
+}
+
+static int replay(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: workload replay script.txt [--show]\n");
+        return 1;
+    }
+    int show = argc > 3 && strcmp(argv[3], "--show") == 0;
+    if (freopen(argv[2], "r", stdin) == NULL) {
+        fprintf(stderr, "Cannot open %s\n", argv[2]);
+        return 1;
+    }
+    // The table goes to the original stdout; the menus talk to /dev/null
+    fflush(stdout);
+    FILE *table = fdopen(dup(STDOUT_FILENO), "w");
+    if (table == NULL)
+        return 1;
+    if (!show) {
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull >= 0) {
+            dup2(devNull, STDOUT_FILENO);
+            close(devNull);
+        }
+    }
+
+    // Same allocator settings as the interactive program
+    const char *allocators = getenv("EX6_ALLOCATORS");
+    if (allocators != NULL && allocatorConfigure(allocators) != POKE_OK) {
+        fprintf(stderr, "Invalid EX6_ALLOCATORS %s\n", allocators);
+        return 1;
+    }
+    setCommandObserver(recordCommand);
+    unsigned long long wallStart = nowNs();
+    Registry *reg = registryCreate();
+    if (reg == NULL)
+        return 1;
+    // Same settings as the interactive program
+    registrySetUndoDepth(reg, POKEDEX_UNDO_DEPTH);
+    mainMenu(reg);
+    unsigned long long wall = nowNs() - wallStart;
+    setCommandObserver(NULL);
+    registryDestroy(reg);
+    PerfCounters totals;
+    perfSnapshot(&totals);
+    fflush(stdout);
+
+    long commands = 0;
+    fprintf(table, "%-10s %10s %12s %12s %12s %12s %14s\n",
+            "command", "count", "p50 ns", "p90 ns", "p99 ns", "max ns", "total ms");
+    for (int k = 0; k < CMD_COUNT; k++) {
+        LatencySeries *s = &series[k];
+        if (s->count == 0)
+            continue;
+        qsort(s->samples, s->count, sizeof(unsigned long long), compareU64);
+        unsigned long long total = 0;
+        for (long i = 0; i < s->count; i++)
+            total += s->samples[i];
+        fprintf(table, "%-10s %10ld %12llu %12llu %12llu %12llu %14.3f\n",
+                getCommandName((CommandKind)k), s->count,
+                percentile(s, 0.50), percentile(s, 0.90), percentile(s, 0.99),
+                s->samples[s->count - 1], (double)total / 1e6);
+        commands += s->count;
+        free(s->samples);
+    }
+    fprintf(table, "%ld commands in %.3f ms (%.0f commands/sec)\n",
+            commands, (double)wall / 1e6, wall ? (double)commands * 1e9 / (double)wall : 0.0);
+    fprintf(table, "%-10s %-8s %12s %14s %14s\n", "subsystem", "via", "allocs", "bytes", "peak reserved");
+    for (int t = 0; t < ALLOC_TAG_COUNT; t++) {
+        fprintf(table, "%-10s %-8s %12llu %14llu %14zu\n", getAllocTagName((AllocTag)t),
+                allocatorGet((AllocTag)t)->name, totals.tagAllocs[t], totals.tagBytes[t], peakReserved[t]);
+    }
+    fclose(table);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "gen") == 0)
+        return generate(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "replay") == 0)
+        return replay(argc, argv);
+    fprintf(stderr, "Usage: workload gen [options] | workload replay script.txt [--show]\n");
+    return 1;
+}